@@ -0,0 +1,401 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+/* Micro-benchmarks of the crypto primitives used by the firmware.
+ *
+ * Every benchmark is warmed up, then timed over BENCH_SAMPLES samples. Each
+ * sample runs a batch of operations sized so that it lasts about
+ * BENCH_SAMPLE_NS, the per operation time of the samples gives the median and
+ * the 99th percentile. Results can be written as JSON and compared against a
+ * baseline written by a previous run.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "skycoin_crypto.h"
+#include "skycoin_signature.h"
+#include "tools/base58.h"
+#include "tools/bip39.h"
+#include "tools/bip44.h"
+#include "tools/ripemd160.h"
+#include "tools/sha2.h"
+
+#define BENCH_WARMUP_NS 50000000ULL
+#define BENCH_SAMPLE_NS 2000000ULL
+#define BENCH_SAMPLES 101
+// Default slowdown of the median tolerated against the baseline, in percent
+#define BENCH_TOLERANCE 10.0
+
+// m/44'/8000'/0'/0/i
+#define BENCH_PURPOSE 0x8000002C
+#define BENCH_COIN_TYPE (0x80000000 + 8000)
+#define BENCH_ACCOUNT 0x80000000
+
+#define BENCH_MNEMONIC "cloud flower upset remain green metal below cup stem infant art thank"
+
+typedef struct {
+    const char* name;
+    void (*run)(uint32_t iteration);
+} Benchmark;
+
+typedef struct {
+    double median_ns;
+    double p99_ns;
+    double ops_per_sec;
+    uint32_t batch;
+} BenchResult;
+
+static uint8_t bench_seed[32];
+static uint8_t bench_seckey[32];
+static uint8_t bench_pubkey[33];
+static uint8_t bench_digest[32];
+static uint8_t bench_sig[65];
+static uint8_t bench_data[1024];
+static char bench_address[36];
+static volatile uint8_t bench_sink;
+
+static void bench_key_pair_iterator(uint32_t iteration)
+{
+    uint8_t seed[32];
+    uint8_t next_seed[32];
+    uint8_t seckey[32];
+    uint8_t pubkey[33];
+    memcpy(seed, bench_seed, sizeof(seed));
+    seed[0] = iteration;
+    deterministic_key_pair_iterator(seed, sizeof(seed), next_seed, seckey, pubkey);
+    bench_sink ^= pubkey[1];
+}
+
+static void bench_address_from_pubkey(uint32_t iteration)
+{
+    (void)iteration;
+    char address[36];
+    size_t size = sizeof(address);
+    skycoin_address_from_pubkey(bench_pubkey, address, &size);
+    bench_sink ^= address[1];
+}
+
+static void bench_sign_digest(uint32_t iteration)
+{
+    uint8_t digest[32];
+    uint8_t sig[65];
+    memcpy(digest, bench_digest, sizeof(digest));
+    digest[0] = iteration;
+    skycoin_ecdsa_sign_digest(bench_seckey, digest, sig);
+    bench_sink ^= sig[0];
+}
+
+static void bench_verify_digest_recover(uint32_t iteration)
+{
+    (void)iteration;
+    uint8_t pubkey[33];
+    skycoin_ecdsa_verify_digest_recover(bench_sig, bench_digest, pubkey);
+    bench_sink ^= pubkey[1];
+}
+
+static void bench_mnemonic_to_seed(uint32_t iteration)
+{
+    // a new passphrase every time so the BIP39 cache does not answer
+    char passphrase[16];
+    uint8_t seed[64];
+    snprintf(passphrase, sizeof(passphrase), "%u", iteration);
+    mnemonic_to_seed(BENCH_MNEMONIC, passphrase, seed, NULL);
+    bench_sink ^= seed[0];
+}
+
+static void bench_hdnode_keypair_for_branch(uint32_t iteration)
+{
+    uint8_t seckey[32];
+    uint8_t pubkey[33];
+    hdnode_keypair_for_branch(bench_seed, sizeof(bench_seed), BENCH_PURPOSE, BENCH_COIN_TYPE, BENCH_ACCOUNT, 0, iteration & 0x7FFFFFFF, seckey, pubkey);
+    bench_sink ^= pubkey[1];
+}
+
+static void bench_b58enc(uint32_t iteration)
+{
+    char b58[64];
+    size_t size = sizeof(b58);
+    bench_data[0] = iteration;
+    b58enc(b58, &size, bench_data, 25);
+    bench_sink ^= b58[0];
+}
+
+static void bench_b58tobin(uint32_t iteration)
+{
+    (void)iteration;
+    uint8_t bin[25];
+    size_t size = sizeof(bin);
+    b58tobin(bin, &size, bench_address);
+    bench_sink ^= bin[0];
+}
+
+static void bench_sha256(uint32_t iteration)
+{
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    bench_data[0] = iteration;
+    sha256_Raw(bench_data, sizeof(bench_data), digest);
+    bench_sink ^= digest[0];
+}
+
+static void bench_sha512(uint32_t iteration)
+{
+    uint8_t digest[SHA512_DIGEST_LENGTH];
+    bench_data[0] = iteration;
+    sha512_Raw(bench_data, sizeof(bench_data), digest);
+    bench_sink ^= digest[0];
+}
+
+static void bench_ripemd160(uint32_t iteration)
+{
+    uint8_t digest[RIPEMD160_DIGEST_LENGTH];
+    bench_data[0] = iteration;
+    ripemd160(bench_data, sizeof(bench_data), digest);
+    bench_sink ^= digest[0];
+}
+
+static const Benchmark benchmarks[] = {
+    {"deterministic_key_pair_iterator", bench_key_pair_iterator},
+    {"skycoin_address_from_pubkey", bench_address_from_pubkey},
+    {"skycoin_ecdsa_sign_digest", bench_sign_digest},
+    {"skycoin_ecdsa_verify_digest_recover", bench_verify_digest_recover},
+    {"mnemonic_to_seed", bench_mnemonic_to_seed},
+    {"hdnode_keypair_for_branch", bench_hdnode_keypair_for_branch},
+    {"b58enc", bench_b58enc},
+    {"b58tobin", bench_b58tobin},
+    {"sha256_1k", bench_sha256},
+    {"sha512_1k", bench_sha512},
+    {"ripemd160_1k", bench_ripemd160},
+};
+
+#define BENCH_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/* Prepare the inputs and check the benchmarked calls succeed on them */
+static bool bench_setup(void)
+{
+    for (size_t i = 0; i < sizeof(bench_data); i++) {
+        bench_data[i] = i * 31 + 7;
+    }
+    sha256_Raw((const uint8_t*)BENCH_MNEMONIC, strlen(BENCH_MNEMONIC), bench_seed);
+    uint8_t next_seed[32];
+    uint8_t seckey[32];
+    uint8_t pubkey[33];
+    size_t size = sizeof(bench_address);
+    sha256_Raw(bench_data, sizeof(bench_data), bench_digest);
+    return deterministic_key_pair_iterator(bench_seed, sizeof(bench_seed), next_seed, bench_seckey, bench_pubkey) == 0 &&
+           skycoin_ecdsa_sign_digest(bench_seckey, bench_digest, bench_sig) == 0 &&
+           skycoin_ecdsa_verify_digest_recover(bench_sig, bench_digest, pubkey) == 0 &&
+           memcmp(pubkey, bench_pubkey, sizeof(pubkey)) == 0 &&
+           skycoin_address_from_pubkey(bench_pubkey, bench_address, &size) &&
+           hdnode_keypair_for_branch(bench_seed, sizeof(bench_seed), BENCH_PURPOSE, BENCH_COIN_TYPE, BENCH_ACCOUNT, 0, 0, seckey, pubkey) == 1;
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_compare_double(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_run(const Benchmark* bench, uint32_t samples, BenchResult* result)
+{
+    static double sample_ns[BENCH_SAMPLES * 10];
+    uint32_t iteration = 0;
+
+    // warm up caches and clocks while finding how many operations fill a sample
+    uint32_t ops = 0;
+    uint64_t start = bench_now_ns();
+    uint64_t elapsed;
+    do {
+        bench->run(iteration++);
+        ops++;
+        elapsed = bench_now_ns() - start;
+    } while (elapsed < BENCH_WARMUP_NS);
+    uint64_t batch = BENCH_SAMPLE_NS * ops / elapsed;
+    result->batch = batch > 0 ? batch : 1;
+
+    for (uint32_t s = 0; s < samples; s++) {
+        start = bench_now_ns();
+        for (uint32_t i = 0; i < result->batch; i++) {
+            bench->run(iteration++);
+        }
+        sample_ns[s] = (double)(bench_now_ns() - start) / result->batch;
+    }
+    qsort(sample_ns, samples, sizeof(sample_ns[0]), bench_compare_double);
+    result->median_ns = sample_ns[samples / 2];
+    result->p99_ns = sample_ns[(samples * 99 + 99) / 100 - 1];
+    result->ops_per_sec = 1e9 / result->median_ns;
+}
+
+/* Find the median of a benchmark in a JSON file written by bench_write_json */
+static bool bench_baseline_median(const char* json, const char* name, double* median_ns)
+{
+    char key[128];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    const char* entry = strstr(json, key);
+    if (entry == NULL) {
+        return false;
+    }
+    const char* field = strstr(entry, "\"median_ns\":");
+    const char* end = strchr(entry, '}');
+    if (field == NULL || (end != NULL && field > end)) {
+        return false;
+    }
+    *median_ns = strtod(field + strlen("\"median_ns\":"), NULL);
+    return *median_ns > 0;
+}
+
+static char* bench_read_file(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* buffer = size >= 0 ? malloc(size + 1) : NULL;
+    if (buffer != NULL) {
+        size_t n = fread(buffer, 1, size, f);
+        buffer[n] = 0;
+    }
+    fclose(f);
+    return buffer;
+}
+
+static bool bench_write_json(const char* path, const BenchResult* results, const bool* selected, uint32_t samples)
+{
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(f, "{\n  \"samples\": %u,\n  \"benchmarks\": [", samples);
+    const char* separator = "\n";
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        if (!selected[i]) {
+            continue;
+        }
+        fprintf(f, "%s    {\"name\": \"%s\", \"batch\": %u, \"median_ns\": %.1f, \"p99_ns\": %.1f, \"ops_per_sec\": %.1f}",
+            separator, benchmarks[i].name, results[i].batch, results[i].median_ns, results[i].p99_ns, results[i].ops_per_sec);
+        separator = ",\n";
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+static void bench_usage(const char* program)
+{
+    fprintf(stderr,
+        "usage: %s [--json FILE] [--baseline FILE] [--tolerance PERCENT] [--samples N] [NAME...]\n"
+        "  --json FILE         write the results as JSON\n"
+        "  --baseline FILE     fail if a median is slower than in this JSON results file\n"
+        "  --tolerance PERCENT slowdown allowed against the baseline, default %.0f\n"
+        "  --samples N         timed samples per benchmark, default %d\n"
+        "  NAME                run only the benchmarks whose name contains NAME\n",
+        program, BENCH_TOLERANCE, BENCH_SAMPLES);
+}
+
+int main(int argc, char** argv)
+{
+    const char* json_path = NULL;
+    const char* baseline_path = NULL;
+    double tolerance = BENCH_TOLERANCE;
+    uint32_t samples = BENCH_SAMPLES;
+    const char* filters[16];
+    size_t filter_count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--json") == 0 && has_value) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && has_value) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && has_value) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--samples") == 0 && has_value) {
+            samples = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && filter_count < sizeof(filters) / sizeof(filters[0])) {
+            filters[filter_count++] = argv[i];
+        } else {
+            bench_usage(argv[0]);
+            return 2;
+        }
+    }
+    if (samples < 1 || samples > BENCH_SAMPLES * 10) {
+        fprintf(stderr, "samples must be between 1 and %d\n", BENCH_SAMPLES * 10);
+        return 2;
+    }
+
+    char* baseline = NULL;
+    if (baseline_path != NULL) {
+        baseline = bench_read_file(baseline_path);
+        if (baseline == NULL) {
+            perror(baseline_path);
+            return 2;
+        }
+    }
+
+    if (!bench_setup()) {
+        fprintf(stderr, "Failed to prepare the benchmark inputs\n");
+        return 2;
+    }
+
+    BenchResult results[BENCH_COUNT];
+    bool selected[BENCH_COUNT];
+    int regressions = 0;
+    printf("%-36s %10s %12s %12s %14s\n", "benchmark", "batch", "median ns", "p99 ns", "ops/s");
+    for (size_t i = 0; i < BENCH_COUNT; i++) {
+        selected[i] = filter_count == 0;
+        for (size_t f = 0; f < filter_count; f++) {
+            selected[i] |= strstr(benchmarks[i].name, filters[f]) != NULL;
+        }
+        if (!selected[i]) {
+            continue;
+        }
+        bench_run(&benchmarks[i], samples, &results[i]);
+        printf("%-36s %10u %12.1f %12.1f %14.1f", benchmarks[i].name, results[i].batch,
+            results[i].median_ns, results[i].p99_ns, results[i].ops_per_sec);
+
+        double baseline_ns;
+        if (baseline != NULL && bench_baseline_median(baseline, benchmarks[i].name, &baseline_ns)) {
+            double change = (results[i].median_ns / baseline_ns - 1.0) * 100.0;
+            printf("  %+6.1f%%", change);
+            if (change > tolerance) {
+                printf(" REGRESSION");
+                regressions++;
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+    free(baseline);
+
+    if (json_path != NULL && !bench_write_json(json_path, results, selected, samples)) {
+        return 2;
+    }
+    if (regressions > 0) {
+        fprintf(stderr, "%d benchmark(s) slower than the baseline by more than %.1f%%\n", regressions, tolerance);
+        return 1;
+    }
+    return 0;
+}
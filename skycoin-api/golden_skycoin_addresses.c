@@ -0,0 +1,478 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+/* Generator of address golden vectors, to cross-check this library against
+ * other Skycoin implementations.
+ *
+ * For every seed it walks the deterministic key pair chain used by the
+ * firmware once, then derives the BIP44 addresses m/44'/8000'/0'/0/i from the
+ * node of the external chain. Seeds are read from a file, one per line, or
+ * built from 128 bits of entropy sha256(base || index) as 12 word mnemonics.
+ *
+ * The BIP32, BIP39 and ECDSA code keeps its scratch buffers in static storage,
+ * so seeds are spread over worker processes instead of threads. Worker w
+ * handles the seeds whose index modulo the number of workers is w and sends
+ * one length prefixed block per seed through a pipe, the parent copies the
+ * blocks to the output in seed order so the result does not depend on --jobs.
+ *
+ * CSV output has one line per address:
+ *
+ *   seed,path,address[,pubkey,seckey]
+ *
+ * where path is d/i for the i-th address of the deterministic chain. Binary
+ * output starts with GOLDEN_MAGIC, a version byte, a flags byte and two zero
+ * bytes, then for every seed:
+ *
+ *   index        4 bytes little endian, position of the seed
+ *   seed_length  2 bytes little endian, then the seed
+ *   count        4 bytes little endian, deterministic addresses
+ *   bip44        4 bytes little endian, BIP44 addresses
+ *
+ * followed by count + bip44 records of the 25 byte address, with the 33 byte
+ * public key and 32 byte secret key when the GOLDEN_FLAG_KEYS flag is set.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "skycoin_constants.h"
+#include "skycoin_crypto.h"
+#include "tools/base58.h"
+#include "tools/bip32.h"
+#include "tools/bip39.h"
+#include "tools/curves.h"
+#include "tools/memzero.h"
+#include "tools/ripemd160.h"
+#include "tools/sha2.h"
+
+#define GOLDEN_MAGIC "SKAG"
+#define GOLDEN_VERSION 1
+#define GOLDEN_FLAG_KEYS 0x01
+
+#define GOLDEN_COUNT 10
+#define GOLDEN_MAX_SEED 1024
+#define GOLDEN_MAX_JOBS 256
+#define GOLDEN_ADDRESS_LEN (RIPEMD160_DIGEST_LENGTH + 1 + SKYCOIN_ADDRESS_CHECKSUM_LENGTH)
+
+// m/44'/8000'/0'/0/i
+#define GOLDEN_PURPOSE 0x8000002C
+#define GOLDEN_COIN_TYPE (0x80000000 + 8000)
+#define GOLDEN_ACCOUNT 0x80000000
+#define GOLDEN_CHANGE 0
+
+typedef struct {
+    const char* seeds_path;
+    uint64_t random;
+    uint64_t base;
+    uint32_t count;
+    uint32_t bip44;
+    bool keys;
+    bool binary;
+} GoldenOptions;
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} GoldenBuffer;
+
+static void golden_append(GoldenBuffer* buffer, const void* data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+        buffer->data = realloc(buffer->data, capacity);
+        if (buffer->data == NULL) {
+            perror("realloc");
+            exit(2);
+        }
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+static void golden_append_le(GoldenBuffer* buffer, uint32_t value, size_t size)
+{
+    uint8_t bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+    golden_append(buffer, bytes, size);
+}
+
+static void golden_append_hex(GoldenBuffer* buffer, const uint8_t* data, size_t size)
+{
+    char hex[2 * SKYCOIN_PUBKEY_LEN + 1];
+    tohex(hex, data, size);
+    golden_append(buffer, ",", 1);
+    golden_append(buffer, hex, 2 * size);
+}
+
+/* Append the record of one address, the hashes of the address are computed once for both formats */
+static void golden_append_address(GoldenBuffer* buffer, const GoldenOptions* options, const char* seed, const char* path, const uint8_t* pubkey, const uint8_t* seckey)
+{
+    uint8_t address[GOLDEN_ADDRESS_LEN] = {0};
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    skycoin_address_hash_from_pubkey(pubkey, address);
+    sha256_Raw(address, RIPEMD160_DIGEST_LENGTH + 1, digest);
+    memcpy(address + RIPEMD160_DIGEST_LENGTH + 1, digest, SKYCOIN_ADDRESS_CHECKSUM_LENGTH);
+    if (options->binary) {
+        golden_append(buffer, address, sizeof(address));
+        if (options->keys) {
+            golden_append(buffer, pubkey, SKYCOIN_PUBKEY_LEN);
+            golden_append(buffer, seckey, SKYCOIN_SECKEY_LEN);
+        }
+        return;
+    }
+    char b58[36];
+    size_t size = sizeof(b58);
+    b58enc(b58, &size, address, sizeof(address));
+    golden_append(buffer, seed, strlen(seed));
+    golden_append(buffer, ",", 1);
+    golden_append(buffer, path, strlen(path));
+    golden_append(buffer, ",", 1);
+    golden_append(buffer, b58, size - 1);
+    if (options->keys) {
+        golden_append_hex(buffer, pubkey, SKYCOIN_PUBKEY_LEN);
+        golden_append_hex(buffer, seckey, SKYCOIN_SECKEY_LEN);
+    }
+    golden_append(buffer, "\n", 1);
+}
+
+/* Walk the deterministic chain once, every step feeds the next one */
+static bool golden_deterministic(GoldenBuffer* buffer, const GoldenOptions* options, const char* seed)
+{
+    uint8_t chain[SHA256_DIGEST_LENGTH];
+    uint8_t next[SHA256_DIGEST_LENGTH];
+    uint8_t seckey[SKYCOIN_SECKEY_LEN];
+    uint8_t pubkey[SKYCOIN_PUBKEY_LEN];
+    char path[16];
+    for (uint32_t i = 0; i < options->count; i++) {
+        int ret = i == 0 ?
+                      deterministic_key_pair_iterator((const uint8_t*)seed, strlen(seed), next, seckey, pubkey) :
+                      deterministic_key_pair_iterator(chain, sizeof(chain), next, seckey, pubkey);
+        if (ret != 0) {
+            return false;
+        }
+        snprintf(path, sizeof(path), "d/%u", i);
+        golden_append_address(buffer, options, seed, path, pubkey, seckey);
+        memcpy(chain, next, sizeof(chain));
+    }
+    memzero(chain, sizeof(chain));
+    memzero(next, sizeof(next));
+    memzero(seckey, sizeof(seckey));
+    return true;
+}
+
+/* Derive the external chain node once, then only the last level for every address */
+static bool golden_bip44(GoldenBuffer* buffer, const GoldenOptions* options, const char* seed)
+{
+    if (options->bip44 == 0) {
+        return true;
+    }
+    BIP39_SEED_CTX ctx;
+    uint8_t bip39_seed[512 / 8];
+    mnemonic_to_seed_Init(&ctx, seed, "");
+    mnemonic_to_seed_Final(&ctx, bip39_seed);
+
+    HDNode chain;
+    HDNode node;
+    bool ok = hdnode_from_seed(bip39_seed, sizeof(bip39_seed), SECP256K1_NAME, &chain) == 1 &&
+              hdnode_private_ckd(&chain, GOLDEN_PURPOSE) == 1 &&
+              hdnode_private_ckd(&chain, GOLDEN_COIN_TYPE) == 1 &&
+              hdnode_private_ckd(&chain, GOLDEN_ACCOUNT) == 1 &&
+              hdnode_private_ckd(&chain, GOLDEN_CHANGE) == 1;
+    if (ok) {
+        // the public key of the parent is needed by every non hardened derivation
+        hdnode_fill_public_key(&chain);
+    }
+    char path[48];
+    for (uint32_t i = 0; ok && i < options->bip44; i++) {
+        node = chain;
+        ok = hdnode_private_ckd(&node, i) == 1;
+        if (ok) {
+            hdnode_fill_public_key(&node);
+            snprintf(path, sizeof(path), "m/44'/8000'/0'/%u/%u", GOLDEN_CHANGE, i);
+            golden_append_address(buffer, options, seed, path, node.public_key, node.private_key);
+        }
+    }
+    memzero(bip39_seed, sizeof(bip39_seed));
+    memzero(&chain, sizeof(chain));
+    memzero(&node, sizeof(node));
+    return ok;
+}
+
+static void golden_random_seed(uint64_t base, uint64_t index, char* seed, size_t size)
+{
+    uint8_t data[16];
+    uint8_t entropy[SHA256_DIGEST_LENGTH];
+    for (int i = 0; i < 8; i++) {
+        data[i] = base >> (8 * i);
+        data[8 + i] = index >> (8 * i);
+    }
+    sha256_Raw(data, sizeof(data), entropy);
+    snprintf(seed, size, "%s", mnemonic_from_data(entropy, 16));
+}
+
+static bool golden_write_all(int fd, const uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool golden_read_all(int fd, uint8_t* data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/* Generate the blocks of the seeds of worker w, return the process exit status */
+static int golden_worker(const GoldenOptions* options, uint32_t w, uint32_t jobs, int fd)
+{
+    FILE* seeds = NULL;
+    if (options->seeds_path != NULL) {
+        seeds = fopen(options->seeds_path, "r");
+        if (seeds == NULL) {
+            perror(options->seeds_path);
+            return 2;
+        }
+    }
+    GoldenBuffer buffer = {0};
+    char seed[GOLDEN_MAX_SEED];
+    uint64_t index = 0;
+    for (;; index++) {
+        if (seeds != NULL) {
+            // empty lines are not seeds, they do not take an index
+            do {
+                if (fgets(seed, sizeof(seed), seeds) == NULL) {
+                    seed[0] = 0;
+                    break;
+                }
+                seed[strcspn(seed, "\r\n")] = 0;
+            } while (seed[0] == 0);
+            if (seed[0] == 0) {
+                break;
+            }
+        } else if (index >= options->random) {
+            break;
+        }
+        if (index % jobs != w) {
+            continue;
+        }
+        if (seeds == NULL) {
+            golden_random_seed(options->base, index, seed, sizeof(seed));
+        }
+
+        buffer.size = 0;
+        golden_append_le(&buffer, 0, 4);
+        if (options->binary) {
+            size_t length = strlen(seed);
+            golden_append_le(&buffer, index, 4);
+            golden_append_le(&buffer, length, 2);
+            golden_append(&buffer, seed, length);
+            golden_append_le(&buffer, options->count, 4);
+            golden_append_le(&buffer, options->bip44, 4);
+        }
+        if (!golden_deterministic(&buffer, options, seed) || !golden_bip44(&buffer, options, seed)) {
+            fprintf(stderr, "Failed to derive the addresses of seed %llu\n", (unsigned long long)index);
+            return 1;
+        }
+        // the block length prefix was reserved first
+        uint32_t length = buffer.size - 4;
+        for (int i = 0; i < 4; i++) {
+            buffer.data[i] = length >> (8 * i);
+        }
+        if (!golden_write_all(fd, buffer.data, buffer.size)) {
+            return 2;
+        }
+    }
+    memzero(seed, sizeof(seed));
+    if (buffer.data != NULL) {
+        memzero(buffer.data, buffer.capacity);
+    }
+    free(buffer.data);
+    if (seeds != NULL) {
+        fclose(seeds);
+    }
+    return 0;
+}
+
+static void golden_usage(const char* program)
+{
+    fprintf(stderr,
+        "usage: %s (--seeds FILE | --random N) [--base N] [--count N] [--bip44 N] [--keys] [--binary] [--jobs N] [--output FILE]\n"
+        "  --seeds FILE   read the seeds from FILE, one per line\n"
+        "  --random N     generate N mnemonics from sha256(base || index)\n"
+        "  --base N       base of the generated mnemonics, default 0\n"
+        "  --count N      addresses of the deterministic chain per seed, default %d\n"
+        "  --bip44 N      BIP44 addresses m/44'/8000'/0'/0/i per seed, default 0\n"
+        "  --keys         also write the public and secret keys\n"
+        "  --binary       write the binary format instead of CSV\n"
+        "  --jobs N       worker processes, default the number of CPUs\n"
+        "  --output FILE  write to FILE instead of the standard output\n",
+        program, GOLDEN_COUNT);
+}
+
+int main(int argc, char** argv)
+{
+    GoldenOptions options = {.count = GOLDEN_COUNT};
+    const char* output_path = NULL;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t jobs = cpus > 0 ? cpus : 1;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--seeds") == 0 && has_value) {
+            options.seeds_path = argv[++i];
+        } else if (strcmp(argv[i], "--random") == 0 && has_value) {
+            options.random = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--base") == 0 && has_value) {
+            options.base = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--count") == 0 && has_value) {
+            options.count = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--bip44") == 0 && has_value) {
+            options.bip44 = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--keys") == 0) {
+            options.keys = true;
+        } else if (strcmp(argv[i], "--binary") == 0) {
+            options.binary = true;
+        } else if (strcmp(argv[i], "--jobs") == 0 && has_value) {
+            jobs = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--output") == 0 && has_value) {
+            output_path = argv[++i];
+        } else {
+            golden_usage(argv[0]);
+            return 2;
+        }
+    }
+    if ((options.seeds_path == NULL) == (options.random == 0) || jobs < 1 || jobs > GOLDEN_MAX_JOBS) {
+        golden_usage(argv[0]);
+        return 2;
+    }
+
+    FILE* output = output_path != NULL ? fopen(output_path, "wb") : stdout;
+    if (output == NULL) {
+        perror(output_path);
+        return 2;
+    }
+    static char output_buffer[1 << 20];
+    setvbuf(output, output_buffer, _IOFBF, sizeof(output_buffer));
+    if (options.binary) {
+        uint8_t header[8] = {0};
+        memcpy(header, GOLDEN_MAGIC, 4);
+        header[4] = GOLDEN_VERSION;
+        header[5] = options.keys ? GOLDEN_FLAG_KEYS : 0;
+        fwrite(header, 1, sizeof(header), output);
+    } else {
+        fprintf(output, "seed,path,address%s\n", options.keys ? ",pubkey,seckey" : "");
+    }
+    fflush(output);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int fds[GOLDEN_MAX_JOBS];
+    pid_t pids[GOLDEN_MAX_JOBS];
+    for (uint32_t w = 0; w < jobs; w++) {
+        int pipefd[2];
+        if (pipe(pipefd) != 0) {
+            perror("pipe");
+            return 2;
+        }
+        pids[w] = fork();
+        if (pids[w] < 0) {
+            perror("fork");
+            return 2;
+        }
+        if (pids[w] == 0) {
+            for (uint32_t v = 0; v < w; v++) {
+                close(fds[v]);
+            }
+            close(pipefd[0]);
+            _exit(golden_worker(&options, w, jobs, pipefd[1]));
+        }
+        close(pipefd[1]);
+        fds[w] = pipefd[0];
+    }
+
+    // copy the blocks in seed order, a worker closing its pipe ends the seeds
+    uint8_t* block = NULL;
+    size_t block_capacity = 0;
+    uint64_t seeds = 0;
+    for (;; seeds++) {
+        uint8_t prefix[4];
+        int fd = fds[seeds % jobs];
+        if (!golden_read_all(fd, prefix, sizeof(prefix))) {
+            break;
+        }
+        size_t length = prefix[0] | prefix[1] << 8 | prefix[2] << 16 | (uint32_t)prefix[3] << 24;
+        if (length > block_capacity) {
+            block = realloc(block, length);
+            if (block == NULL) {
+                perror("realloc");
+                return 2;
+            }
+            block_capacity = length;
+        }
+        if (!golden_read_all(fd, block, length)) {
+            break;
+        }
+        fwrite(block, 1, length, output);
+    }
+    free(block);
+
+    int status = 0;
+    for (uint32_t w = 0; w < jobs; w++) {
+        close(fds[w]);
+        int worker_status;
+        if (waitpid(pids[w], &worker_status, 0) < 0 || !WIFEXITED(worker_status) || WEXITSTATUS(worker_status) != 0) {
+            status = 1;
+        }
+    }
+    if (fclose(output) != 0) {
+        perror(output_path != NULL ? output_path : "stdout");
+        status = 2;
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    uint64_t addresses = seeds * (options.count + options.bip44);
+    fprintf(stderr, "%llu seeds, %llu addresses in %.3f s, %.0f addresses/s with %u jobs\n",
+        (unsigned long long)seeds, (unsigned long long)addresses, seconds, addresses / seconds, jobs);
+    return status;
+}
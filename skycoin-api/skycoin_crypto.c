@@ -21,6 +21,7 @@
 #include "tools/ecdsa.h"
 #include "tools/ripemd160.h"
 #include "tools/secp256k1.h"
+#include "tools/memzero.h"
 #include "tools/sha2.h"
 
 extern void bn_print(const bignum256* a);
@@ -326,29 +327,21 @@ The address_size must be at least 36 bytes and the address buffer must be at lea
 
 Returns 0 if the address cannot fit into the b58address array or if the pubkey is not valid
 */
-int skycoin_address_from_pubkey(const uint8_t* pubkey, char* b58address, size_t* size_b58address)
+void skycoin_address_hash_from_pubkey(const uint8_t* pubkey, uint8_t* address_hash)
 {
-    /*
-    SKYCOIN CIPHER AUDIT
-    https://github.com/skycoin/skycoin/wiki/Technical-background-of-version-0-Skycoin-addresses
-
-    address = ripemd160(sha256(sha256(pubkey))
-    checksum = sha256(address+version)
-    */
-    const curve_info* curve = get_curve_by_name(SECP256K1_NAME);
-
-    if (!pubkey_is_valid(curve->params, pubkey)) {
-        return 0;
-    }
-
-    uint8_t address[RIPEMD160_DIGEST_LENGTH + 1 + 4] = {0};
     uint8_t r1[SHA256_DIGEST_LENGTH] = {0};
     uint8_t r2[SHA256_DIGEST_LENGTH] = {0};
 
     // ripemd160(sha256(sha256(pubkey))
     sha256sum(pubkey, r1, SKYCOIN_PUBKEY_LEN);
     sha256sum(r1, r2, sizeof(r1));
-    ripemd160(r2, SHA256_DIGEST_LENGTH, address);
+    ripemd160(r2, SHA256_DIGEST_LENGTH, address_hash);
+}
+
+int skycoin_address_from_address_hash(const uint8_t* address_hash, char* b58address, size_t* size_b58address)
+{
+    uint8_t address[RIPEMD160_DIGEST_LENGTH + 1 + 4] = {0};
+    memcpy(address, address_hash, RIPEMD160_DIGEST_LENGTH);
 
     // compute base58 address
     uint8_t digest[SHA256_DIGEST_LENGTH] = {0};
@@ -364,6 +357,26 @@ int skycoin_address_from_pubkey(const uint8_t* pubkey, char* b58address, size_t*
     return 0;
 }
 
+int skycoin_address_from_pubkey(const uint8_t* pubkey, char* b58address, size_t* size_b58address)
+{
+    /*
+    SKYCOIN CIPHER AUDIT
+    https://github.com/skycoin/skycoin/wiki/Technical-background-of-version-0-Skycoin-addresses
+
+    address = ripemd160(sha256(sha256(pubkey))
+    checksum = sha256(address+version)
+    */
+    const curve_info* curve = get_curve_by_name(SECP256K1_NAME);
+
+    if (!pubkey_is_valid(curve->params, pubkey)) {
+        return 0;
+    }
+
+    uint8_t address_hash[RIPEMD160_DIGEST_LENGTH] = {0};
+    skycoin_address_hash_from_pubkey(pubkey, address_hash);
+    return skycoin_address_from_address_hash(address_hash, b58address, size_b58address);
+}
+
 void transaction_initZeroTransaction(Transaction* self)
 {
     self->nbIn = 0;
@@ -456,18 +469,89 @@ void transaction_msgToSign(Transaction* self, uint8_t index, uint8_t* msg_digest
     sha256_Final(&sha256ctx, msg_digest);
 }
 
-static TxSignContext context;
+static TxSignContext contexts[TX_SIGN_CTX_POOL_SIZE];
+// Monotonic use counter, the context with the lowest stamp is evicted first
+static uint32_t contexts_stamp[TX_SIGN_CTX_POOL_SIZE];
+static uint32_t contexts_clock = 0;
 
-TxSignContext* TxSignCtx_Init()
+static void TxSignCtx_stamp(TxSignContext* ctx)
 {
-    context.state = Start;
-    context.mnemonic_change = false;
-    return &context;
+    contexts_stamp[ctx - contexts] = ++contexts_clock;
+}
+
+TxSignContext* TxSignCtx_Init(const char* tx_hash, uint32_t now_ms)
+{
+    TxSignContext* ctx = NULL;
+    for (size_t i = 0; i < TX_SIGN_CTX_POOL_SIZE; ++i) {
+        if (contexts[i].state == Destroyed) {
+            ctx = &contexts[i];
+            break;
+        }
+        if (ctx == NULL || contexts_stamp[i] < contexts_stamp[ctx - contexts]) {
+            ctx = &contexts[i];
+        }
+    }
+    TxSignCtx_Destroy(ctx);
+    ctx->state = Start;
+    ctx->mnemonic_change = false;
+    strncpy(ctx->tx_hash, tx_hash, sizeof(ctx->tx_hash) - 1);
+    TxSignCtx_Touch(ctx, now_ms);
+    return ctx;
 }
 
 TxSignContext* TxSignCtx_Get()
 {
-    return &context;
+    TxSignContext* ctx = &contexts[0];
+    for (size_t i = 0; i < TX_SIGN_CTX_POOL_SIZE; ++i) {
+        if (contexts[i].state != Destroyed &&
+            (ctx->state == Destroyed || contexts_stamp[i] > contexts_stamp[ctx - contexts])) {
+            ctx = &contexts[i];
+        }
+    }
+    return ctx;
+}
+
+TxSignContext* TxSignCtx_Find(const char* tx_hash)
+{
+    for (size_t i = 0; i < TX_SIGN_CTX_POOL_SIZE; ++i) {
+        if (contexts[i].state != Destroyed &&
+            strncmp(contexts[i].tx_hash, tx_hash, sizeof(contexts[i].tx_hash)) == 0) {
+            return &contexts[i];
+        }
+    }
+    return NULL;
+}
+
+void TxSignCtx_Touch(TxSignContext* ctx, uint32_t now_ms)
+{
+    ctx->last_used_ms = now_ms;
+    TxSignCtx_stamp(ctx);
+}
+
+void TxSignCtx_DestroyExpired(uint32_t now_ms, uint32_t timeout_ms)
+{
+    for (size_t i = 0; i < TX_SIGN_CTX_POOL_SIZE; ++i) {
+        if (contexts[i].state != Destroyed &&
+            (uint32_t)(now_ms - contexts[i].last_used_ms) > timeout_ms) {
+            TxSignCtx_Destroy(&contexts[i]);
+        }
+    }
+}
+
+void TxSignCtx_SetMnemonicChange(void)
+{
+    for (size_t i = 0; i < TX_SIGN_CTX_POOL_SIZE; ++i) {
+        if (contexts[i].state != Destroyed) {
+            contexts[i].mnemonic_change = true;
+        }
+    }
+}
+
+void TxSignCtx_DestroyAll(void)
+{
+    for (size_t i = 0; i < TX_SIGN_CTX_POOL_SIZE; ++i) {
+        TxSignCtx_Destroy(&contexts[i]);
+    }
 }
 
 void TxSignCtx_printSHA256(TxSignContext* ctx)
@@ -531,6 +615,6 @@ void TxSignCtx_finishInnerHash(TxSignContext* ctx)
 
 void TxSignCtx_Destroy(TxSignContext* ctx)
 {
-    memset(ctx, 0, sizeof(TxSignContext));
+    memzero(ctx, sizeof(TxSignContext));
     ctx->state = Destroyed;
 }
\ No newline at end of file
@@ -33,6 +33,11 @@ typedef struct Transaction {
     uint8_t innerHash[32];
 } Transaction;
 
+// Number of transaction signing sessions that can be in progress at once
+#define TX_SIGN_CTX_POOL_SIZE 4
+// Idle time after which a signing session is considered abandoned
+#define TX_SIGN_CTX_TIMEOUT_MS 120000
+
 typedef enum {
     Destroyed,
     Start,
@@ -55,6 +60,7 @@ typedef struct _TxSignContext {
     bool has_innerHash;
     uint8_t innerHash[32];
     uint64_t requestIndex;
+    uint32_t last_used_ms;
     SHA256_CTX sha256_ctx;
 } TxSignContext;
 
@@ -72,6 +78,14 @@ int deterministic_key_pair_iterator(const uint8_t* seed, const size_t seed_lengt
 int deterministic_key_pair_iterator_step(const uint8_t* seed, uint8_t* seckey, uint8_t* pubkey);
 void skycoin_pubkey_from_seckey(const uint8_t* seckey, uint8_t* pubkey);
 int skycoin_address_from_pubkey(const uint8_t* pubkey, char* b58address, size_t* size_address);
+/**
+ * @brief Compute the 20 bytes hash an address is built from, ripemd160(sha256(sha256(pubkey)))
+ */
+void skycoin_address_hash_from_pubkey(const uint8_t* pubkey, uint8_t* address_hash);
+/**
+ * @brief Encode the base58 address of a 20 bytes address hash
+ */
+int skycoin_address_from_address_hash(const uint8_t* address_hash, char* b58address, size_t* size_address);
 int skycoin_ecdsa_sign_digest(const uint8_t* priv_key, const uint8_t* digest, uint8_t* sig);
 void tohex(char* str, const uint8_t* buffer, int buffer_length);
 /**
@@ -84,14 +98,35 @@ void tohex(char* str, const uint8_t* buffer, int buffer_length);
 bool tobuff(const char* str, uint8_t* buf, size_t bufferLength);
 void writebuf_fromhexstr(const char* str, uint8_t* buf);
 
-/*  @brief Initialize global variable context
- *  @return Pointer to TxSignContext
+/*  @brief Take a context from the pool for a new signing session
+ *  @param tx_hash Transaction hash the session is keyed by
+ *  @param now_ms Current time in milliseconds
+ *  @return Pointer to TxSignContext, evicting the least recently used session if the pool is full
  */
-TxSignContext* TxSignCtx_Init(void);
-/* @brief Get current transaction context 
- * @return Pointer to TxSignContext
+TxSignContext* TxSignCtx_Init(const char* tx_hash, uint32_t now_ms);
+/* @brief Get the most recently used transaction context
+ * @return Pointer to TxSignContext, in Destroyed state if no session is in progress
  */
 TxSignContext* TxSignCtx_Get(void);
+/* @brief Find the signing session for a transaction
+ * @param tx_hash Transaction hash the session is keyed by
+ * @return Pointer to TxSignContext or NULL if there is no such session
+ */
+TxSignContext* TxSignCtx_Find(const char* tx_hash);
+/* @brief Mark ctx as used so that it is the last candidate for eviction
+ * @param ctx Context in use
+ * @param now_ms Current time in milliseconds
+ */
+void TxSignCtx_Touch(TxSignContext* ctx, uint32_t now_ms);
+/* @brief Destroy every session idle for longer than timeout_ms
+ * @param now_ms Current time in milliseconds
+ * @param timeout_ms Maximum idle time
+ */
+void TxSignCtx_DestroyExpired(uint32_t now_ms, uint32_t timeout_ms);
+/* @brief Flag every session in progress as started with a previous mnemonic */
+void TxSignCtx_SetMnemonicChange(void);
+/* @brief Destroy every session in the pool */
+void TxSignCtx_DestroyAll(void);
 /*  @brief Add size prefix of inputs or outputs to SHA256 context inside ctx
  *  @param ctx Context with SHA256 context for update
  *  @param nbIn Number of inputs or outputs
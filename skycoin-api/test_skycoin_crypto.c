@@ -670,6 +670,21 @@ START_TEST(test_skycoin_address_from_pubkey)
 }
 END_TEST
 
+START_TEST(test_skycoin_address_from_address_hash)
+{
+    uint8_t pubkey[33] = {0};
+    uint8_t address_hash[20] = {0};
+    char address[256] = {0};
+    size_t size_address = sizeof(address);
+    memcpy(pubkey, fromhex("02e5be89fa161bf6b0bc64ec9ec7fe27311fbb78949c3ef9739d4c73a84920d6e1"), 33);
+    skycoin_address_hash_from_pubkey(pubkey, address_hash);
+    ck_assert_mem_eq(address_hash, fromhex("b1aa8dd3e68d1d9b130c67ea1339ac9250b7d845"), 20);
+    int ok = skycoin_address_from_address_hash(address_hash, address, &size_address);
+    ck_assert_int_eq(ok, 1);
+    ck_assert_str_eq(address, "2EVNa4CK9SKosT4j1GEn8SuuUUEAXaHAMbM");
+}
+END_TEST
+
 START_TEST(test_compute_sha256sum)
 {
     char seed[256] = "seed";
@@ -1380,6 +1395,46 @@ START_TEST(test_addtransactioninput)
 }
 END_TEST
 
+START_TEST(test_txsignctx_pool)
+{
+    char tx_hash[TX_SIGN_CTX_POOL_SIZE + 1][65];
+    TxSignContext* ctxs[TX_SIGN_CTX_POOL_SIZE + 1];
+    TxSignCtx_DestroyAll();
+    ck_assert_int_eq(TxSignCtx_Get()->state, Destroyed);
+    for (uint32_t i = 0; i < TX_SIGN_CTX_POOL_SIZE; ++i) {
+        sprintf(tx_hash[i], "%064u", i);
+        ctxs[i] = TxSignCtx_Init(tx_hash[i], i);
+        ck_assert_int_eq(ctxs[i]->state, Start);
+        ck_assert_str_eq(ctxs[i]->tx_hash, tx_hash[i]);
+    }
+    for (uint32_t i = 0; i < TX_SIGN_CTX_POOL_SIZE; ++i) {
+        ck_assert_ptr_eq(TxSignCtx_Find(tx_hash[i]), ctxs[i]);
+    }
+    ck_assert_ptr_eq(TxSignCtx_Get(), ctxs[TX_SIGN_CTX_POOL_SIZE - 1]);
+
+    // first session becomes the most recently used, second one is evicted
+    TxSignCtx_Touch(ctxs[0], TX_SIGN_CTX_POOL_SIZE);
+    ck_assert_ptr_eq(TxSignCtx_Get(), ctxs[0]);
+    sprintf(tx_hash[TX_SIGN_CTX_POOL_SIZE], "%064u", TX_SIGN_CTX_POOL_SIZE);
+    ctxs[TX_SIGN_CTX_POOL_SIZE] = TxSignCtx_Init(tx_hash[TX_SIGN_CTX_POOL_SIZE], TX_SIGN_CTX_POOL_SIZE);
+    ck_assert_ptr_eq(ctxs[TX_SIGN_CTX_POOL_SIZE], ctxs[1]);
+    ck_assert_ptr_null(TxSignCtx_Find(tx_hash[1]));
+    ck_assert_ptr_eq(TxSignCtx_Find(tx_hash[0]), ctxs[0]);
+
+    TxSignCtx_SetMnemonicChange();
+    ck_assert(ctxs[0]->mnemonic_change);
+
+    // everything but the last two sessions timed out
+    TxSignCtx_DestroyExpired(TX_SIGN_CTX_POOL_SIZE + 10, 10);
+    ck_assert_ptr_eq(TxSignCtx_Find(tx_hash[0]), ctxs[0]);
+    ck_assert_ptr_null(TxSignCtx_Find(tx_hash[2]));
+    TxSignCtx_DestroyAll();
+    ck_assert_ptr_null(TxSignCtx_Find(tx_hash[0]));
+    uint8_t zero[sizeof(ctxs[0]->innerHash)] = {0};
+    ck_assert_mem_eq(ctxs[0]->innerHash, zero, sizeof(zero));
+}
+END_TEST
+
 // define test suite and cases
 Suite* test_suite(void)
 {
@@ -1391,6 +1446,7 @@ Suite* test_suite(void)
     tcase_add_test(tc, test_secp256k1Hash);
     tcase_add_test(tc, test_deterministic_key_pair_iterator);
     tcase_add_test(tc, test_skycoin_address_from_pubkey);
+    tcase_add_test(tc, test_skycoin_address_from_address_hash);
     tcase_add_test(tc, test_compute_sha256sum);
     tcase_add_test(tc, test_skycoin_ecdsa_verify_digest_recover);
     tcase_add_test(tc, test_base58_decode);
@@ -1399,6 +1455,7 @@ Suite* test_suite(void)
     tcase_add_test(tc, test_checkdigest);
     tcase_add_test(tc, test_addtransactioninput);
     tcase_add_test(tc, test_ecdh);
+    tcase_add_test(tc, test_txsignctx_pool);
     suite_add_tcase(s, tc);
     load_bip32_testcase(s);
     load_bip44_testcase(s);
@@ -231,11 +231,11 @@ int mnemonic_check(const char* mnemonic)
 }
 
 // passphrase must be at most 256 characters otherwise it would be truncated
-void mnemonic_to_seed(const char* mnemonic, const char* passphrase, uint8_t seed[512 / 8], void (*progress_callback)(uint32_t current, uint32_t total))
+bool mnemonic_to_seed(const char* mnemonic, const char* passphrase, uint8_t seed[512 / 8], bool (*progress_callback)(uint32_t current, uint32_t total))
 {
+#if USE_BIP39_CACHE
     int mnemoniclen = strlen(mnemonic);
     int passphraselen = strnlen(passphrase, 256);
-#if USE_BIP39_CACHE
     // check cache
     if (mnemoniclen < 256 && passphraselen < 64) {
         for (int i = 0; i < BIP39_CACHE_SIZE; i++) {
@@ -244,26 +244,24 @@ void mnemonic_to_seed(const char* mnemonic, const char* passphrase, uint8_t seed
             if (strcmp(bip39_cache[i].passphrase, passphrase) != 0) continue;
             // found the correct entry
             memcpy(seed, bip39_cache[i].seed, 512 / 8);
-            return;
+            return true;
         }
     }
 #endif
-    uint8_t salt[8 + 256];
-    memcpy(salt, "mnemonic", 8);
-    memcpy(salt + 8, passphrase, passphraselen);
-    static CONFIDENTIAL PBKDF2_HMAC_SHA512_CTX pctx;
-    pbkdf2_hmac_sha512_Init(&pctx, (const uint8_t*)mnemonic, mnemoniclen, salt, passphraselen + 8, 1);
-    if (progress_callback) {
-        progress_callback(0, BIP39_PBKDF2_ROUNDS);
-    }
+    static CONFIDENTIAL BIP39_SEED_CTX ctx;
+    mnemonic_to_seed_Init(&ctx, mnemonic, passphrase);
     for (int i = 0; i < 16; i++) {
-        pbkdf2_hmac_sha512_Update(&pctx, BIP39_PBKDF2_ROUNDS / 16);
-        if (progress_callback) {
-            progress_callback((i + 1) * BIP39_PBKDF2_ROUNDS / 16, BIP39_PBKDF2_ROUNDS);
+        if (progress_callback && !progress_callback(ctx.rounds, BIP39_PBKDF2_ROUNDS)) {
+            memzero(&ctx, sizeof(ctx));
+            return false;
         }
+        mnemonic_to_seed_Update(&ctx, BIP39_PBKDF2_ROUNDS / 16);
     }
-    pbkdf2_hmac_sha512_Final(&pctx, seed);
-    memzero(salt, sizeof(salt));
+    if (progress_callback && !progress_callback(ctx.rounds, BIP39_PBKDF2_ROUNDS)) {
+        memzero(&ctx, sizeof(ctx));
+        return false;
+    }
+    mnemonic_to_seed_Final(&ctx, seed);
 #if USE_BIP39_CACHE
     // store to cache
     if (mnemoniclen < 256 && passphraselen < 64) {
@@ -274,6 +272,40 @@ void mnemonic_to_seed(const char* mnemonic, const char* passphrase, uint8_t seed
         bip39_cache_index = (bip39_cache_index + 1) % BIP39_CACHE_SIZE;
     }
 #endif
+    return true;
+}
+
+void mnemonic_to_seed_Init(BIP39_SEED_CTX* ctx, const char* mnemonic, const char* passphrase)
+{
+    int mnemoniclen = strlen(mnemonic);
+    int passphraselen = strnlen(passphrase, 256);
+    uint8_t salt[8 + 256];
+    memcpy(salt, "mnemonic", 8);
+    memcpy(salt + 8, passphrase, passphraselen);
+    pbkdf2_hmac_sha512_Init(&ctx->pctx, (const uint8_t*)mnemonic, mnemoniclen, salt, passphraselen + 8, 1);
+    ctx->rounds = 0;
+    memzero(salt, sizeof(salt));
+}
+
+bool mnemonic_to_seed_Update(BIP39_SEED_CTX* ctx, uint32_t rounds)
+{
+    if (rounds > BIP39_PBKDF2_ROUNDS - ctx->rounds) {
+        rounds = BIP39_PBKDF2_ROUNDS - ctx->rounds;
+    }
+    // the first update accounts for the round already done by init
+    if (rounds == 0) {
+        return ctx->rounds == BIP39_PBKDF2_ROUNDS;
+    }
+    pbkdf2_hmac_sha512_Update(&ctx->pctx, rounds);
+    ctx->rounds += rounds;
+    return ctx->rounds == BIP39_PBKDF2_ROUNDS;
+}
+
+void mnemonic_to_seed_Final(BIP39_SEED_CTX* ctx, uint8_t seed[512 / 8])
+{
+    mnemonic_to_seed_Update(ctx, BIP39_PBKDF2_ROUNDS);
+    pbkdf2_hmac_sha512_Final(&ctx->pctx, seed);
+    memzero(ctx, sizeof(*ctx));
 }
 
 const char* const* mnemonic_wordlist(void)
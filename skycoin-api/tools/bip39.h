@@ -24,10 +24,18 @@
 #ifndef __BIP39_H__
 #define __BIP39_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
+#include "pbkdf2.h"
+
 #define BIP39_PBKDF2_ROUNDS 2048
 
+typedef struct _BIP39_SEED_CTX {
+    PBKDF2_HMAC_SHA512_CTX pctx;
+    uint32_t rounds;
+} BIP39_SEED_CTX;
+
 const char* mnemonic_generate(int strength);             // strength in bits
 const uint16_t* mnemonic_generate_indexes(int strength); // strength in bits
 
@@ -37,7 +45,15 @@ const uint16_t* mnemonic_from_data_indexes(const uint8_t* data, int len);
 int mnemonic_check(const char* mnemonic);
 
 // passphrase must be at most 256 characters or code may crash
-void mnemonic_to_seed(const char* mnemonic, const char* passphrase, uint8_t seed[512 / 8], void (*progress_callback)(uint32_t current, uint32_t total));
+// progress_callback may abort the computation by returning false, in which case
+// seed is left untouched and false is returned
+bool mnemonic_to_seed(const char* mnemonic, const char* passphrase, uint8_t seed[512 / 8], bool (*progress_callback)(uint32_t current, uint32_t total));
+
+// incremental version of mnemonic_to_seed, the BIP39 cache is not used
+void mnemonic_to_seed_Init(BIP39_SEED_CTX* ctx, const char* mnemonic, const char* passphrase);
+// run at most rounds PBKDF2 rounds, returns true once all BIP39_PBKDF2_ROUNDS are done
+bool mnemonic_to_seed_Update(BIP39_SEED_CTX* ctx, uint32_t rounds);
+void mnemonic_to_seed_Final(BIP39_SEED_CTX* ctx, uint8_t seed[512 / 8]);
 
 const char* const* mnemonic_wordlist(void);
 
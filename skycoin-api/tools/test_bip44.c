@@ -117,10 +117,34 @@ START_TEST(TestSimpleExample1)
 }
 END_TEST
 
+static uint32_t seed_progress_calls;
+
+static bool abort_seed_progress(uint32_t current, uint32_t total)
+{
+    ck_assert_uint_eq(total, BIP39_PBKDF2_ROUNDS);
+    ++seed_progress_calls;
+    return current < BIP39_PBKDF2_ROUNDS / 4;
+}
+
+START_TEST(TestMnemonicToSeedAbort)
+{
+    const char* mnemonic = "program robust plug afraid subway lesson slight rose hunt depart milk traffic";
+    uint8_t seed[512 / 8] = {0};
+    uint8_t zero[512 / 8] = {0};
+    seed_progress_calls = 0;
+    ck_assert(!mnemonic_to_seed(mnemonic, "abort", seed, &abort_seed_progress));
+    ck_assert_uint_eq(seed_progress_calls, 5);
+    ck_assert_mem_eq(seed, zero, sizeof(seed));
+    ck_assert(mnemonic_to_seed(mnemonic, "abort", seed, NULL));
+    ck_assert_int_ne(memcmp(seed, zero, sizeof(seed)), 0);
+}
+END_TEST
+
 void load_bip44_testcase(Suite* s)
 {
     TCase* tc = tcase_create("skycoin_crypto_bip44");
     tcase_add_test(tc, TestSimpleExample);
     tcase_add_test(tc, TestSimpleExample1);
+    tcase_add_test(tc, TestMnemonicToSeedAbort);
     suite_add_tcase(s, tc);
 }
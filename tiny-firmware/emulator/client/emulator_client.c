@@ -0,0 +1,190 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "emulator_client.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// '?', '#', '#', message id and size come before the payload of the first report
+#define EMULATOR_CLIENT_HEADER_SIZE 9
+
+int emulator_client_connect(const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+void emulator_client_close(int fd)
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static bool emulator_client_send(int fd, const uint8_t* report)
+{
+    return send(fd, report, EMULATOR_CLIENT_REPORT_SIZE, MSG_NOSIGNAL) == EMULATOR_CLIENT_REPORT_SIZE;
+}
+
+static bool emulator_client_recv(int fd, uint8_t* report, int timeout_ms)
+{
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    if (ready == 0) {
+        errno = ETIMEDOUT;
+        return false;
+    }
+    if (ready < 0) {
+        return false;
+    }
+    ssize_t n = recv(fd, report, EMULATOR_CLIENT_REPORT_SIZE, 0);
+    if (n == 0) {
+        errno = ECONNRESET;
+        return false;
+    }
+    return n == EMULATOR_CLIENT_REPORT_SIZE;
+}
+
+bool emulator_client_write(int fd, uint16_t msg_id, const uint8_t* data, uint32_t size)
+{
+    uint8_t report[EMULATOR_CLIENT_REPORT_SIZE];
+    memset(report, 0, sizeof(report));
+    report[0] = '?';
+    report[1] = '#';
+    report[2] = '#';
+    report[3] = (msg_id >> 8) & 0xFF;
+    report[4] = msg_id & 0xFF;
+    report[5] = (size >> 24) & 0xFF;
+    report[6] = (size >> 16) & 0xFF;
+    report[7] = (size >> 8) & 0xFF;
+    report[8] = size & 0xFF;
+
+    uint32_t pos = EMULATOR_CLIENT_HEADER_SIZE;
+    uint32_t sent = 0;
+    for (;;) {
+        uint32_t chunk = sizeof(report) - pos;
+        if (chunk > size - sent) {
+            chunk = size - sent;
+        }
+        memcpy(report + pos, data + sent, chunk);
+        sent += chunk;
+        if (!emulator_client_send(fd, report)) {
+            return false;
+        }
+        if (sent == size) {
+            return true;
+        }
+        // continuation reports only carry the '?' marker
+        memset(report + 1, 0, sizeof(report) - 1);
+        pos = 1;
+    }
+}
+
+bool emulator_client_read(int fd, uint16_t* msg_id, uint8_t* data, uint32_t max_size, uint32_t* size, int timeout_ms)
+{
+    uint8_t report[EMULATOR_CLIENT_REPORT_SIZE];
+    do {
+        if (!emulator_client_recv(fd, report, timeout_ms)) {
+            return false;
+        }
+        // skip stray continuation reports until a message starts
+    } while (report[0] != '?' || report[1] != '#' || report[2] != '#');
+
+    *msg_id = ((uint16_t)report[3] << 8) | report[4];
+    *size = ((uint32_t)report[5] << 24) | ((uint32_t)report[6] << 16) | ((uint32_t)report[7] << 8) | report[8];
+    if (*size > max_size) {
+        errno = EMSGSIZE;
+        return false;
+    }
+
+    uint32_t pos = EMULATOR_CLIENT_HEADER_SIZE;
+    uint32_t received = 0;
+    for (;;) {
+        uint32_t chunk = sizeof(report) - pos;
+        if (chunk > *size - received) {
+            chunk = *size - received;
+        }
+        memcpy(data + received, report + pos, chunk);
+        received += chunk;
+        if (received == *size) {
+            return true;
+        }
+        if (!emulator_client_recv(fd, report, timeout_ms)) {
+            return false;
+        }
+        if (report[0] != '?') {
+            errno = EPROTO;
+            return false;
+        }
+        pos = 1;
+    }
+}
+
+bool emulator_client_press_button(int fd, uint8_t button_type)
+{
+    uint8_t report[EMULATOR_CLIENT_REPORT_SIZE];
+    memset(report, 0, sizeof(report));
+    // the emulator recognizes 0, 1, 2, 3, 4 followed by the button type
+    for (uint8_t i = 0; i < 5; i++) {
+        report[i] = i;
+    }
+    report[5] = button_type;
+    return emulator_client_send(fd, report);
+}
+
+static int compare_us(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+void emulator_client_sort_us(uint32_t* us, size_t count)
+{
+    qsort(us, count, sizeof(*us), compare_us);
+}
+
+double emulator_client_percentile_ms(const uint32_t* us, size_t count, unsigned permille)
+{
+    size_t rank = (count * permille + 999) / 1000;
+    return us[rank ? rank - 1 : 0] / 1000.0;
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#ifndef __TINYFIRMWARE_EMULATOR_CLIENT__
+#define __TINYFIRMWARE_EMULATOR_CLIENT__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Size of every report exchanged with the emulator
+#define EMULATOR_CLIENT_REPORT_SIZE 64
+// Appended by the emulator to the main socket path for the debug link
+#define EMULATOR_CLIENT_DEBUG_SUFFIX ".debug"
+
+/**
+ * @brief Connect to an emulator started with SKYWALLET_UNIX_SOCKET
+ * @param path socket path, append EMULATOR_CLIENT_DEBUG_SUFFIX for the debug link
+ * @return socket descriptor, -1 on error with errno set
+ */
+int emulator_client_connect(const char* path);
+
+/**
+ * @brief Close a connection, the emulator waits for the next host
+ */
+void emulator_client_close(int fd);
+
+/**
+ * @brief Send a protobuf encoded message split into ?## framed reports
+ * @param msg_id MessageType of the message
+ * @param data encoded message
+ * @param size length of data
+ */
+bool emulator_client_write(int fd, uint16_t msg_id, const uint8_t* data, uint32_t size);
+
+/**
+ * @brief Receive and reassemble a protobuf encoded message
+ * @param msg_id MessageType of the received message
+ * @param data buffer for the encoded message
+ * @param max_size size of the buffer, longer messages are an error
+ * @param size length of the received message
+ * @param timeout_ms time to wait for each report, negative waits forever
+ */
+bool emulator_client_read(int fd, uint16_t* msg_id, uint8_t* data, uint32_t max_size, uint32_t* size, int timeout_ms);
+
+/**
+ * @brief Press a button of the emulator, as the debug link tests do
+ * @param button_type BTN_LEFT, BTN_RIGHT or BTN_LEFT_RIGHT from buttons.h
+ */
+bool emulator_client_press_button(int fd, uint8_t button_type);
+
+/**
+ * @brief Sort latency samples in microseconds before taking percentiles
+ */
+void emulator_client_sort_us(uint32_t* us, size_t count);
+
+/**
+ * @brief Nearest rank percentile of sorted latency samples
+ * @param us samples in microseconds sorted by emulator_client_sort_us
+ * @param count number of samples, at least one
+ * @param permille rank in thousandths, e.g. 990 for p99
+ * @return the percentile in milliseconds
+ */
+double emulator_client_percentile_ms(const uint32_t* us, size_t count, unsigned permille);
+
+#endif // __TINYFIRMWARE_EMULATOR_CLIENT__
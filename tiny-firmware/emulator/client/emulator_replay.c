@@ -0,0 +1,472 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+/* Replay a trace recorded with SKYWALLET_TRACE_FILE against emulators
+ * listening on Unix sockets, as fast as they answer, and report the
+ * throughput and the latency of every message type.
+ *
+ *   emulator_replay [-n runs] [-t timeout_ms] trace socket...
+ */
+
+#include "emulator_client.h"
+#include "emulator_trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Largest message accepted, bigger than any the firmware handles
+#define REPLAY_MAX_MESSAGE (64 * 1024)
+#define REPLAY_HEADER_SIZE 9
+
+// Message names come from the generated protobuf header when it was built
+#if defined(__has_include)
+#if __has_include("messages.pb.h")
+#include "messages.pb.h"
+#define REPLAY_NAMES 1
+#endif
+#endif
+#ifndef REPLAY_NAMES
+#define REPLAY_NAMES 0
+#endif
+
+#if REPLAY_NAMES
+#define REPLAY_NAME(name) {MessageType_MessageType_##name, #name}
+static const struct {
+    uint16_t msg_id;
+    const char* name;
+} replay_names[] = {
+    REPLAY_NAME(Initialize),
+    REPLAY_NAME(Ping),
+    REPLAY_NAME(Success),
+    REPLAY_NAME(Failure),
+    REPLAY_NAME(Features),
+    REPLAY_NAME(ButtonRequest),
+    REPLAY_NAME(ButtonAck),
+    REPLAY_NAME(PinMatrixRequest),
+    REPLAY_NAME(PinMatrixAck),
+    REPLAY_NAME(PassphraseRequest),
+    REPLAY_NAME(PassphraseAck),
+    REPLAY_NAME(Cancel),
+    REPLAY_NAME(WipeDevice),
+    REPLAY_NAME(LoadDevice),
+    REPLAY_NAME(ApplySettings),
+    REPLAY_NAME(ChangePin),
+    REPLAY_NAME(GenerateMnemonic),
+    REPLAY_NAME(RecoveryDevice),
+    REPLAY_NAME(WordRequest),
+    REPLAY_NAME(BackupDevice),
+    REPLAY_NAME(Entropy),
+    REPLAY_NAME(EntropyRequest),
+    REPLAY_NAME(EntropyAck),
+    REPLAY_NAME(SkycoinAddress),
+    REPLAY_NAME(ResponseSkycoinAddress),
+    REPLAY_NAME(SkycoinSignMessage),
+    REPLAY_NAME(ResponseSkycoinSignMessage),
+    REPLAY_NAME(TransactionSign),
+    REPLAY_NAME(ResponseTransactionSign),
+    REPLAY_NAME(SignTx),
+    REPLAY_NAME(TxRequest),
+    REPLAY_NAME(TxAck),
+    REPLAY_NAME(DebugLinkDecision),
+    REPLAY_NAME(DebugLinkGetState),
+};
+#endif
+
+static const char* replay_name(uint16_t msg_id, char* buffer, size_t size)
+{
+#if REPLAY_NAMES
+    for (size_t i = 0; i < sizeof(replay_names) / sizeof(replay_names[0]); i++) {
+        if (replay_names[i].msg_id == msg_id) {
+            return replay_names[i].name;
+        }
+    }
+#endif
+    snprintf(buffer, size, "%u", msg_id);
+    return buffer;
+}
+
+typedef enum {
+    ReplaySend,   /*!< Message written by the host */
+    ReplayButton, /*!< Button pressed by the host */
+    ReplayExpect, /*!< Message the emulator answered */
+} ReplayKind;
+
+typedef struct {
+    ReplayKind kind;
+    int iface;
+    uint16_t msg_id;
+    uint8_t button;
+    uint32_t size;
+    uint8_t* data;
+} ReplayEvent;
+
+/* Message being reassembled from the reports of one direction and interface */
+typedef struct {
+    bool active;
+    uint16_t msg_id;
+    uint32_t size;
+    uint32_t received;
+    uint8_t* data;
+} ReplayAssembly;
+
+static ReplayEvent* events;
+static size_t events_count;
+static bool uses_debug;
+
+static void replay_add(ReplayKind kind, int iface, uint16_t msg_id, uint8_t button, uint32_t size, uint8_t* data)
+{
+    static size_t capacity;
+    if (events_count == capacity) {
+        capacity = capacity ? 2 * capacity : 256;
+        events = realloc(events, capacity * sizeof(*events));
+        if (!events) {
+            perror("Failed to read trace");
+            exit(1);
+        }
+    }
+    events[events_count++] = (ReplayEvent){kind, iface, msg_id, button, size, data};
+    uses_debug |= iface == 1;
+}
+
+static void replay_report(ReplayAssembly* assembly, bool device, int iface, const uint8_t* report)
+{
+    uint32_t pos;
+    if (!device && memcmp(report, "\x00\x01\x02\x03\x04", 5) == 0) {
+        replay_add(ReplayButton, iface, 0, report[5], 0, NULL);
+        return;
+    }
+    if (report[0] == '?' && report[1] == '#' && report[2] == '#') {
+        free(assembly->data);
+        assembly->active = true;
+        assembly->msg_id = ((uint16_t)report[3] << 8) | report[4];
+        assembly->size = ((uint32_t)report[5] << 24) | ((uint32_t)report[6] << 16) | ((uint32_t)report[7] << 8) | report[8];
+        assembly->received = 0;
+        assembly->data = NULL;
+        if (assembly->size > REPLAY_MAX_MESSAGE) {
+            fprintf(stderr, "Message %u of %u bytes skipped\n", assembly->msg_id, assembly->size);
+            assembly->active = false;
+            return;
+        }
+        assembly->data = malloc(assembly->size + 1);
+        if (!assembly->data) {
+            perror("Failed to read trace");
+            exit(1);
+        }
+        pos = REPLAY_HEADER_SIZE;
+    } else if (report[0] == '?' && assembly->active) {
+        pos = 1;
+    } else {
+        return;
+    }
+
+    uint32_t chunk = EMULATOR_CLIENT_REPORT_SIZE - pos;
+    if (chunk > assembly->size - assembly->received) {
+        chunk = assembly->size - assembly->received;
+    }
+    memcpy(assembly->data + assembly->received, report + pos, chunk);
+    assembly->received += chunk;
+    if (assembly->received < assembly->size) {
+        return;
+    }
+    if (device) {
+        // answers are only checked by type
+        free(assembly->data);
+        assembly->data = NULL;
+        replay_add(ReplayExpect, iface, assembly->msg_id, 0, 0, NULL);
+    } else {
+        replay_add(ReplaySend, iface, assembly->msg_id, 0, assembly->size, assembly->data);
+        assembly->data = NULL;
+    }
+    assembly->active = false;
+}
+
+static bool replay_load(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return false;
+    }
+    uint8_t header[EMULATOR_TRACE_HEADER_SIZE];
+    if (fread(header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header, EMULATOR_TRACE_MAGIC, strlen(EMULATOR_TRACE_MAGIC)) != 0 ||
+        header[strlen(EMULATOR_TRACE_MAGIC)] != EMULATOR_TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d trace\n", path, EMULATOR_TRACE_VERSION);
+        fclose(fp);
+        return false;
+    }
+
+    // [device][iface]
+    ReplayAssembly assembly[2][2];
+    memset(assembly, 0, sizeof(assembly));
+    uint8_t record[EMULATOR_TRACE_RECORD_SIZE];
+    uint8_t report[EMULATOR_CLIENT_REPORT_SIZE];
+    while (fread(record, sizeof(record), 1, fp) == 1) {
+        if (record[1] > sizeof(report)) {
+            fprintf(stderr, "%s: corrupted record\n", path);
+            fclose(fp);
+            return false;
+        }
+        memset(report, 0, sizeof(report));
+        if (fread(report, 1, record[1], fp) != record[1]) {
+            // the emulator was killed while writing
+            break;
+        }
+        bool device = record[0] & EMULATOR_TRACE_DEVICE;
+        int iface = (record[0] & EMULATOR_TRACE_DEBUG) ? 1 : 0;
+        replay_report(&assembly[device][iface], device, iface, report);
+    }
+    fclose(fp);
+    for (int i = 0; i < 4; i++) {
+        free(assembly[i / 2][i % 2].data);
+    }
+    return true;
+}
+
+/* Latencies of the messages of one type, in microseconds */
+typedef struct {
+    uint16_t msg_id;
+    size_t count;
+    size_t capacity;
+    uint32_t* us;
+} ReplayLatency;
+
+typedef struct {
+    const char* path;
+    int runs;
+    int timeout_ms;
+    pthread_t thread;
+    uint64_t messages;
+    uint64_t mismatches;
+    int error;
+    ReplayLatency* latencies;
+    size_t latencies_count;
+} ReplayInstance;
+
+static ReplayLatency* replay_latency(ReplayLatency** latencies, size_t* count, uint16_t msg_id)
+{
+    for (size_t i = 0; i < *count; i++) {
+        if ((*latencies)[i].msg_id == msg_id) {
+            return &(*latencies)[i];
+        }
+    }
+    *latencies = realloc(*latencies, (*count + 1) * sizeof(**latencies));
+    if (!*latencies) {
+        perror("Failed to record latency");
+        exit(1);
+    }
+    ReplayLatency* latency = &(*latencies)[(*count)++];
+    memset(latency, 0, sizeof(*latency));
+    latency->msg_id = msg_id;
+    return latency;
+}
+
+static void replay_sample(ReplayLatency* latency, uint32_t us)
+{
+    if (latency->count == latency->capacity) {
+        latency->capacity = latency->capacity ? 2 * latency->capacity : 64;
+        latency->us = realloc(latency->us, latency->capacity * sizeof(*latency->us));
+        if (!latency->us) {
+            perror("Failed to record latency");
+            exit(1);
+        }
+    }
+    latency->us[latency->count++] = us;
+}
+
+static uint64_t replay_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Latency of a message runs from its first report to the first answer on the same interface */
+static void* replay_run(void* arg)
+{
+    ReplayInstance* instance = arg;
+    int fd[2] = {-1, -1};
+    uint8_t* answer = malloc(REPLAY_MAX_MESSAGE);
+    char debug_path[4096];
+    snprintf(debug_path, sizeof(debug_path), "%s" EMULATOR_CLIENT_DEBUG_SUFFIX, instance->path);
+
+    fd[0] = emulator_client_connect(instance->path);
+    if (fd[0] < 0 || (uses_debug && (fd[1] = emulator_client_connect(debug_path)) < 0) || !answer) {
+        instance->error = errno;
+        goto out;
+    }
+
+    for (int run = 0; run < instance->runs; run++) {
+        bool pending[2] = {false, false};
+        uint16_t pending_id[2] = {0, 0};
+        uint64_t pending_start[2] = {0, 0};
+        for (size_t i = 0; i < events_count; i++) {
+            const ReplayEvent* event = &events[i];
+            int iface = event->iface;
+            if (event->kind == ReplayButton) {
+                if (!emulator_client_press_button(fd[iface], event->button)) {
+                    instance->error = errno;
+                    goto out;
+                }
+                continue;
+            }
+            if (event->kind == ReplaySend) {
+                pending[iface] = true;
+                pending_id[iface] = event->msg_id;
+                pending_start[iface] = replay_now_us();
+                if (!emulator_client_write(fd[iface], event->msg_id, event->data, event->size)) {
+                    instance->error = errno;
+                    goto out;
+                }
+                instance->messages++;
+                continue;
+            }
+
+            uint16_t msg_id;
+            uint32_t size;
+            if (!emulator_client_read(fd[iface], &msg_id, answer, REPLAY_MAX_MESSAGE, &size, instance->timeout_ms)) {
+                instance->error = errno;
+                goto out;
+            }
+            uint64_t end = replay_now_us();
+            instance->messages++;
+            if (msg_id != event->msg_id) {
+                instance->mismatches++;
+            }
+            if (pending[iface]) {
+                ReplayLatency* latency = replay_latency(&instance->latencies, &instance->latencies_count, pending_id[iface]);
+                uint64_t us = end - pending_start[iface];
+                replay_sample(latency, us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+                pending[iface] = false;
+            }
+        }
+    }
+
+out:
+    free(answer);
+    emulator_client_close(fd[0]);
+    emulator_client_close(fd[1]);
+    return NULL;
+}
+
+static int compare_msg_id(const void* a, const void* b)
+{
+    return (int)((const ReplayLatency*)a)->msg_id - (int)((const ReplayLatency*)b)->msg_id;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-n runs] [-t timeout_ms] trace socket...\n", name);
+    fprintf(stderr, "  -n runs        times every emulator replays the trace, default 1\n");
+    fprintf(stderr, "  -t timeout_ms  wait for each answer at most this long, default 10000\n");
+}
+
+int main(int argc, char** argv)
+{
+    int runs = 1;
+    int timeout_ms = 10000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        case 't':
+            timeout_ms = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (argc - optind < 2 || runs <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (!replay_load(argv[optind])) {
+        return 1;
+    }
+
+    int count = argc - optind - 1;
+    ReplayInstance* instances = calloc(count, sizeof(*instances));
+    if (!instances) {
+        perror("Failed to start replay");
+        return 1;
+    }
+    uint64_t start = replay_now_us();
+    for (int i = 0; i < count; i++) {
+        instances[i].path = argv[optind + 1 + i];
+        instances[i].runs = runs;
+        instances[i].timeout_ms = timeout_ms;
+        if (pthread_create(&instances[i].thread, NULL, replay_run, &instances[i]) != 0) {
+            perror("Failed to start replay");
+            return 1;
+        }
+    }
+
+    int status = 0;
+    uint64_t messages = 0;
+    uint64_t mismatches = 0;
+    ReplayLatency* latencies = NULL;
+    size_t latencies_count = 0;
+    for (int i = 0; i < count; i++) {
+        ReplayInstance* instance = &instances[i];
+        pthread_join(instance->thread, NULL);
+        if (instance->error) {
+            fprintf(stderr, "%s: %s\n", instance->path, strerror(instance->error));
+            status = 1;
+        }
+        messages += instance->messages;
+        mismatches += instance->mismatches;
+        for (size_t j = 0; j < instance->latencies_count; j++) {
+            ReplayLatency* from = &instance->latencies[j];
+            ReplayLatency* to = replay_latency(&latencies, &latencies_count, from->msg_id);
+            for (size_t k = 0; k < from->count; k++) {
+                replay_sample(to, from->us[k]);
+            }
+            free(from->us);
+        }
+        free(instance->latencies);
+    }
+    double seconds = (replay_now_us() - start) / 1e6;
+
+    printf("%d emulators, %d runs, %llu messages in %.3f s: %.1f messages/s\n", count, runs,
+        (unsigned long long)messages, seconds, seconds > 0 ? messages / seconds : 0.0);
+    if (mismatches) {
+        printf("%llu answers of another type than in the trace\n", (unsigned long long)mismatches);
+        status = 1;
+    }
+    printf("%-28s %8s %9s %9s %9s %9s %9s\n", "message", "count", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms");
+    qsort(latencies, latencies_count, sizeof(*latencies), compare_msg_id);
+    for (size_t i = 0; i < latencies_count; i++) {
+        ReplayLatency* latency = &latencies[i];
+        char name[8];
+        uint64_t total = 0;
+        emulator_client_sort_us(latency->us, latency->count);
+        for (size_t k = 0; k < latency->count; k++) {
+            total += latency->us[k];
+        }
+        const uint32_t* us = latency->us;
+        printf("%-28s %8zu %9.3f %9.3f %9.3f %9.3f %9.3f\n", replay_name(latency->msg_id, name, sizeof(name)),
+            latency->count, total / 1000.0 / latency->count, emulator_client_percentile_ms(us, latency->count, 500),
+            emulator_client_percentile_ms(us, latency->count, 900), emulator_client_percentile_ms(us, latency->count, 990),
+            us[latency->count - 1] / 1000.0);
+        free(latency->us);
+    }
+    free(latencies);
+    free(instances);
+    return status;
+}
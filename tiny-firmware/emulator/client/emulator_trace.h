@@ -0,0 +1,39 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#ifndef __TINYFIRMWARE_EMULATOR_TRACE__
+#define __TINYFIRMWARE_EMULATOR_TRACE__
+
+/* Reports exchanged with an emulator started with SKYWALLET_TRACE_FILE.
+ *
+ * The file starts with EMULATOR_TRACE_MAGIC and a version byte padded to
+ * EMULATOR_TRACE_HEADER_SIZE bytes. Every report follows as a record of
+ * EMULATOR_TRACE_RECORD_SIZE bytes:
+ *
+ *   flags      1 byte, EMULATOR_TRACE_DEVICE and EMULATOR_TRACE_DEBUG bits
+ *   length     1 byte, bytes of the report kept, at most 64
+ *   delta_us   4 bytes little endian, microseconds since the previous record
+ *
+ * then by the first length bytes of the report. Trailing zero bytes are
+ * dropped, they pad the last report of every message.
+ */
+
+#define EMULATOR_TRACE_MAGIC "SWTR"
+#define EMULATOR_TRACE_VERSION 1
+#define EMULATOR_TRACE_HEADER_SIZE 8
+#define EMULATOR_TRACE_RECORD_SIZE 6
+
+// Report sent by the emulator, otherwise received from the host
+#define EMULATOR_TRACE_DEVICE 0x01
+// Report of the debug link, otherwise of the main interface
+#define EMULATOR_TRACE_DEBUG 0x02
+
+#endif // __TINYFIRMWARE_EMULATOR_TRACE__
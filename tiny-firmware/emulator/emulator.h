@@ -22,7 +22,9 @@
 
 #if EMULATOR
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #if !defined(__APPLE__) && !defined(TARGET_OS_MAC)
 #include "strl.h" // NOTE(): This file is not required by BSD family(Darwin)
@@ -30,10 +32,18 @@
 
 void emulatorPoll(void);
 void emulatorRandom(void* buffer, size_t size);
+void emulatorFlashSync(size_t offset, size_t size);
+void emulatorUuid(uint8_t* uuid, size_t size);
+uint64_t emulatorEnvNumber(const char* name, uint64_t fallback, uint64_t min, uint64_t max);
 
 void emulatorSocketInit(void);
 size_t emulatorSocketRead(int* iface, void* buffer, size_t size);
 size_t emulatorSocketWrite(int iface, const void* buffer, size_t size);
+void emulatorWait(uint32_t timeout_ms);
+
+bool emulatorVirtualTime(void);
+void emulatorSetVirtualTime(bool enabled);
+void emulatorAdvanceTime(uint32_t ms);
 
 #endif // EMULATOR
 
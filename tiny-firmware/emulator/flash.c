@@ -22,8 +22,15 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <libopencm3/stm32/flash.h>
+
 #include "tiny-firmware/memory.h"
 
+/* Programming errors since the flash was unlocked, returned by svc_flash_lock */
+static uint32_t flash_status;
+/* Bit mask of the sectors changed since the flash was last locked */
+static uint32_t flash_dirty;
+
 void flash_lock(void) {}
 void flash_unlock(void) {}
 
@@ -88,6 +95,17 @@ static ssize_t sector_to_size(uint8_t sector)
     return end - start;
 }
 
+static void flash_mark_dirty(uint32_t address)
+{
+    uint32_t offset = address - FLASH_ORIGIN;
+    for (uint8_t sector = 0; sector_to_offset(sector + 1) >= 0; sector++) {
+        if (offset < (uint32_t)sector_to_offset(sector + 1)) {
+            flash_dirty |= 1u << sector;
+            return;
+        }
+    }
+}
+
 void flash_erase_sector(uint8_t sector, uint32_t program_size)
 {
     (void)program_size;
@@ -103,6 +121,7 @@ void flash_erase_sector(uint8_t sector, uint32_t program_size)
     }
 
     memset(address, 0xFF, size);
+    flash_dirty |= 1u << sector;
 }
 
 void flash_erase_all_sectors(uint32_t program_size)
@@ -112,17 +131,45 @@ void flash_erase_all_sectors(uint32_t program_size)
     memset(emulator_flash_base, 0xFF, FLASH_TOTAL_SIZE);
 }
 
+/* Like the real flash, programming can only clear bits of erased words */
 void flash_program_word(uint32_t address, uint32_t data)
 {
-    *(volatile uint32_t*)FLASH_PTR(address) = data;
+    volatile uint32_t* ptr = (volatile uint32_t*)FLASH_PTR(address);
+    if (address & 3) {
+        flash_status |= FLASH_SR_PGAERR;
+        return;
+    }
+    if (data & ~*ptr) {
+        flash_status |= FLASH_SR_PGSERR;
+    }
+    *ptr &= data;
+    flash_mark_dirty(address);
 }
 
 void flash_program_byte(uint32_t address, uint8_t data)
 {
-    *(volatile uint8_t*)FLASH_PTR(address) = data;
+    volatile uint8_t* ptr = (volatile uint8_t*)FLASH_PTR(address);
+    if (data & ~*ptr) {
+        flash_status |= FLASH_SR_PGSERR;
+    }
+    *ptr &= data;
+    flash_mark_dirty(address);
 }
 
 static bool flash_locked = true;
+
+void flash_write32(uint32_t addr, uint32_t word)
+{
+    assert(!flash_locked);
+    flash_program_word(addr, word);
+}
+
+void flash_write8(uint32_t addr, uint8_t byte)
+{
+    assert(!flash_locked);
+    flash_program_byte(addr, byte);
+}
+
 void svc_flash_unlock(void)
 {
     assert(flash_locked);
@@ -144,5 +191,13 @@ uint32_t svc_flash_lock(void)
 {
     assert(!flash_locked);
     flash_locked = true;
-    return 0;
+    for (uint8_t sector = 0; flash_dirty != 0; sector++) {
+        if (flash_dirty & (1u << sector)) {
+            emulatorFlashSync(sector_to_offset(sector), sector_to_size(sector));
+            flash_dirty &= ~(1u << sector);
+        }
+    }
+    uint32_t status = flash_status;
+    flash_status = 0;
+    return status;
 }
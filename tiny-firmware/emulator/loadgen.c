@@ -0,0 +1,638 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+/* Soak test driver, one thread per emulator listening on a Unix socket.
+ *
+ * Every emulator is wiped and loaded with a known mnemonic, then gets a
+ * random mix of address listings, message signatures and checks, and
+ * TransactionSign or SignTx/TxAck signatures of several inputs. Button
+ * requests are confirmed with the simulated button press of usbPoll. The
+ * throughput, the latency percentiles and the errors of every kind of
+ * request are reported at the end.
+ *
+ *   skycoin-emulator-loadgen [-n requests] [-m mix] [-i inputs] [-a addresses]
+ *                            [-s seed] [-t timeout_ms] socket...
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tiny-firmware/buttons.h"
+#include "tiny-firmware/emulator/client/emulator_client.h"
+
+#include "messages.pb.h"
+#include "pb_decode.h"
+#include "pb_encode.h"
+
+#define LOADGEN_MNEMONIC "cloud flower upset remain green metal below cup stem infant art thank"
+// Encoded messages and decoded answers
+#define LOADGEN_BUFFER_SIZE (16 * 1024)
+// Addresses read at start, spent from and sent to
+#define LOADGEN_ADDRESSES 8
+// Inputs or outputs carried by a TxAck
+#define LOADGEN_TXACK_ITEMS 7
+// Largest address listing of SkycoinAddress
+#define LOADGEN_MAX_ADDRESS_N 99
+
+_Static_assert(sizeof(ResponseSkycoinAddress) <= LOADGEN_BUFFER_SIZE, "address listing does not fit");
+_Static_assert(sizeof(TxRequest) <= LOADGEN_BUFFER_SIZE, "TxRequest does not fit");
+
+typedef enum {
+    LoadAddress = 0,     /*!< SkycoinAddress */
+    LoadSignMessage,     /*!< SkycoinSignMessage */
+    LoadCheckSignature,  /*!< SkycoinCheckMessageSignature */
+    LoadTransactionSign, /*!< TransactionSign */
+    LoadSignTx,          /*!< SignTx followed by TxAck */
+    LoadKindCount,
+} LoadKind;
+
+static const char* const load_names[LoadKindCount] = {"address", "sign", "verify", "transaction", "signtx"};
+
+typedef enum {
+    LoadOk,     /*!< Expected answer */
+    LoadFailed, /*!< Failure or unexpected answer, the next request may go on */
+    LoadBroken, /*!< Connection lost or timed out */
+} LoadResult;
+
+/* Outcome of one kind of request on one emulator */
+typedef struct {
+    uint64_t count;
+    uint64_t errors;
+    size_t capacity;
+    uint32_t* us;
+    char failure[96];
+} LoadStats;
+
+typedef struct {
+    const char* path;
+    unsigned seed;
+    pthread_t thread;
+    int fd;
+    uint8_t* buffer;
+    void* answer;
+    char addresses[LOADGEN_ADDRESSES][36];
+    size_t addresses_count;
+    // last message signed, checked by LoadCheckSignature
+    char message[64];
+    char signature[160];
+    size_t signer;
+    uint64_t messages;
+    char failure[96];
+    int error;
+    LoadStats stats[LoadKindCount];
+} LoadWorker;
+
+static struct {
+    unsigned requests;
+    unsigned weights[LoadKindCount];
+    unsigned total_weight;
+    unsigned max_inputs;
+    unsigned max_address_n;
+    int timeout_ms;
+} config = {
+    .requests = 100,
+    .weights = {4, 2, 2, 1, 1},
+    .max_inputs = 4,
+    .max_address_n = 10,
+    .timeout_ms = 10000,
+};
+
+static uint64_t now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static unsigned random_below(LoadWorker* w, unsigned n)
+{
+    return n ? (unsigned)rand_r(&w->seed) % n : 0;
+}
+
+static void random_hex(LoadWorker* w, char* hex, size_t bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < 2 * bytes; i++) {
+        hex[i] = digits[random_below(w, 16)];
+    }
+    hex[2 * bytes] = '\0';
+}
+
+/* Send a request and wait for its answer, acknowledging and confirming every ButtonRequest on the way */
+static LoadResult loadgen_call(LoadWorker* w, uint16_t msg_id, const pb_field_t* fields, const void* msg,
+    uint16_t answer_id, const pb_field_t* answer_fields)
+{
+    pb_ostream_t os = pb_ostream_from_buffer(w->buffer, LOADGEN_BUFFER_SIZE);
+    if (!pb_encode(&os, fields, msg)) {
+        snprintf(w->failure, sizeof(w->failure), "encoding %u: %s", msg_id, PB_GET_ERROR(&os));
+        return LoadFailed;
+    }
+    if (!emulator_client_write(w->fd, msg_id, w->buffer, os.bytes_written)) {
+        return LoadBroken;
+    }
+    w->messages++;
+
+    for (;;) {
+        uint16_t id;
+        uint32_t size;
+        if (!emulator_client_read(w->fd, &id, w->buffer, LOADGEN_BUFFER_SIZE, &size, config.timeout_ms)) {
+            return LoadBroken;
+        }
+        w->messages++;
+        if (id == MessageType_MessageType_ButtonRequest) {
+            if (!emulator_client_write(w->fd, MessageType_MessageType_ButtonAck, w->buffer, 0) ||
+                !emulator_client_press_button(w->fd, BTN_RIGHT)) {
+                return LoadBroken;
+            }
+            w->messages++;
+            continue;
+        }
+
+        pb_istream_t is = pb_istream_from_buffer(w->buffer, size);
+        if (id == answer_id) {
+            memset(w->answer, 0, LOADGEN_BUFFER_SIZE);
+            if (!pb_decode(&is, answer_fields, w->answer)) {
+                snprintf(w->failure, sizeof(w->failure), "decoding %u: %s", id, PB_GET_ERROR(&is));
+                return LoadFailed;
+            }
+            return LoadOk;
+        }
+        if (id == MessageType_MessageType_Failure) {
+            Failure failure = Failure_init_zero;
+            pb_decode(&is, Failure_fields, &failure);
+            snprintf(w->failure, sizeof(w->failure), "Failure %d: %.80s", failure.code,
+                failure.has_message ? failure.message : "");
+            return LoadFailed;
+        }
+        snprintf(w->failure, sizeof(w->failure), "message %u instead of %u", id, answer_id);
+        return LoadFailed;
+    }
+}
+
+static LoadResult loadgen_setup(LoadWorker* w)
+{
+    WipeDevice wipe = WipeDevice_init_zero;
+    LoadResult result = loadgen_call(w, MessageType_MessageType_WipeDevice, WipeDevice_fields, &wipe,
+        MessageType_MessageType_Success, Success_fields);
+    if (result != LoadOk) {
+        return result;
+    }
+
+    SetMnemonic mnemonic = SetMnemonic_init_zero;
+    strncpy(mnemonic.mnemonic, LOADGEN_MNEMONIC, sizeof(mnemonic.mnemonic) - 1);
+    result = loadgen_call(w, MessageType_MessageType_SetMnemonic, SetMnemonic_fields, &mnemonic,
+        MessageType_MessageType_Success, Success_fields);
+    if (result != LoadOk) {
+        return result;
+    }
+
+    SkycoinAddress address = SkycoinAddress_init_zero;
+    address.address_n = LOADGEN_ADDRESSES;
+    result = loadgen_call(w, MessageType_MessageType_SkycoinAddress, SkycoinAddress_fields, &address,
+        MessageType_MessageType_ResponseSkycoinAddress, ResponseSkycoinAddress_fields);
+    if (result != LoadOk) {
+        return result;
+    }
+    const ResponseSkycoinAddress* resp = w->answer;
+    w->addresses_count = resp->addresses_count < LOADGEN_ADDRESSES ? resp->addresses_count : LOADGEN_ADDRESSES;
+    for (size_t i = 0; i < w->addresses_count; i++) {
+        strncpy(w->addresses[i], resp->addresses[i], sizeof(w->addresses[i]) - 1);
+    }
+    if (w->addresses_count == 0) {
+        snprintf(w->failure, sizeof(w->failure), "no address");
+        return LoadFailed;
+    }
+    return LoadOk;
+}
+
+static LoadResult load_address(LoadWorker* w)
+{
+    SkycoinAddress msg = SkycoinAddress_init_zero;
+    msg.address_n = 1 + random_below(w, config.max_address_n);
+    msg.has_start_index = true;
+    msg.start_index = random_below(w, 100);
+    LoadResult result = loadgen_call(w, MessageType_MessageType_SkycoinAddress, SkycoinAddress_fields, &msg,
+        MessageType_MessageType_ResponseSkycoinAddress, ResponseSkycoinAddress_fields);
+    if (result == LoadOk && ((const ResponseSkycoinAddress*)w->answer)->addresses_count != msg.address_n) {
+        snprintf(w->failure, sizeof(w->failure), "%u addresses instead of %" PRIu32,
+            (unsigned)((const ResponseSkycoinAddress*)w->answer)->addresses_count, msg.address_n);
+        return LoadFailed;
+    }
+    return result;
+}
+
+static LoadResult load_sign_message(LoadWorker* w)
+{
+    SkycoinSignMessage msg = SkycoinSignMessage_init_zero;
+    w->signer = random_below(w, w->addresses_count);
+    msg.address_n = w->signer;
+    snprintf(w->message, sizeof(w->message), "loadgen %u", (unsigned)rand_r(&w->seed));
+    strncpy(msg.message, w->message, sizeof(msg.message) - 1);
+    LoadResult result = loadgen_call(w, MessageType_MessageType_SkycoinSignMessage, SkycoinSignMessage_fields, &msg,
+        MessageType_MessageType_ResponseSkycoinSignMessage, ResponseSkycoinSignMessage_fields);
+    if (result == LoadOk) {
+        strncpy(w->signature, ((const ResponseSkycoinSignMessage*)w->answer)->signed_message, sizeof(w->signature) - 1);
+    } else {
+        w->signature[0] = '\0';
+    }
+    return result;
+}
+
+static LoadResult load_check_signature(LoadWorker* w)
+{
+    if (w->signature[0] == '\0') {
+        // nothing signed yet, or the last signature failed
+        LoadResult result = load_sign_message(w);
+        if (result != LoadOk) {
+            return result;
+        }
+    }
+    SkycoinCheckMessageSignature msg = SkycoinCheckMessageSignature_init_zero;
+    strncpy(msg.address, w->addresses[w->signer], sizeof(msg.address) - 1);
+    strncpy(msg.message, w->message, sizeof(msg.message) - 1);
+    strncpy(msg.signature, w->signature, sizeof(msg.signature) - 1);
+    return loadgen_call(w, MessageType_MessageType_SkycoinCheckMessageSignature, SkycoinCheckMessageSignature_fields,
+        &msg, MessageType_MessageType_Success, Success_fields);
+}
+
+static LoadResult load_transaction_sign(LoadWorker* w)
+{
+    TransactionSign msg = TransactionSign_init_zero;
+    msg.nbIn = 1 + random_below(w, config.max_inputs);
+    msg.nbOut = 1 + random_below(w, 2);
+    for (uint32_t i = 0; i < msg.nbIn; i++) {
+        random_hex(w, msg.transactionIn[i].hashIn, 32);
+        msg.transactionIn[i].has_index = true;
+        msg.transactionIn[i].index = random_below(w, w->addresses_count);
+    }
+    for (uint32_t i = 0; i < msg.nbOut; i++) {
+        strncpy(msg.transactionOut[i].address, w->addresses[random_below(w, w->addresses_count)],
+            sizeof(msg.transactionOut[i].address) - 1);
+        msg.transactionOut[i].coin = 1000000 * (1 + random_below(w, 100));
+        msg.transactionOut[i].hour = random_below(w, 1000);
+    }
+    msg.transactionIn_count = msg.nbIn;
+    msg.transactionOut_count = msg.nbOut;
+    LoadResult result = loadgen_call(w, MessageType_MessageType_TransactionSign, TransactionSign_fields, &msg,
+        MessageType_MessageType_ResponseTransactionSign, ResponseTransactionSign_fields);
+    if (result == LoadOk && ((const ResponseTransactionSign*)w->answer)->signatures_count != msg.nbIn) {
+        snprintf(w->failure, sizeof(w->failure), "%u signatures for %" PRIu32 " inputs",
+            (unsigned)((const ResponseTransactionSign*)w->answer)->signatures_count, msg.nbIn);
+        return LoadFailed;
+    }
+    return result;
+}
+
+/* Send a TxAck and check which part of the transaction the device asks for next */
+static LoadResult load_tx_ack(LoadWorker* w, TxAck* ack, TxRequest_RequestType expected, size_t* signatures)
+{
+    LoadResult result = loadgen_call(w, MessageType_MessageType_TxAck, TxAck_fields, ack,
+        MessageType_MessageType_TxRequest, TxRequest_fields);
+    if (result != LoadOk) {
+        return result;
+    }
+    const TxRequest* req = w->answer;
+    if (req->request_type != expected) {
+        snprintf(w->failure, sizeof(w->failure), "TxRequest %d instead of %d", req->request_type, expected);
+        return LoadFailed;
+    }
+    *signatures += req->sign_result_count;
+    return LoadOk;
+}
+
+/* Inputs are hashed, then outputs, then inputs are sent again to be signed */
+static LoadResult load_sign_tx(LoadWorker* w)
+{
+    SignTx msg = SignTx_init_default;
+    uint32_t inputs = 1 + random_below(w, config.max_inputs);
+    uint32_t outputs = 1 + random_below(w, 2);
+    msg.inputs_count = inputs;
+    msg.outputs_count = outputs;
+    msg.has_coin_name = true;
+    strncpy(msg.coin_name, "Skycoin", sizeof(msg.coin_name) - 1);
+    msg.has_version = true;
+    msg.version = 1;
+    msg.has_lock_time = true;
+    msg.lock_time = 0;
+    msg.has_tx_hash = true;
+    // every session needs its own hash
+    random_hex(w, msg.tx_hash, 32);
+    LoadResult result = loadgen_call(w, MessageType_MessageType_SignTx, SignTx_fields, &msg,
+        MessageType_MessageType_TxRequest, TxRequest_fields);
+    if (result != LoadOk) {
+        return result;
+    }
+
+    char hashes[LOADGEN_TXACK_ITEMS * 2][65];
+    uint32_t indexes[LOADGEN_TXACK_ITEMS * 2];
+    for (uint32_t i = 0; i < inputs; i++) {
+        random_hex(w, hashes[i], 32);
+        indexes[i] = random_below(w, w->addresses_count);
+    }
+    size_t signatures = 0;
+    TxAck ack = TxAck_init_default;
+    ack.has_tx = true;
+    ack.tx.has_version = true;
+    ack.tx.version = 1;
+    ack.tx.has_lock_time = true;
+    ack.tx.lock_time = 0;
+
+    for (int signing = 0; signing < 2; signing++) {
+        for (uint32_t sent = 0; sent < inputs;) {
+            uint32_t n = inputs - sent < LOADGEN_TXACK_ITEMS ? inputs - sent : LOADGEN_TXACK_ITEMS;
+            ack.tx.inputs_count = n;
+            ack.tx.outputs_count = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                memset(&ack.tx.inputs[i], 0, sizeof(ack.tx.inputs[i]));
+                strncpy(ack.tx.inputs[i].hashIn, hashes[sent + i], sizeof(ack.tx.inputs[i].hashIn) - 1);
+                ack.tx.inputs[i].address_n_count = 1;
+                ack.tx.inputs[i].address_n[0] = indexes[sent + i];
+            }
+            sent += n;
+            TxRequest_RequestType next = sent < inputs ? TxRequest_RequestType_TXINPUT :
+                                         signing ? TxRequest_RequestType_TXFINISHED :
+                                                   TxRequest_RequestType_TXOUTPUT;
+            result = load_tx_ack(w, &ack, next, &signatures);
+            if (result != LoadOk) {
+                return result;
+            }
+        }
+        if (signing) {
+            break;
+        }
+        // a single TxAck carries every output, there are at most two
+        ack.tx.inputs_count = 0;
+        ack.tx.outputs_count = outputs;
+        for (uint32_t i = 0; i < outputs; i++) {
+            memset(&ack.tx.outputs[i], 0, sizeof(ack.tx.outputs[i]));
+            strncpy(ack.tx.outputs[i].address, w->addresses[random_below(w, w->addresses_count)],
+                sizeof(ack.tx.outputs[i].address) - 1);
+            ack.tx.outputs[i].coins = 1000000 * (1 + random_below(w, 100));
+            ack.tx.outputs[i].hours = random_below(w, 1000);
+        }
+        result = load_tx_ack(w, &ack, TxRequest_RequestType_TXINPUT, &signatures);
+        if (result != LoadOk) {
+            return result;
+        }
+    }
+    if (signatures != inputs) {
+        snprintf(w->failure, sizeof(w->failure), "%zu signatures for %" PRIu32 " inputs", signatures, inputs);
+        return LoadFailed;
+    }
+    return LoadOk;
+}
+
+static LoadResult (*const load_requests[LoadKindCount])(LoadWorker* w) = {
+    load_address,
+    load_sign_message,
+    load_check_signature,
+    load_transaction_sign,
+    load_sign_tx,
+};
+
+static void stats_sample(LoadStats* stats, uint32_t us)
+{
+    if (stats->count == stats->capacity) {
+        stats->capacity = stats->capacity ? 2 * stats->capacity : 64;
+        stats->us = realloc(stats->us, stats->capacity * sizeof(*stats->us));
+        if (!stats->us) {
+            perror("Failed to record latency");
+            exit(1);
+        }
+    }
+    stats->us[stats->count++] = us;
+}
+
+static LoadKind random_kind(LoadWorker* w)
+{
+    unsigned pick = random_below(w, config.total_weight);
+    for (int kind = 0; kind < LoadKindCount; kind++) {
+        if (pick < config.weights[kind]) {
+            return kind;
+        }
+        pick -= config.weights[kind];
+    }
+    return LoadAddress;
+}
+
+static void* loadgen_run(void* arg)
+{
+    LoadWorker* w = arg;
+    w->fd = emulator_client_connect(w->path);
+    if (w->fd < 0) {
+        w->error = errno;
+        return NULL;
+    }
+    LoadResult result = loadgen_setup(w);
+    if (result != LoadOk) {
+        w->error = result == LoadBroken ? errno : EPROTO;
+        emulator_client_close(w->fd);
+        return NULL;
+    }
+
+    for (unsigned i = 0; i < config.requests; i++) {
+        LoadKind kind = random_kind(w);
+        LoadStats* stats = &w->stats[kind];
+        uint64_t start = now_us();
+        result = load_requests[kind](w);
+        uint64_t us = now_us() - start;
+        if (result == LoadOk) {
+            stats_sample(stats, us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+            continue;
+        }
+        stats->errors++;
+        if (result == LoadBroken) {
+            w->error = errno;
+            break;
+        }
+        memcpy(stats->failure, w->failure, sizeof(stats->failure));
+    }
+    emulator_client_close(w->fd);
+    return NULL;
+}
+
+/* name=weight pairs separated by commas, kinds left out are not sent */
+static bool parse_mix(const char* mix)
+{
+    char copy[256];
+    strncpy(copy, mix, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+    memset(config.weights, 0, sizeof(config.weights));
+    for (char* item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+        char* value = strchr(item, '=');
+        if (!value) {
+            return false;
+        }
+        *value++ = '\0';
+        int kind = 0;
+        while (kind < LoadKindCount && strcmp(item, load_names[kind]) != 0) {
+            kind++;
+        }
+        if (kind == LoadKindCount) {
+            return false;
+        }
+        config.weights[kind] = atoi(value);
+    }
+    return true;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-n requests] [-m mix] [-i inputs] [-a addresses] [-s seed] [-t timeout_ms] socket...\n", name);
+    fprintf(stderr, "  -n requests    sent to every emulator, default %u\n", config.requests);
+    fprintf(stderr, "  -m mix         weights of address, sign, verify, transaction and signtx,\n");
+    fprintf(stderr, "                 default address=4,sign=2,verify=2,transaction=1,signtx=1\n");
+    fprintf(stderr, "  -i inputs      most inputs of a transaction, default %u\n", config.max_inputs);
+    fprintf(stderr, "  -a addresses   most addresses listed at once, default %u\n", config.max_address_n);
+    fprintf(stderr, "  -s seed        of the request mix, default the time\n");
+    fprintf(stderr, "  -t timeout_ms  wait for each answer at most this long, default %d\n", config.timeout_ms);
+    fprintf(stderr, "Emulators run with SKYWALLET_UNIX_SOCKET, they are wiped first.\n");
+}
+
+int main(int argc, char** argv)
+{
+    unsigned seed = time(NULL);
+    int opt;
+    while ((opt = getopt(argc, argv, "n:m:i:a:s:t:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            config.requests = atoi(optarg);
+            break;
+        case 'm':
+            if (!parse_mix(optarg)) {
+                fprintf(stderr, "Invalid mix: %s\n", optarg);
+                return 2;
+            }
+            break;
+        case 'i':
+            config.max_inputs = atoi(optarg);
+            break;
+        case 'a':
+            config.max_address_n = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            config.timeout_ms = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 2;
+        }
+    }
+    for (int kind = 0; kind < LoadKindCount; kind++) {
+        config.total_weight += config.weights[kind];
+    }
+    // TransactionSign takes at most 8 inputs
+    if (optind == argc || config.total_weight == 0 || config.max_inputs < 1 || config.max_inputs > 8 ||
+        config.max_address_n < 1 || config.max_address_n > LOADGEN_MAX_ADDRESS_N) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    int count = argc - optind;
+    LoadWorker* workers = calloc(count, sizeof(*workers));
+    if (!workers) {
+        perror("Failed to start");
+        return 1;
+    }
+    printf("seed %u\n", seed);
+    uint64_t start = now_us();
+    for (int i = 0; i < count; i++) {
+        LoadWorker* w = &workers[i];
+        w->path = argv[optind + i];
+        w->seed = seed + i;
+        w->buffer = malloc(LOADGEN_BUFFER_SIZE);
+        w->answer = malloc(LOADGEN_BUFFER_SIZE);
+        if (!w->buffer || !w->answer || pthread_create(&w->thread, NULL, loadgen_run, w) != 0) {
+            perror("Failed to start");
+            return 1;
+        }
+    }
+
+    int status = 0;
+    uint64_t messages = 0;
+    LoadStats total[LoadKindCount];
+    memset(total, 0, sizeof(total));
+    for (int i = 0; i < count; i++) {
+        LoadWorker* w = &workers[i];
+        pthread_join(w->thread, NULL);
+        if (w->error) {
+            fprintf(stderr, "%s: %s%s%s\n", w->path, strerror(w->error), w->failure[0] ? ", " : "", w->failure);
+            status = 1;
+        }
+        messages += w->messages;
+        for (int kind = 0; kind < LoadKindCount; kind++) {
+            LoadStats* stats = &w->stats[kind];
+            for (size_t k = 0; k < stats->count; k++) {
+                stats_sample(&total[kind], stats->us[k]);
+            }
+            total[kind].errors += stats->errors;
+            if (stats->failure[0]) {
+                memcpy(total[kind].failure, stats->failure, sizeof(total[kind].failure));
+            }
+            free(stats->us);
+        }
+        free(w->buffer);
+        free(w->answer);
+    }
+    double seconds = (now_us() - start) / 1e6;
+
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    for (int kind = 0; kind < LoadKindCount; kind++) {
+        requests += total[kind].count + total[kind].errors;
+        errors += total[kind].errors;
+    }
+    printf("%d emulators, %" PRIu64 " requests, %" PRIu64 " messages in %.3f s: %.1f requests/s, %.1f messages/s\n",
+        count, requests, messages, seconds, seconds > 0 ? requests / seconds : 0.0,
+        seconds > 0 ? messages / seconds : 0.0);
+    printf("%-12s %8s %8s %7s %9s %9s %9s %9s %9s %9s\n", "request", "ok", "errors", "error%", "mean ms",
+        "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms");
+    for (int kind = 0; kind < LoadKindCount; kind++) {
+        LoadStats* stats = &total[kind];
+        uint64_t sent = stats->count + stats->errors;
+        if (sent == 0) {
+            continue;
+        }
+        printf("%-12s %8" PRIu64 " %8" PRIu64 " %7.2f", load_names[kind], stats->count, stats->errors,
+            100.0 * stats->errors / sent);
+        if (stats->count) {
+            uint64_t sum = 0;
+            emulator_client_sort_us(stats->us, stats->count);
+            for (size_t k = 0; k < stats->count; k++) {
+                sum += stats->us[k];
+            }
+            const uint32_t* us = stats->us;
+            printf(" %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f", sum / 1000.0 / stats->count,
+                emulator_client_percentile_ms(us, stats->count, 500), emulator_client_percentile_ms(us, stats->count, 900),
+                emulator_client_percentile_ms(us, stats->count, 990), emulator_client_percentile_ms(us, stats->count, 999),
+                us[stats->count - 1] / 1000.0);
+        }
+        printf("\n");
+        free(stats->us);
+    }
+    for (int kind = 0; kind < LoadKindCount; kind++) {
+        if (total[kind].failure[0]) {
+            printf("last %s error: %s\n", load_names[kind], total[kind].failure);
+        }
+    }
+    free(workers);
+    return status || errors ? 1 : 0;
+}
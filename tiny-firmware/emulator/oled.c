@@ -18,6 +18,7 @@
  * along with this library.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/oled.h"
 
 #if HEADLESS
@@ -37,15 +38,7 @@ static SDL_Texture* texture = NULL;
 
 static int emulatorScale(void)
 {
-    const char* variable = getenv(ENV_OLED_SCALE);
-    if (!variable) {
-        return 1;
-    }
-    int scale = atoi(variable);
-    if (scale >= 1 && scale <= 16) {
-        return scale;
-    }
-    return 1;
+    return emulatorEnvNumber(ENV_OLED_SCALE, 1, 1, 16);
 }
 
 void oledInit(void)
@@ -87,29 +80,41 @@ void oledInit(void)
 
 void oledRefresh(void)
 {
+    PROFILE_BEGIN(refresh);
     /* Draw triangle in upper right corner */
     oledInvertDebugLink();
 
     const uint8_t* buffer = oledGetBuffer();
+    uint8_t pages = oledChangedPages();
 
     static uint32_t data[OLED_HEIGHT][OLED_WIDTH];
 
-    for (size_t i = 0; i < OLED_BUFSIZE; i++) {
-        int x = (OLED_BUFSIZE - 1 - i) % OLED_WIDTH;
-        int y = (OLED_BUFSIZE - 1 - i) / OLED_WIDTH * 8 + 7;
-
-        for (uint8_t shift = 0; shift < 8; shift++, y--) {
-            bool set = (buffer[i] >> shift) & 1;
-            data[y][x] = set ? 0xFFFFFFFF : 0xFF000000;
+    /* Page n of the buffer holds the rows of band OLED_HEIGHT / 8 - 1 - n */
+    for (int page = 0; page < OLED_HEIGHT / 8; page++) {
+        if (!(pages & (1 << page))) {
+            continue;
         }
+        for (size_t i = page * OLED_WIDTH; i < (size_t)(page + 1) * OLED_WIDTH; i++) {
+            int x = (OLED_BUFSIZE - 1 - i) % OLED_WIDTH;
+            int y = (OLED_BUFSIZE - 1 - i) / OLED_WIDTH * 8 + 7;
+
+            for (uint8_t shift = 0; shift < 8; shift++, y--) {
+                bool set = (buffer[i] >> shift) & 1;
+                data[y][x] = set ? 0xFFFFFFFF : 0xFF000000;
+            }
+        }
+        SDL_Rect rect = {0, (OLED_HEIGHT / 8 - 1 - page) * 8, OLED_WIDTH, 8};
+        SDL_UpdateTexture(texture, &rect, data[rect.y], OLED_WIDTH * sizeof(uint32_t));
     }
 
-    SDL_UpdateTexture(texture, NULL, data, OLED_WIDTH * sizeof(uint32_t));
-    SDL_RenderCopy(renderer, texture, NULL, NULL);
-    SDL_RenderPresent(renderer);
+    if (pages) {
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+    }
 
     /* Return it back */
     oledInvertDebugLink();
+    PROFILE_END(refresh, ProfilePhaseOledRefresh, 0);
 }
 
 void emulatorPoll(void)
@@ -21,6 +21,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
@@ -33,6 +34,26 @@
 #include "tiny-firmware/timer.h"
 
 #define EMULATOR_FLASH_FILE "emulator.img"
+#define ENV_FLASH_MODE "SKYWALLET_FLASH_MODE"
+#define ENV_FLASH_FILE "SKYWALLET_FLASH_FILE"
+#define ENV_UUID "SKYWALLET_UUID"
+#define ENV_RNG_SEED "SKYWALLET_RNG_SEED"
+
+/* How the emulated flash is backed:
+ * sync      - the flash file is mapped and every write goes to disk (default)
+ * writeback - the flash lives in memory and the sectors written since the
+ *             flash was unlocked are copied to the file when it is locked
+ * memory    - the flash lives in memory and is never persisted, for tests
+ */
+typedef enum {
+    FlashModeSync,
+    FlashModeWriteBack,
+    FlashModeMemory,
+} FlashMode;
+
+static FlashMode flash_mode = FlashModeSync;
+/* Flash file of the writeback mode */
+static int flash_fd = -1;
 
 uint8_t* emulator_flash_base = NULL;
 
@@ -40,6 +61,10 @@ uint32_t __stack_chk_guard;
 
 static int urandom = -1;
 
+/* Deterministic random numbers for reproducible emulator runs, not secure */
+static bool rng_seeded;
+static uint64_t rng_state;
+
 static void setup_urandom(void);
 static void setup_flash(void);
 
@@ -55,8 +80,24 @@ void __attribute__((noreturn)) shutdown(void)
     exit(0);
 }
 
+static uint64_t splitmix64(void)
+{
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
 void emulatorRandom(void* buffer, size_t size)
 {
+    if (rng_seeded) {
+        uint8_t* bytes = buffer;
+        for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+            uint64_t word = splitmix64();
+            memcpy(bytes + i, &word, size - i < sizeof(word) ? size - i : sizeof(word));
+        }
+        return;
+    }
     ssize_t n = read(urandom, buffer, size);
     if (n < 0 || ((size_t)n) != size) {
         perror("Failed to read /dev/urandom");
@@ -64,8 +105,55 @@ void emulatorRandom(void* buffer, size_t size)
     }
 }
 
+void emulatorUuid(uint8_t* uuid, size_t size)
+{
+    const char* variable = getenv(ENV_UUID);
+    if (variable && strlen(variable) == 2 * size) {
+        size_t i = 0;
+        while (i < size && sscanf(variable + 2 * i, "%2hhx", &uuid[i]) == 1) {
+            i++;
+        }
+        if (i == size) {
+            return;
+        }
+        fprintf(stderr, "Ignoring invalid %s\n", ENV_UUID);
+    }
+    emulatorRandom(uuid, size);
+}
+
+/* Read a number from the environment variable name, fallback when it is
+ * not set.  The emulator stops when the value is not a number in [min, max].
+ */
+uint64_t emulatorEnvNumber(const char* name, uint64_t fallback, uint64_t min, uint64_t max)
+{
+    const char* variable = getenv(name);
+    if (!variable) {
+        return fallback;
+    }
+    char* end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(variable, &end, 0);
+    if (variable[0] < '0' || variable[0] > '9' || *end != '\0' || errno == ERANGE || value < min || value > max) {
+        fprintf(stderr, "Invalid %s %s, expected a number from %llu to %llu\n", name, variable,
+            (unsigned long long)min, (unsigned long long)max);
+        exit(1);
+    }
+    return value;
+}
+
+static const char* emulatorFlashFile(void)
+{
+    const char* variable = getenv(ENV_FLASH_FILE);
+    return (variable && variable[0]) ? variable : EMULATOR_FLASH_FILE;
+}
+
 static void setup_urandom(void)
 {
+    if (getenv(ENV_RNG_SEED)) {
+        rng_seeded = true;
+        rng_state = emulatorEnvNumber(ENV_RNG_SEED, 0, 0, UINT64_MAX);
+        return;
+    }
     urandom = open("/dev/urandom", O_RDONLY);
     if (urandom < 0) {
         perror("Failed to open /dev/urandom");
@@ -73,9 +161,96 @@ static void setup_urandom(void)
     }
 }
 
+static FlashMode emulatorFlashMode(void)
+{
+    const char* variable = getenv(ENV_FLASH_MODE);
+    if (!variable) {
+        return FlashModeSync;
+    }
+    if (strcmp(variable, "writeback") == 0) {
+        return FlashModeWriteBack;
+    }
+    if (strcmp(variable, "memory") == 0) {
+        return FlashModeMemory;
+    }
+    if (strcmp(variable, "sync") == 0) {
+        return FlashModeSync;
+    }
+    fprintf(stderr, "Invalid %s %s, expected sync, writeback or memory\n", ENV_FLASH_MODE, variable);
+    exit(1);
+}
+
+static void setup_flash_memory(void)
+{
+    if (emulator_flash_base != NULL) {
+        // keep the flash content when setup is run again, e.g. by tests
+        return;
+    }
+    emulator_flash_base = mmap(NULL, FLASH_TOTAL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (emulator_flash_base == MAP_FAILED) {
+        perror("Failed to allocate flash emulation memory");
+        exit(1);
+    }
+    flash_erase_all_sectors(FLASH_CR_PROGRAM_X32);
+    if (flash_mode != FlashModeWriteBack) {
+        return;
+    }
+
+    flash_fd = open(emulatorFlashFile(), O_RDWR | O_CREAT, 0644);
+    if (flash_fd < 0) {
+        perror("Failed to open flash emulation file");
+        exit(1);
+    }
+    size_t done = 0;
+    while (done < FLASH_TOTAL_SIZE) {
+        ssize_t n = pread(flash_fd, emulator_flash_base + done, FLASH_TOTAL_SIZE - done, done);
+        if (n < 0) {
+            perror("Failed to read flash emulation file");
+            exit(1);
+        }
+        if (n == 0) {
+            // short file, start from erased flash as in sync mode
+            flash_erase_all_sectors(FLASH_CR_PROGRAM_X32);
+            emulatorFlashSync(0, FLASH_TOTAL_SIZE);
+            break;
+        }
+        done += n;
+    }
+}
+
+/* Copy a changed range of the flash to the file of the writeback mode.
+ * Only the touched sectors are written, so a crash in the middle can tear
+ * one sector like a power loss on the device.
+ */
+void emulatorFlashSync(size_t offset, size_t size)
+{
+    if (flash_mode != FlashModeWriteBack) {
+        return;
+    }
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pwrite(flash_fd, emulator_flash_base + offset + done, size - done, offset + done);
+        if (n < 0) {
+            perror("Failed to write flash emulation file");
+            exit(1);
+        }
+        done += n;
+    }
+    if (fdatasync(flash_fd) != 0) {
+        perror("Failed to write flash emulation file");
+        exit(1);
+    }
+}
+
 static void setup_flash(void)
 {
-    int fd = open(EMULATOR_FLASH_FILE, O_RDWR | O_SYNC | O_CREAT, 0644);
+    flash_mode = emulatorFlashMode();
+    if (flash_mode != FlashModeSync) {
+        setup_flash_memory();
+        return;
+    }
+
+    int fd = open(emulatorFlashFile(), O_RDWR | O_SYNC | O_CREAT, 0644);
     if (fd < 0) {
         perror("Failed to open flash emulation file");
         exit(1);
@@ -18,16 +18,59 @@
  */
 #include "tiny-firmware/timer.h"
 
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
 #include "tiny-firmware/firmware/swtimer.h"
 
+#define ENV_VIRTUAL_TIME "SKYWALLET_VIRTUAL_TIME"
+
+/* A virtual clock only moves when the firmware sleeps, which then ends at
+ * once, and when a test or the debug link advances it. Timeouts do not
+ * depend on the speed of the host and take no time to expire.
+ */
+typedef enum {
+    ClockUnset,
+    ClockReal,
+    ClockVirtual,
+} Clock;
+
+static Clock clock_kind = ClockUnset;
+static uint32_t virtual_ms = 0;
+
 void timer_init(void)
 {
     timer_init_sw();
 }
 
+bool emulatorVirtualTime(void)
+{
+    if (clock_kind == ClockUnset) {
+        clock_kind = emulatorEnvNumber(ENV_VIRTUAL_TIME, 0, 0, 1) ? ClockVirtual : ClockReal;
+    }
+    return clock_kind == ClockVirtual;
+}
+
+void emulatorSetVirtualTime(bool enabled)
+{
+    clock_kind = enabled ? ClockVirtual : ClockReal;
+}
+
+void emulatorAdvanceTime(uint32_t ms)
+{
+    virtual_ms += ms;
+}
+
 uint32_t timer_ms(void)
+{
+    if (emulatorVirtualTime()) {
+        return virtual_ms;
+    }
+    return timer_real_ms();
+}
+
+uint32_t timer_real_ms(void)
 {
     struct timespec t;
     clock_gettime(CLOCK_MONOTONIC, &t);
@@ -35,3 +78,12 @@ uint32_t timer_ms(void)
     uint32_t msec = t.tv_sec * 1000 + (t.tv_nsec / 1000000);
     return msec;
 }
+
+/* Cycles of the device core clock, wrapping around like the DWT counter */
+uint32_t timer_cycles(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+
+    return (uint64_t)t.tv_sec * TIMER_CYCLES_PER_US * 1000000 + (uint64_t)t.tv_nsec * TIMER_CYCLES_PER_US / 1000;
+}
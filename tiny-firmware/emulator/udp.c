@@ -19,26 +19,136 @@
 
 #include <arpa/inet.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "tiny-firmware/emulator/client/emulator_trace.h"
 #include "tiny-firmware/firmware/messages.h"
 #include "tiny-firmware/timer.h"
 #include "tiny-firmware/usb.h"
 
 #define SKYWALLET_UDP_PORT 21324
+#define ENV_UDP_PORT "SKYWALLET_UDP_PORT"
+#define ENV_UNIX_SOCKET "SKYWALLET_UNIX_SOCKET"
+#define ENV_TRACE_FILE "SKYWALLET_TRACE_FILE"
+// Appended to the unix socket path of the main interface
+#define EMULATOR_DEBUG_SUFFIX ".debug"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#if !HEADLESS
+// SDL has no file descriptor to wait on, its events are polled this often
+#define EMULATOR_SDL_POLL_MS 16
+#endif
 
+/* UDP sockets answer the last sender. Unix sockets listen on listen_fd
+ * and fd is the connected host, if any.
+ */
 struct usb_socket {
     int fd;
+    int listen_fd;
     struct sockaddr_in from;
     socklen_t fromlen;
 };
 
-static struct usb_socket usb_main;
-static struct usb_socket usb_debug;
+static struct usb_socket usb_main = {.fd = -1, .listen_fd = -1};
+static struct usb_socket usb_debug = {.fd = -1, .listen_fd = -1};
+
+// Datagrams moved per system call
+#define EMULATOR_BATCH 32
+
+#if defined(__linux__) && defined(_GNU_SOURCE)
+#define EMULATOR_MMSG 1
+#else
+#define EMULATOR_MMSG 0
+#endif
+
+/* Frames received and not handled yet */
+static struct {
+    uint8_t frames[EMULATOR_BATCH][64];
+    size_t len[EMULATOR_BATCH];
+    int iface[EMULATOR_BATCH];
+    int count;
+    int next;
+} rx;
+
+/* Reports recorded to SKYWALLET_TRACE_FILE, see emulator_trace.h */
+static struct {
+    FILE* fp;
+    struct timespec last;
+    bool dirty;
+} trace;
+
+static void trace_open(void)
+{
+    const char* path = getenv(ENV_TRACE_FILE);
+    if (!path || !path[0]) {
+        return;
+    }
+    trace.fp = fopen(path, "wb");
+    if (!trace.fp) {
+        perror("Failed to open trace file");
+        exit(1);
+    }
+    uint8_t header[EMULATOR_TRACE_HEADER_SIZE] = {0};
+    memcpy(header, EMULATOR_TRACE_MAGIC, strlen(EMULATOR_TRACE_MAGIC));
+    header[strlen(EMULATOR_TRACE_MAGIC)] = EMULATOR_TRACE_VERSION;
+    fwrite(header, sizeof(header), 1, trace.fp);
+    clock_gettime(CLOCK_MONOTONIC, &trace.last);
+    trace.dirty = true;
+}
+
+static void trace_report(const struct usb_socket* sock, uint8_t flags, const uint8_t* report, size_t size)
+{
+    if (!trace.fp) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t delta = (int64_t)(now.tv_sec - trace.last.tv_sec) * 1000000 + (now.tv_nsec - trace.last.tv_nsec) / 1000;
+    uint32_t delta_us = delta < 0 ? 0 : delta > UINT32_MAX ? UINT32_MAX : (uint32_t)delta;
+    trace.last = now;
+
+    if (sock == &usb_debug) {
+        flags |= EMULATOR_TRACE_DEBUG;
+    }
+    // the last report of a message is padded with zeros
+    if (size > 64) {
+        size = 64;
+    }
+    while (size > 0 && report[size - 1] == 0) {
+        size--;
+    }
+    uint8_t record[EMULATOR_TRACE_RECORD_SIZE] = {
+        flags, size, delta_us & 0xFF, (delta_us >> 8) & 0xFF, (delta_us >> 16) & 0xFF, (delta_us >> 24) & 0xFF};
+    if (fwrite(record, sizeof(record), 1, trace.fp) != 1 || fwrite(report, 1, size, trace.fp) != size) {
+        perror("Failed to write trace file");
+        fclose(trace.fp);
+        trace.fp = NULL;
+        return;
+    }
+    trace.dirty = true;
+}
+
+/* Written once per main loop iteration, a killed emulator keeps its trace */
+static void trace_flush(void)
+{
+    if (trace.fp && trace.dirty) {
+        fflush(trace.fp);
+        trace.dirty = false;
+    }
+}
 
 static int socket_setup(int port)
 {
@@ -61,9 +171,66 @@ static int socket_setup(int port)
     return fd;
 }
 
+/* SOCK_SEQPACKET keeps the 64 bytes frames apart, just like UDP datagrams */
+static int socket_setup_unix(const char* path)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        exit(1);
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (fd < 0) {
+        perror("Failed to create socket");
+        exit(1);
+    }
+
+    // left behind by a previous run
+    unlink(path);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("Failed to bind socket");
+        exit(1);
+    }
+    if (listen(fd, 1) != 0 || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+        perror("Failed to listen on socket");
+        exit(1);
+    }
+
+    return fd;
+}
+
+/* A new host replaces the previous one, as the last UDP sender does */
+static void socket_accept(struct usb_socket* sock)
+{
+    int fd = accept(sock->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            perror("Failed to accept connection");
+        }
+        return;
+    }
+    if (sock->fd >= 0) {
+        close(sock->fd);
+    }
+    sock->fd = fd;
+}
+
 static size_t socket_write(struct usb_socket* sock, const void* buffer, size_t size)
 {
-    if (sock->fromlen > 0) {
+    if (sock->listen_fd >= 0) {
+        if (sock->fd < 0) {
+            return size;
+        }
+        ssize_t n = send(sock->fd, buffer, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 || ((size_t)n) != size) {
+            perror("Failed to write socket");
+            return 0;
+        }
+    } else if (sock->fromlen > 0) {
         ssize_t n = sendto(sock->fd, buffer, size, MSG_DONTWAIT, (const struct sockaddr*)&sock->from, sock->fromlen);
         if (n < 0 || ((size_t)n) != size) {
             perror("Failed to write socket");
@@ -74,60 +241,215 @@ static size_t socket_write(struct usb_socket* sock, const void* buffer, size_t s
     return size;
 }
 
-static size_t socket_read(struct usb_socket* sock, void* buffer, size_t size)
+/* Queue a received datagram unless it is a ping, frame may already be in rx */
+static void socket_received(struct usb_socket* sock, int iface, const uint8_t* frame, size_t n)
 {
-    sock->fromlen = sizeof(sock->from);
-    ssize_t n = recvfrom(sock->fd, buffer, size, MSG_DONTWAIT, (struct sockaddr*)&sock->from, &sock->fromlen);
+    static const char msg_ping[] = {'P', 'I', 'N', 'G', 'P', 'I', 'N', 'G'};
+    static const char msg_pong[] = {'P', 'O', 'N', 'G', 'P', 'O', 'N', 'G'};
 
+    if (n == sizeof(msg_ping) && memcmp(frame, msg_ping, sizeof(msg_ping)) == 0) {
+        socket_write(sock, msg_pong, sizeof(msg_pong));
+        return;
+    }
+
+    trace_report(sock, 0, frame, n);
+    memmove(rx.frames[rx.count], frame, n);
+    memset(rx.frames[rx.count] + n, 0, sizeof(rx.frames[0]) - n);
+    rx.len[rx.count] = n;
+    rx.iface[rx.count] = iface;
+    rx.count++;
+}
+
+/* Queue all the datagrams waiting on the socket, as long as there is room */
+static void socket_read(struct usb_socket* sock, int iface)
+{
+    if (sock->listen_fd >= 0) {
+        socket_accept(sock);
+    }
+    // Firmware code may poll for Cancel before sockets are set up, e.g. in tests
+    if (sock->fd < 0 || rx.count >= EMULATOR_BATCH) {
+        return;
+    }
+    if (sock->listen_fd >= 0) {
+        while (rx.count < EMULATOR_BATCH) {
+            ssize_t n = recv(sock->fd, rx.frames[rx.count], sizeof(rx.frames[0]), MSG_DONTWAIT);
+            if (n == 0) {
+                // the host hung up
+                close(sock->fd);
+                sock->fd = -1;
+                return;
+            }
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    perror("Failed to read socket");
+                }
+                return;
+            }
+            socket_received(sock, iface, rx.frames[rx.count], n);
+        }
+        return;
+    }
+#if EMULATOR_MMSG
+    int max = EMULATOR_BATCH - rx.count;
+    struct mmsghdr msgs[EMULATOR_BATCH];
+    struct iovec iov[EMULATOR_BATCH];
+    struct sockaddr_in from[EMULATOR_BATCH];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < max; i++) {
+        iov[i].iov_base = rx.frames[rx.count + i];
+        iov[i].iov_len = sizeof(rx.frames[0]);
+        msgs[i].msg_hdr.msg_name = &from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = recvmmsg(sock->fd, msgs, max, MSG_DONTWAIT, NULL);
     if (n < 0) {
         if (errno != EAGAIN && errno != EWOULDBLOCK) {
             perror("Failed to read socket");
         }
-        return 0;
+        return;
     }
+    for (int i = 0; i < n; i++) {
+        memcpy(&sock->from, &from[i], sizeof(sock->from));
+        sock->fromlen = msgs[i].msg_hdr.msg_namelen;
+        socket_received(sock, iface, iov[i].iov_base, msgs[i].msg_len);
+    }
+#else
+    while (rx.count < EMULATOR_BATCH) {
+        sock->fromlen = sizeof(sock->from);
+        ssize_t n = recvfrom(sock->fd, rx.frames[rx.count], sizeof(rx.frames[0]), MSG_DONTWAIT, (struct sockaddr*)&sock->from, &sock->fromlen);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Failed to read socket");
+            }
+            return;
+        }
+        socket_received(sock, iface, rx.frames[rx.count], n);
+    }
+#endif
+}
 
-    static const char msg_ping[] = {'P', 'I', 'N', 'G', 'P', 'I', 'N', 'G'};
-    static const char msg_pong[] = {'P', 'O', 'N', 'G', 'P', 'O', 'N', 'G'};
-
-    if (n == sizeof(msg_ping) && memcmp(buffer, msg_ping, sizeof(msg_ping)) == 0) {
-        socket_write(sock, msg_pong, sizeof(msg_pong));
-        return 0;
+/* Send all the pending output frames of out_data to the host */
+static void socket_flush(struct usb_socket* sock, const uint8_t* (*out_data)(void))
+{
+    const uint8_t* data;
+#if EMULATOR_MMSG
+    while (sock->listen_fd < 0) {
+        struct mmsghdr msgs[EMULATOR_BATCH];
+        struct iovec iov[EMULATOR_BATCH];
+        int n = 0;
+        memset(msgs, 0, sizeof(msgs));
+        while (n < EMULATOR_BATCH && (data = out_data()) != NULL) {
+            trace_report(sock, EMULATOR_TRACE_DEVICE, data, 64);
+            iov[n].iov_base = (void*)data;
+            iov[n].iov_len = 64;
+            msgs[n].msg_hdr.msg_name = &sock->from;
+            msgs[n].msg_hdr.msg_namelen = sock->fromlen;
+            msgs[n].msg_hdr.msg_iov = &iov[n];
+            msgs[n].msg_hdr.msg_iovlen = 1;
+            n++;
+        }
+        if (n == 0) {
+            return;
+        }
+        if (sock->fromlen > 0 && sendmmsg(sock->fd, msgs, n, MSG_DONTWAIT) != n) {
+            perror("Failed to write socket");
+        }
+    }
+#endif
+    while ((data = out_data()) != NULL) {
+        trace_report(sock, EMULATOR_TRACE_DEVICE, data, 64);
+        socket_write(sock, data, 64);
     }
+}
 
-    return n;
+/* Send the pending output of both interfaces */
+static void usb_flush(void)
+{
+    socket_flush(&usb_main, msg_out_data);
+#if DEBUG_LINK
+    socket_flush(&usb_debug, msg_debug_out_data);
+#endif
+}
+
+/* Main interface port, the debug link listens on the next one */
+static int emulatorUdpPort(void)
+{
+    return emulatorEnvNumber(ENV_UDP_PORT, SKYWALLET_UDP_PORT, 1, 65534);
 }
 
 void emulatorSocketInit(void)
 {
-    usb_main.fd = socket_setup(SKYWALLET_UDP_PORT);
+    trace_open();
+
+    const char* path = getenv(ENV_UNIX_SOCKET);
+    if (path && path[0]) {
+        char debug_path[sizeof(((struct sockaddr_un*)NULL)->sun_path) + sizeof(EMULATOR_DEBUG_SUFFIX)];
+        snprintf(debug_path, sizeof(debug_path), "%s" EMULATOR_DEBUG_SUFFIX, path);
+        usb_main.listen_fd = socket_setup_unix(path);
+        usb_debug.listen_fd = socket_setup_unix(debug_path);
+        return;
+    }
+
+    int port = emulatorUdpPort();
+    usb_main.fd = socket_setup(port);
     usb_main.fromlen = 0;
-    usb_debug.fd = socket_setup(SKYWALLET_UDP_PORT + 1);
+    usb_debug.fd = socket_setup(port + 1);
     usb_debug.fromlen = 0;
 }
 
 size_t emulatorSocketRead(int* iface, void* buffer, size_t size)
 {
-    size_t n = socket_read(&usb_main, buffer, size);
-    if (n > 0) {
-        *iface = 0;
-        return n;
+    if (rx.next == rx.count) {
+        rx.next = rx.count = 0;
+        socket_read(&usb_main, 0);
+        socket_read(&usb_debug, 1);
     }
-
-    n = socket_read(&usb_debug, buffer, size);
-    if (n > 0) {
-        *iface = 1;
-        return n;
+    if (rx.next == rx.count) {
+        return 0;
     }
 
-    return 0;
+    size_t n = rx.len[rx.next] < size ? rx.len[rx.next] : size;
+    memcpy(buffer, rx.frames[rx.next], n);
+    *iface = rx.iface[rx.next];
+    rx.next++;
+    return n;
+}
+
+void emulatorWait(uint32_t timeout_ms)
+{
+#if !HEADLESS
+    if (timeout_ms > EMULATOR_SDL_POLL_MS) {
+        timeout_ms = EMULATOR_SDL_POLL_MS;
+    }
+#endif
+    // frames may still be queued, e.g. after a simulated button press
+    if (timeout_ms == 0 || (usb_main.fd < 0 && usb_main.listen_fd < 0) || rx.next < rx.count) {
+        return;
+    }
+    // poll skips negative descriptors, e.g. UDP has no listening socket
+    struct pollfd fds[] = {
+        {.fd = usb_main.fd, .events = POLLIN},
+        {.fd = usb_debug.fd, .events = POLLIN},
+        {.fd = usb_main.listen_fd, .events = POLLIN},
+        {.fd = usb_debug.listen_fd, .events = POLLIN},
+    };
+    int timeout = timeout_ms > INT_MAX ? INT_MAX : (int)timeout_ms;
+    // poll rather than ppoll, which is not available on macOS
+    if (poll(fds, sizeof(fds) / sizeof(fds[0]), timeout) < 0 && errno != EINTR) {
+        perror("Failed to poll sockets");
+    }
 }
 
 size_t emulatorSocketWrite(int iface, const void* buffer, size_t size)
 {
     if (iface == 0) {
+        trace_report(&usb_main, EMULATOR_TRACE_DEVICE, buffer, size);
         return socket_write(&usb_main, buffer, size);
     }
     if (iface == 1) {
+        trace_report(&usb_debug, EMULATOR_TRACE_DEVICE, buffer, size);
         return socket_write(&usb_debug, buffer, size);
     }
     return 0;
@@ -157,7 +479,13 @@ void usbPoll(void)
 
     int iface = 0, i, j = 0;
 
-    if (emulatorSocketRead(&iface, buffer, sizeof(buffer)) > 0) {
+    if (!tiny) {
+        msg_read_deferred();
+    }
+    // handle every frame received, requests spanning many frames
+    // then take a single main loop iteration, the receive calls are batched
+    while (emulatorSocketRead(&iface, buffer, sizeof(buffer)) > 0) {
+        j = 0;
         for (i = 0; i < 5; i++) {
             if (buffer[i] == i) {
                 j++;
@@ -175,14 +503,20 @@ void usbPoll(void)
                 msg_read_common(_ISDBG, buffer, sizeof(buffer));
             } else {
                 msg_read_tiny(buffer, sizeof(buffer));
+                // the rest of a deferred request stays in the socket
+                if (msg_tiny_deferred()) {
+                    break;
+                }
             }
+            // send the answer of a completed request before handling the
+            // next one, msg_out would overflow with many answers queued
+            usb_flush();
         }
     }
 
-    const uint8_t* data = msg_out_data();
-    if (data != NULL) {
-        emulatorSocketWrite(0, data, 64);
-    }
+    // send every pending frame, the main loop may go to sleep after this
+    usb_flush();
+    trace_flush();
 }
 
 char usbTiny(char set)
@@ -198,5 +532,9 @@ void usbSleep(uint32_t millis)
 
     while ((timer_ms() - start) < millis) {
         usbPoll();
+        // a virtual clock goes to the end of the sleep once pending input is handled
+        if (emulatorVirtualTime()) {
+            emulatorAdvanceTime(millis - (timer_ms() - start));
+        }
     }
 }
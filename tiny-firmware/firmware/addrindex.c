@@ -0,0 +1,114 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "tiny-firmware/firmware/addrindex.h"
+
+#include <string.h>
+
+#include "skycoin-crypto/tools/base58.h"
+#include "skycoin-crypto/tools/memzero.h"
+#include "skycoin-crypto/tools/sha2.h"
+#include "tiny-firmware/firmware/storage.h"
+
+_Static_assert((ADDRINDEX_SIZE & (ADDRINDEX_SIZE - 1)) == 0, "address index size must be a power of two");
+
+/* Open addressing table with linear probing. Address hashes are uniformly
+ * distributed so their first bytes are used as the slot number.
+ */
+static struct {
+    uint32_t count;
+    struct {
+        bool used;
+        uint8_t hash[ADDRESS_CACHE_HASH_LEN];
+        AddressPath path;
+    } slots[ADDRINDEX_SIZE];
+} addrIndex;
+
+static uint32_t addrindex_slot(const uint8_t* hash)
+{
+    return ((uint32_t)hash[0] | ((uint32_t)hash[1] << 8)) & (ADDRINDEX_SIZE - 1);
+}
+
+bool addrindex_addressHash(const char* address, uint8_t* hash)
+{
+    uint8_t bin[ADDRESS_CACHE_HASH_LEN + 1 + 4];
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    size_t len = sizeof(bin);
+    if (!b58tobin(bin, &len, address) || len != sizeof(bin) || bin[ADDRESS_CACHE_HASH_LEN] != 0) {
+        return false;
+    }
+    sha256_Raw(bin, ADDRESS_CACHE_HASH_LEN + 1, digest);
+    if (memcmp(digest, bin + ADDRESS_CACHE_HASH_LEN + 1, 4) != 0) {
+        return false;
+    }
+    memcpy(hash, bin, ADDRESS_CACHE_HASH_LEN);
+    return true;
+}
+
+void addrindex_clear(void)
+{
+    memzero(&addrIndex, sizeof(addrIndex));
+}
+
+void addrindex_add(const uint8_t* hash, const AddressPath* path)
+{
+    uint32_t slot = addrindex_slot(hash);
+    while (addrIndex.slots[slot].used) {
+        if (memcmp(addrIndex.slots[slot].hash, hash, ADDRESS_CACHE_HASH_LEN) == 0) {
+            return;
+        }
+        slot = (slot + 1) & (ADDRINDEX_SIZE - 1);
+    }
+    if (addrIndex.count >= ADDRINDEX_MAX_ENTRIES) {
+        return;
+    }
+    addrIndex.slots[slot].used = true;
+    memcpy(addrIndex.slots[slot].hash, hash, ADDRESS_CACHE_HASH_LEN);
+    addrIndex.slots[slot].path = *path;
+    addrIndex.count++;
+}
+
+void addrindex_addAddress(const char* address, const AddressPath* path)
+{
+    uint8_t hash[ADDRESS_CACHE_HASH_LEN];
+    if (addrindex_addressHash(address, hash)) {
+        addrindex_add(hash, path);
+    }
+}
+
+bool addrindex_find(const uint8_t* hash, AddressPath* path)
+{
+    uint32_t slot = addrindex_slot(hash);
+    while (addrIndex.slots[slot].used) {
+        if (memcmp(addrIndex.slots[slot].hash, hash, ADDRESS_CACHE_HASH_LEN) == 0) {
+            *path = addrIndex.slots[slot].path;
+            return true;
+        }
+        slot = (slot + 1) & (ADDRINDEX_SIZE - 1);
+    }
+    return false;
+}
+
+bool addrindex_findAddress(const char* address, AddressPath* path)
+{
+    uint8_t hash[ADDRESS_CACHE_HASH_LEN];
+    return addrindex_addressHash(address, hash) && addrindex_find(hash, path);
+}
+
+bool addrindex_samePath(const AddressPath* path, const AddressPath* expected)
+{
+    if (path->bip44 != expected->bip44 || path->index != expected->index) {
+        return false;
+    }
+    return !path->bip44 || (path->coin_type == expected->coin_type &&
+                               path->account == expected->account &&
+                               path->change == expected->change);
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#ifndef __TINYFIRMWARE_FIRMWARE_ADDRINDEX__
+#define __TINYFIRMWARE_FIRMWARE_ADDRINDEX__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Slots of the session address index, must be a power of two
+#define ADDRINDEX_SIZE 128
+// Inserts stop at this load so that lookups stay short
+#define ADDRINDEX_MAX_ENTRIES (ADDRINDEX_SIZE * 3 / 4)
+
+/**
+ * @brief Derivation path of an address of this wallet.
+ * coin_type, account and change are only meaningful for BIP44 addresses
+ */
+typedef struct {
+    bool bip44;
+    uint32_t coin_type;
+    uint32_t account;
+    uint32_t change;
+    uint32_t index;
+} AddressPath;
+
+/**
+ * @brief Decode the hash of a base58 address, checking its version and checksum
+ * @param hash 20 bytes buffer for the address hash
+ */
+bool addrindex_addressHash(const char* address, uint8_t* hash);
+
+/**
+ * @brief Forget all the addresses, must be called whenever the full seed changes
+ */
+void addrindex_clear(void);
+
+/**
+ * @brief Record the path of a derived address
+ * @param hash 20 bytes address hash
+ */
+void addrindex_add(const uint8_t* hash, const AddressPath* path);
+
+/**
+ * @brief Record the path of a derived base58 address
+ */
+void addrindex_addAddress(const char* address, const AddressPath* path);
+
+/**
+ * @brief Look up the path of an address hash
+ * @return true if the address was derived in this session
+ */
+bool addrindex_find(const uint8_t* hash, AddressPath* path);
+
+/**
+ * @brief Look up the path of a base58 address
+ * @return true if the address was derived in this session
+ */
+bool addrindex_findAddress(const char* address, AddressPath* path);
+
+/**
+ * @brief Whether path points to the same address as expected
+ */
+bool addrindex_samePath(const AddressPath* path, const AddressPath* expected);
+
+#endif // __TINYFIRMWARE_FIRMWARE_ADDRINDEX__
@@ -0,0 +1,92 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "tiny-firmware/firmware/arena.h"
+
+#include <stdint.h>
+
+#include "skycoin-crypto/tools/memzero.h"
+
+_Static_assert(ARENA_SIZE % ARENA_ALIGN == 0, "arena size must be a multiple of its alignment");
+
+static CONFIDENTIAL uint8_t arenaBuffer[ARENA_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+
+/* Allocated: [0, arenaBottom) and [arenaTop, ARENA_SIZE), everything between is zero */
+static size_t arenaBottom = 0;
+static size_t arenaTop = ARENA_SIZE;
+static size_t arenaPeak = 0;
+
+static size_t arena_round(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static void arena_used(void)
+{
+    size_t used = arenaBottom + (ARENA_SIZE - arenaTop);
+    if (used > arenaPeak) {
+        arenaPeak = used;
+    }
+}
+
+void* arena_alloc(size_t size)
+{
+    size = arena_round(size);
+    if (size > arenaTop - arenaBottom) {
+        return NULL;
+    }
+    void* ptr = arenaBuffer + arenaBottom;
+    arenaBottom += size;
+    arena_used();
+    return ptr;
+}
+
+void* arena_alloc_top(size_t size)
+{
+    size = arena_round(size);
+    if (size > arenaTop - arenaBottom) {
+        return NULL;
+    }
+    arenaTop -= size;
+    arena_used();
+    return arenaBuffer + arenaTop;
+}
+
+void arena_release_top(void)
+{
+    memzero(arenaBuffer + arenaTop, ARENA_SIZE - arenaTop);
+    arenaTop = ARENA_SIZE;
+}
+
+size_t arena_mark(void)
+{
+    return arenaBottom;
+}
+
+void arena_release(size_t mark)
+{
+    if (mark >= arenaBottom) {
+        return;
+    }
+    memzero(arenaBuffer + mark, arenaBottom - mark);
+    arenaBottom = mark;
+}
+
+void arena_reset(void)
+{
+    arena_release(0);
+    arena_release_top();
+}
+
+size_t arena_peak(void)
+{
+    return arenaPeak;
+}
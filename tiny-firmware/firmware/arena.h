@@ -0,0 +1,69 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#ifndef __TINYFIRMWARE_FIRMWARE_ARENA__
+#define __TINYFIRMWARE_FIRMWARE_ARENA__
+
+#include <stddef.h>
+
+#include "tiny-firmware/firmware/messages.h"
+
+// Decoded message, raw message and the bytes its last report may write past its end
+#define ARENA_SIZE (2 * MSG_IN_SIZE + 64)
+// Alignment of every allocation
+#define ARENA_ALIGN 8
+
+/*
+ * Scratch memory of the message being processed, in the confidential
+ * section. Allocations are taken from the bottom up, except the raw message
+ * which is taken from the top down and released once decoded so that
+ * handlers can use its room. Released memory is wiped, allocations are
+ * always zeroed.
+ */
+
+/**
+ * @brief Allocate zeroed memory from the bottom of the arena
+ * @return NULL when the arena is exhausted
+ */
+void* arena_alloc(size_t size);
+
+/**
+ * @brief Allocate zeroed memory from the top of the arena
+ * @return NULL when the arena is exhausted
+ */
+void* arena_alloc_top(size_t size);
+
+/**
+ * @brief Wipe and free every allocation from the top
+ */
+void arena_release_top(void);
+
+/**
+ * @brief Current bottom of the arena, to be given back to arena_release
+ */
+size_t arena_mark(void);
+
+/**
+ * @brief Wipe and free the allocations from the bottom made since mark
+ */
+void arena_release(size_t mark);
+
+/**
+ * @brief Wipe and free every allocation, called when a message completes
+ */
+void arena_reset(void);
+
+/**
+ * @brief Most bytes allocated at once since boot
+ */
+size_t arena_peak(void);
+
+#endif // __TINYFIRMWARE_FIRMWARE_ARENA__
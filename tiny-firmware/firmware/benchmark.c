@@ -0,0 +1,138 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "tiny-firmware/firmware/benchmark.h"
+#include "tiny-firmware/firmware/profile.h"
+
+#if PROFILE
+
+#include <libopencm3/stm32/flash.h>
+#include <string.h>
+
+#include "skycoin-crypto/skycoin_crypto.h"
+#include "skycoin-crypto/skycoin_signature.h"
+#include "skycoin-crypto/tools/memzero.h"
+#include "skycoin-crypto/tools/pbkdf2.h"
+#include "skycoin-crypto/tools/sha2.h"
+#include "tiny-firmware/firmware/skywallet.h"
+#include "tiny-firmware/firmware/stackmon.h"
+#include "tiny-firmware/memory.h"
+#include "tiny-firmware/supervise.h"
+#include "tiny-firmware/timer.h"
+
+#define BENCHMARK_MNEMONIC "cloud flower upset remain green metal below cup stem infant art thank"
+
+/* Inputs and outputs of every primitive, set up before the timed loop */
+static struct {
+    uint8_t seed[32];
+    uint8_t seckey[32];
+    uint8_t pubkey[33];
+    uint8_t digest[32];
+    uint8_t sig[65];
+    uint32_t sha256_state[8];
+    uint32_t sha256_block[16];
+    PBKDF2_HMAC_SHA512_CTX pbkdf2;
+} bench;
+
+static bool benchmark_setup(BenchmarkPrimitive primitive)
+{
+    uint8_t next_seed[32];
+    memzero(&bench, sizeof(bench));
+    sha256_Raw((const uint8_t*)BENCHMARK_MNEMONIC, strlen(BENCHMARK_MNEMONIC), bench.seed);
+    switch (primitive) {
+    case BenchmarkChainStep:
+        return true;
+    case BenchmarkSign:
+    case BenchmarkRecover:
+        sha256_Raw(bench.seed, sizeof(bench.seed), bench.digest);
+        return deterministic_key_pair_iterator(bench.seed, sizeof(bench.seed), next_seed, bench.seckey, bench.pubkey) == 0 &&
+               skycoin_ecdsa_sign_digest(bench.seckey, bench.digest, bench.sig) == 0;
+    case BenchmarkPbkdf2Slice:
+        pbkdf2_hmac_sha512_Init(&bench.pbkdf2, (const uint8_t*)BENCHMARK_MNEMONIC, strlen(BENCHMARK_MNEMONIC),
+            (const uint8_t*)"mnemonic", strlen("mnemonic"), 1);
+        return true;
+    case BenchmarkSha256Block:
+        memcpy(bench.sha256_block, BENCHMARK_MNEMONIC, sizeof(bench.sha256_block));
+        return true;
+    case BenchmarkFlashProgramWord:
+        svc_flash_unlock();
+        svc_flash_program(FLASH_CR_PROGRAM_X32);
+        return true;
+    }
+    return false;
+}
+
+static void benchmark_step(BenchmarkPrimitive primitive, uint32_t iteration)
+{
+    uint8_t next_seed[32];
+    uint8_t sig[65];
+    uint8_t pubkey[33];
+    switch (primitive) {
+    case BenchmarkChainStep:
+        deterministic_key_pair_iterator(bench.seed, sizeof(bench.seed), next_seed, bench.seckey, bench.pubkey);
+        memcpy(bench.seed, next_seed, sizeof(bench.seed));
+        break;
+    case BenchmarkSign:
+        bench.digest[0] = iteration;
+        skycoin_ecdsa_sign_digest(bench.seckey, bench.digest, sig);
+        break;
+    case BenchmarkRecover:
+        skycoin_ecdsa_verify_digest_recover(bench.sig, bench.digest, pubkey);
+        break;
+    case BenchmarkPbkdf2Slice:
+        pbkdf2_hmac_sha512_Update(&bench.pbkdf2, BIP39_SEED_IDLE_ROUNDS);
+        break;
+    case BenchmarkSha256Block:
+        sha256_Transform(bench.sha256_state, bench.sha256_block, bench.sha256_state);
+        break;
+    case BenchmarkFlashProgramWord:
+        // programming the current value only clears bits that are already clear
+        flash_write32(FLASH_META_MAGIC, *(const uint32_t*)FLASH_PTR(FLASH_META_MAGIC));
+        break;
+    }
+}
+
+ErrCode_t benchmark_run(BenchmarkPrimitive primitive, uint32_t iterations, BenchmarkResult* result)
+{
+    if (iterations == 0 || iterations > BENCHMARK_MAX_ITERATIONS || primitive > BenchmarkFlashProgramWord) {
+        return ErrInvalidArg;
+    }
+    if (!benchmark_setup(primitive)) {
+        return ErrFailed;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->min_cycles = UINT32_MAX;
+    stackmon_paint(BENCHMARK_STACK_PROBE);
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t start = timer_cycles();
+        benchmark_step(primitive, i);
+        uint32_t cycles = timer_cycles() - start;
+        result->total_cycles += cycles;
+        if (cycles < result->min_cycles) {
+            result->min_cycles = cycles;
+        }
+        if (cycles > result->max_cycles) {
+            result->max_cycles = cycles;
+        }
+    }
+    result->stack_used = stackmon_used();
+    result->iterations = iterations;
+
+    memzero(&bench, sizeof(bench));
+    if (primitive == BenchmarkFlashProgramWord &&
+        (svc_flash_lock() & (FLASH_SR_PGAERR | FLASH_SR_PGPERR | FLASH_SR_PGSERR | FLASH_SR_WRPERR))) {
+        return ErrFailed;
+    }
+    return ErrOk;
+}
+
+#endif // PROFILE
@@ -0,0 +1,58 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#ifndef __TINYFIRMWARE_FIRMWARE_BENCHMARK__
+#define __TINYFIRMWARE_FIRMWARE_BENCHMARK__
+
+#include <stdint.h>
+
+#include "tiny-firmware/firmware/error.h"
+#include "tiny-firmware/firmware/profile.h"
+
+// Longest run accepted, the device does nothing else meanwhile
+#define BENCHMARK_MAX_ITERATIONS 10000
+// Stack painted below the benchmark to find its high-water mark
+#define BENCHMARK_STACK_PROBE (16 * 1024)
+
+/**
+ * @brief Primitive timed by benchmark_run
+ */
+typedef enum {
+    BenchmarkChainStep = 0,        /*!< deterministic_key_pair_iterator on the previous seed */
+    BenchmarkSign = 1,             /*!< skycoin_ecdsa_sign_digest */
+    BenchmarkRecover = 2,          /*!< skycoin_ecdsa_verify_digest_recover */
+    BenchmarkPbkdf2Slice = 3,      /*!< BIP39_SEED_IDLE_ROUNDS rounds of the BIP39 seed PBKDF2 */
+    BenchmarkSha256Block = 4,      /*!< sha256_Transform of a 64 bytes block */
+    BenchmarkFlashProgramWord = 5, /*!< flash_write32 of a word with its current value */
+} BenchmarkPrimitive;
+
+/**
+ * @brief Cycles measured by benchmark_run, in timer_cycles() units
+ */
+typedef struct {
+    uint32_t iterations;
+    uint64_t total_cycles;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint32_t stack_used; /*!< Deepest stack use below benchmark_run, in bytes */
+} BenchmarkResult;
+
+#if PROFILE
+
+/**
+ * @brief Run a primitive iterations times on fixed test inputs
+ * @return ErrInvalidArg for an unknown primitive or a count out of 1..BENCHMARK_MAX_ITERATIONS
+ */
+ErrCode_t benchmark_run(BenchmarkPrimitive primitive, uint32_t iterations, BenchmarkResult* result);
+
+#endif // PROFILE
+
+#endif // __TINYFIRMWARE_FIRMWARE_BENCHMARK__
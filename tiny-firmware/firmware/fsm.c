@@ -28,6 +28,7 @@
 #include "skycoin-crypto/tools/base58.h"
 #include "skycoin-crypto/tools/bip32.h"
 #include "skycoin-crypto/tools/bip39.h"
+#include "tiny-firmware/firmware/benchmark.h"
 #include "tiny-firmware/firmware/droplet.h"
 #include "tiny-firmware/firmware/entropy.h"
 #include "tiny-firmware/firmware/fsm.h"
@@ -35,15 +36,18 @@
 #include "tiny-firmware/firmware/gettext.h"
 #include "tiny-firmware/firmware/layout2.h"
 #include "tiny-firmware/firmware/messages.h"
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/firmware/protect.h"
 #include "tiny-firmware/firmware/recovery.h"
 #include "tiny-firmware/firmware/reset.h"
 #include "tiny-firmware/firmware/skyparams.h"
 #include "tiny-firmware/firmware/skywallet.h"
+#include "tiny-firmware/firmware/stackmon.h"
 #include "tiny-firmware/firmware/storage.h"
 #include "tiny-firmware/memory.h"
 #include "tiny-firmware/oled.h"
 #include "tiny-firmware/rng.h"
+#include "tiny-firmware/timer.h"
 #include "tiny-firmware/usb.h"
 #include "tiny-firmware/util.h"
 
@@ -246,6 +250,7 @@ void fsm_sendFailure(FailureType code, const char* text, MessageType* msgtype)
 void fsm_msgInitialize(Initialize* msg)
 {
     recovery_abort();
+    TxSignCtx_DestroyAll();
     if (msg && msg->has_state && msg->state.size == 64) {
         uint8_t i_state[64];
         if (!session_getState(msg->state.bytes, i_state, NULL)) {
@@ -334,6 +339,19 @@ ErrCode_t requestConfirmTransaction(char* strCoin, char* strHour, TransactionSig
     return err;
 }
 
+ErrCode_t requestConfirmBatchDestination(char* strCoin, char* strHour, char* address)
+{
+    layoutDialogSwipe(&bmp_icon_question, _("Cancel"), _("Next"), NULL, _("The batch will"), strCoin, strHour,
+        _("in total to address"), _("..."), NULL);
+    ErrCode_t err = checkButtonProtectRetErrCode();
+    if (err != ErrOk) {
+        return err;
+    }
+    layoutAddress(address);
+    err = checkButtonProtectRetErrCode();
+    return err;
+}
+
 void fsm_msgPing(Ping* msg)
 {
     MessageType msgtype = MessageType_MessageType_Ping;
@@ -610,8 +628,7 @@ void fsm_msgWordAck(WordAck* msg)
 void fsm_msgCancel(Cancel* msg)
 {
     MessageType msgtype = MessageType_MessageType_Cancel;
-    (void)msg;
-    recovery_abort();
+    msgCancelImpl(msg);
     fsm_sendFailure(FailureType_Failure_ActionCancelled, NULL, &msgtype);
 }
 
@@ -665,6 +682,9 @@ void fsm_msgTxAck(TxAck* msg)
     case ErrOk:
         msg_write(MessageType_MessageType_TxRequest, resp);
         break;
+    case ErrUnexpectedMessage:
+        fsm_sendFailure(FailureType_Failure_UnexpectedMessage, _("No transaction is being signed"), &msgType);
+        break;
     case ErrInvalidArg:
         fsm_sendFailure(FailureType_Failure_DataError, _("Invalid data on TxAck message."), &msgType);
         break;
@@ -681,3 +701,107 @@ void fsm_msgTxAck(TxAck* msg)
     layoutHome();
     return;
 }
+
+#if DEBUG_LINK && PROFILE && defined(DebugLinkProfile_init_default)
+
+void fsm_msgDebugLinkGetProfile(DebugLinkGetProfile* msg)
+{
+    (void)msg;
+    RESP_INIT(DebugLinkProfile);
+    ProfileRecord records[sizeof(resp->records) / sizeof(resp->records[0])];
+    uint32_t dropped = 0;
+    size_t count = profile_read(records, sizeof(records) / sizeof(records[0]), &dropped);
+    for (size_t i = 0; i < count; i++) {
+        resp->records[i].phase = records[i].phase;
+        resp->records[i].id = records[i].id;
+        resp->records[i].start = records[i].start;
+        resp->records[i].cycles = records[i].cycles;
+    }
+    resp->records_count = count;
+    resp->has_cycles_per_us = true;
+    resp->cycles_per_us = TIMER_CYCLES_PER_US;
+    resp->has_dropped = true;
+    resp->dropped = dropped;
+    msg_debug_write(MessageType_MessageType_DebugLinkProfile, resp);
+}
+
+#endif
+
+#if DEBUG_LINK && PROFILE && defined(DebugLinkBenchmark_init_default)
+
+/* Failure answering a debug link request, sent on the debug link */
+static void fsm_sendDebugFailure(FailureType code, const char* text, MessageType* msgtype)
+{
+    RESP_INIT(Failure);
+    resp->has_code = true;
+    resp->code = code;
+    resp->has_msg_type = true;
+    resp->msg_type = *msgtype;
+    resp->has_message = true;
+    strlcpy(resp->message, text, sizeof(resp->message));
+    msg_debug_write(MessageType_MessageType_Failure, resp);
+}
+
+void fsm_msgDebugLinkBenchmark(DebugLinkBenchmark* msg)
+{
+    MessageType msgtype = MessageType_MessageType_DebugLinkBenchmark;
+    BenchmarkResult result;
+    ErrCode_t err = benchmark_run((BenchmarkPrimitive)msg->primitive, msg->has_iterations ? msg->iterations : 1, &result);
+    if (err != ErrOk) {
+        fsm_sendDebugFailure(err == ErrInvalidArg ? FailureType_Failure_DataError : FailureType_Failure_ProcessError,
+            _("Benchmark failed"), &msgtype);
+        return;
+    }
+    RESP_INIT(DebugLinkBenchmarkResult);
+    resp->has_iterations = true;
+    resp->iterations = result.iterations;
+    resp->has_total_cycles = true;
+    resp->total_cycles = result.total_cycles;
+    resp->has_min_cycles = true;
+    resp->min_cycles = result.min_cycles;
+    resp->has_max_cycles = true;
+    resp->max_cycles = result.max_cycles;
+    resp->has_stack_used = true;
+    resp->stack_used = result.stack_used;
+    resp->has_cycles_per_us = true;
+    resp->cycles_per_us = TIMER_CYCLES_PER_US;
+    msg_debug_write(MessageType_MessageType_DebugLinkBenchmarkResult, resp);
+}
+
+#endif
+
+#if EMULATOR && DEBUG_LINK && defined(DebugLinkAdvanceTime_init_default)
+
+void fsm_msgDebugLinkAdvanceTime(DebugLinkAdvanceTime* msg)
+{
+    // the real clock of the host cannot be moved
+    if (emulatorVirtualTime()) {
+        emulatorAdvanceTime(msg->ms);
+    }
+    RESP_INIT(DebugLinkTime);
+    resp->has_now_ms = true;
+    resp->now_ms = timer_ms();
+    resp->has_virtual_time = true;
+    resp->virtual_time = emulatorVirtualTime();
+    msg_debug_write(MessageType_MessageType_DebugLinkTime, resp);
+}
+
+#endif
+
+#if DEBUG_LINK && PROFILE && defined(DebugLinkStackUsage_init_default)
+
+void fsm_msgDebugLinkGetStackUsage(DebugLinkGetStackUsage* msg)
+{
+    RESP_INIT(DebugLinkStackUsage);
+    resp->has_peak = true;
+    resp->peak = stackmon_peak();
+    resp->has_size = true;
+    resp->size = stackmon_size();
+    // the next request measures only what runs after this one, unless
+    // the mark could not be reported
+    if (msg_debug_write(MessageType_MessageType_DebugLinkStackUsage, resp) && msg->has_reset && msg->reset) {
+        stackmon_reset();
+    }
+}
+
+#endif
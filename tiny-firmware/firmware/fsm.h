@@ -22,6 +22,7 @@
 #define __FSM_H__
 
 #include "tiny-firmware/firmware/error.h"
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/protob/c/messages.pb.h"
 
 // message functions
@@ -52,6 +53,19 @@ void fsm_msgRecoveryDevice(RecoveryDevice* msg);
 void fsm_msgWordAck(WordAck* msg);
 void fsm_msgSignTx(SignTx* msg);
 void fsm_msgTxAck(TxAck* msg);
+#if DEBUG_LINK && PROFILE && defined(DebugLinkProfile_init_default)
+void fsm_msgDebugLinkGetProfile(DebugLinkGetProfile* msg);
+#endif
+#if DEBUG_LINK && PROFILE && defined(DebugLinkBenchmark_init_default)
+void fsm_msgDebugLinkBenchmark(DebugLinkBenchmark* msg);
+#endif
+#if EMULATOR && DEBUG_LINK && defined(DebugLinkAdvanceTime_init_default)
+void fsm_msgDebugLinkAdvanceTime(DebugLinkAdvanceTime* msg);
+#endif
+#if DEBUG_LINK && PROFILE && defined(DebugLinkStackUsage_init_default)
+void fsm_msgDebugLinkGetStackUsage(DebugLinkGetStackUsage* msg);
+#endif
 ErrCode_t requestConfirmTransaction(char* strCoin, char* strHour, TransactionSign* msg, uint32_t i);
+ErrCode_t requestConfirmBatchDestination(char* strCoin, char* strHour, char* address);
 
 #endif
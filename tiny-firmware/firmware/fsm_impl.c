@@ -23,6 +23,8 @@
 #include "skycoin-crypto/tools/base58.h"
 #include "skycoin-crypto/tools/bip32.h"
 #include "skycoin-crypto/tools/bip39.h"
+#include "skycoin-crypto/tools/memzero.h"
+#include "tiny-firmware/firmware/addrindex.h"
 #include "tiny-firmware/firmware/droplet.h"
 #include "tiny-firmware/firmware/entropy.h"
 #include "tiny-firmware/firmware/fsm.h"
@@ -30,6 +32,7 @@
 #include "tiny-firmware/firmware/gettext.h"
 #include "tiny-firmware/firmware/layout2.h"
 #include "tiny-firmware/firmware/messages.h"
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/firmware/protect.h"
 #include "tiny-firmware/firmware/recovery.h"
 #include "tiny-firmware/firmware/reset.h"
@@ -38,6 +41,7 @@
 #include "tiny-firmware/memory.h"
 #include "tiny-firmware/oled.h"
 #include "tiny-firmware/rng.h"
+#include "tiny-firmware/timer.h"
 #include "tiny-firmware/usb.h"
 #include "tiny-firmware/util.h"
 
@@ -219,10 +223,7 @@ ErrCode_t msgGenerateMnemonicImpl(GenerateMnemonic* msg, void (*random_buffer_fu
         return ErrInvalidChecksum;
     }
     storage_setMnemonic(mnemonic);
-    TxSignContext* ctx = TxSignCtx_Get();
-    if (ctx != NULL) {
-        ctx->mnemonic_change = true;
-    }
+    TxSignCtx_SetMnemonicChange();
     storage_setNeedsBackup(true);
     storage_setPassphraseProtection(
         msg->has_passphrase_protection && msg->passphrase_protection);
@@ -239,7 +240,9 @@ ErrCode_t msgSignTransactionMessageImpl(uint8_t* message_digest, uint32_t index,
     if (res != ErrOk) {
         return res;
     }
+    PROFILE_BEGIN(sign);
     int signres = skycoin_ecdsa_sign_digest(seckey, message_digest, signature);
+    PROFILE_END(sign, ProfilePhaseSign, 0);
     if (signres == -2) {
         // Fail due to empty digest
         return ErrInvalidArg;
@@ -255,14 +258,23 @@ ErrCode_t msgSignTransactionMessageImpl(uint8_t* message_digest, uint32_t index,
     return ErrOk;
 }
 
+bool fsm_seedProgress(uint32_t current, uint32_t total)
+{
+    return protectProgress(_("Deriving seed"), current, total);
+}
+
 ErrCode_t addressFromHdw(SkycoinAddress* msg, ResponseSkycoinAddress* resp)
 {
     if (msg->has_bip44_addr) {
-        const char* mnemo = storage_getFullSeed();
         uint8_t seed[512 / 8] = {0};
-        mnemonic_to_seed(mnemo, "", seed, NULL);
+        if (!session_getBip39Seed(seed, &fsm_seedProgress)) {
+            return ErrActionCancelled;
+        }
         resp->addresses_count = 0;
         for (uint32_t i = 0; i < msg->bip44_addr.address_n; ++i) {
+            if (!protectProgress(_("Generating addresses"), i, msg->bip44_addr.address_n)) {
+                return ErrActionCancelled;
+            }
             char addr[100] = {0};
             size_t addr_size = sizeof(addr);
             int ret = hdnode_address_for_branch(
@@ -275,6 +287,12 @@ ErrCode_t addressFromHdw(SkycoinAddress* msg, ResponseSkycoinAddress* resp)
             if (addr_size > sizeof(resp->addresses[i])) {
                 return ErrFailed;
             }
+            AddressPath path = {.bip44 = true,
+                .coin_type = msg->bip44_addr.coin_type,
+                .account = msg->bip44_addr.account,
+                .change = msg->bip44_addr.change,
+                .index = msg->bip44_addr.address_start_index + i};
+            addrindex_addAddress(addr, &path);
             memcpy(resp->addresses[i], addr, addr_size);
 #if EMULATOR
             printf("%s\n", resp->addresses[i]);
@@ -292,13 +310,16 @@ ErrCode_t keyPairFromHdw(SkycoinSignMessage* msg,
     uint8_t* pubkey)
 {
     if (msg->has_bip44_addr) {
-        const char* mnemo = storage_getFullSeed();
         uint8_t seed[512 / 8] = {0};
-        mnemonic_to_seed(mnemo, "", seed, NULL);
+        if (!session_getBip39Seed(seed, &fsm_seedProgress)) {
+            return ErrActionCancelled;
+        }
+        PROFILE_BEGIN(derive);
         int ret = hdnode_keypair_for_branch(
             seed, sizeof(seed), bip44_purpose, msg->bip44_addr.coin_type,
             msg->bip44_addr.account, msg->bip44_addr.change,
             msg->bip44_addr.address_start_index, seckey, pubkey);
+        PROFILE_END(derive, ProfilePhaseKeyDerivation, 1);
         if (ret != 1) {
             return ErrAddressGeneration;
         }
@@ -310,9 +331,10 @@ ErrCode_t keyPairFromHdw(SkycoinSignMessage* msg,
 ErrCode_t addressFromHdwWithTransactionOutput(SkycoinTransactionOutput output, char* addr, size_t* addr_size)
 {
     if (output.has_bip44_addr) {
-        const char* mnemo = storage_getFullSeed();
         uint8_t seed[512 / 8] = {0};
-        mnemonic_to_seed(mnemo, "", seed, NULL);
+        if (!session_getBip39Seed(seed, &fsm_seedProgress)) {
+            return ErrActionCancelled;
+        }
         int ret = hdnode_address_for_branch(
             seed,
             sizeof(seed),
@@ -326,6 +348,13 @@ ErrCode_t addressFromHdwWithTransactionOutput(SkycoinTransactionOutput output, c
         if (ret != 1) {
             return ErrAddressGeneration;
         }
+        AddressPath path = {.bip44 = true,
+            .coin_type = output.bip44_addr.coin_type,
+            .account = output.bip44_addr.account,
+            .change = output.bip44_addr.change,
+            .index = output.bip44_addr.address_start_index};
+        addrindex_addAddress(addr, &path);
+        return ErrOk;
     }
     return ErrInvalidArg;
 }
@@ -335,16 +364,21 @@ ErrCode_t signTransactionMessageFromHDW(uint8_t* message_digest, Bip44AddrIndex
     uint8_t pubkey[SKYCOIN_PUBKEY_LEN] = {0};
     uint8_t seckey[SKYCOIN_SECKEY_LEN] = {0};
     uint8_t signature[SKYCOIN_SIG_LEN] = {0};
-    const char* mnemo = storage_getFullSeed();
     uint8_t seed[512 / 8] = {0};
-    mnemonic_to_seed(mnemo, "", seed, NULL);
+    if (!session_getBip39Seed(seed, &fsm_seedProgress)) {
+        return ErrActionCancelled;
+    }
+    PROFILE_BEGIN(derive);
     int ret = hdnode_keypair_for_branch(
         seed, sizeof(seed), bip44_purpose, bip44.coin_type, bip44.account,
         bip44.change, bip44.address_start_index, seckey, pubkey);
+    PROFILE_END(derive, ProfilePhaseKeyDerivation, 1);
     if (ret != 1) {
         return ErrAddressGeneration;
     }
+    PROFILE_BEGIN(sign);
     int signres = skycoin_ecdsa_sign_digest(seckey, message_digest, signature);
+    PROFILE_END(sign, ProfilePhaseSign, 0);
     if (signres == -2) {
         // Fail due to empty digest
         return ErrInvalidArg;
@@ -364,8 +398,9 @@ ErrCode_t
 fsm_getKeyPairAtIndex(uint32_t nbAddress, uint8_t* pubkey, uint8_t* seckey, ResponseSkycoinAddress* respSkycoinAddress, uint32_t start_index)
 {
     const char* mnemo = storage_getFullSeed();
-    uint8_t seed[33] = {0};
+    uint8_t seed[SHA256_DIGEST_LENGTH] = {0};
     uint8_t nextSeed[SHA256_DIGEST_LENGTH] = {0};
+    uint8_t secret[SKYCOIN_SECKEY_LEN] = {0};
     size_t size_address = 36;
     _Static_assert(
         sizeof(respSkycoinAddress->addresses[0]) == 36,
@@ -373,36 +408,102 @@ fsm_getKeyPairAtIndex(uint32_t nbAddress, uint8_t* pubkey, uint8_t* seckey, Resp
     if (mnemo == NULL || nbAddress == 0) {
         return ErrInvalidArg;
     }
-    if (0 != deterministic_key_pair_iterator((const uint8_t*)mnemo, strlen(mnemo), nextSeed, seckey, pubkey)) {
-        return ErrFailed;
-    }
-    if (respSkycoinAddress != NULL && start_index == 0) {
-        if (!skycoin_address_from_pubkey(pubkey, respSkycoinAddress->addresses[0], &size_address)) {
-            return ErrFailed;
-        }
-        respSkycoinAddress->addresses_count++;
-    }
-    memcpy(seed, nextSeed, 32);
     size_t max_addresses =
         sizeof(respSkycoinAddress->addresses) / sizeof(respSkycoinAddress->addresses[0]);
     if (nbAddress + start_index - 1 > max_addresses) {
         return ErrInvalidArg;
     }
-    for (uint32_t i = 0; i < nbAddress + start_index - 1; ++i) {
-        if (0 != deterministic_key_pair_iterator(seed, 32, nextSeed, seckey, pubkey)) {
-            return ErrFailed;
+    // Key pairs prefetched in this session skip the head of the chain.
+    // Only public keys are kept, a secret key below them is derived again
+    PROFILE_BEGIN(derive);
+    uint32_t cached = session_getCachedKeyPairs(mnemo, seed);
+    if (seckey != NULL && nbAddress + start_index <= cached) {
+        cached = 0;
+    }
+    uint32_t flash_cached = 0;
+    storage_getAddressCache(mnemo, &flash_cached);
+    ErrCode_t err = ErrOk;
+    for (uint32_t i = 0; i < nbAddress + start_index; ++i) {
+        if (i < cached) {
+            session_getCachedKeyPair(i, pubkey);
+        } else if (i == 0) {
+            if (0 != deterministic_key_pair_iterator((const uint8_t*)mnemo, strlen(mnemo), nextSeed, secret, pubkey)) {
+                err = ErrFailed;
+                break;
+            }
+        } else {
+            // Only show progress when it takes long enough to be noticed
+            const char* desc = nbAddress + start_index > FSM_PROGRESS_MIN_ADDRESSES ? _("Generating addresses") : NULL;
+            if (!protectProgress(desc, i - 1, nbAddress + start_index - 1)) {
+                err = ErrActionCancelled;
+                break;
+            }
+            if (0 != deterministic_key_pair_iterator(seed, sizeof(seed), nextSeed, secret, pubkey)) {
+                err = ErrFailed;
+                break;
+            }
+        }
+        uint8_t hash[ADDRESS_CACHE_HASH_LEN];
+        if (i >= cached || i == flash_cached) {
+            skycoin_address_hash_from_pubkey(pubkey, hash);
         }
-        memcpy(seed, nextSeed, 32);
-        seed[32] = 0;
-        if (respSkycoinAddress != NULL && ((i + 1) >= start_index)) {
+        if (i >= cached) {
+            AddressPath path = {.bip44 = false, .index = i};
+            addrindex_add(hash, &path);
+            session_cacheKeyPair(i, pubkey, nextSeed);
+            memcpy(seed, nextSeed, sizeof(seed));
+        }
+        if (i == flash_cached) {
+            storage_appendAddressCache(mnemo, i, hash);
+            flash_cached++;
+        }
+        if (respSkycoinAddress != NULL && i >= start_index) {
             size_address = 36;
             if (!skycoin_address_from_pubkey(pubkey, respSkycoinAddress->addresses[respSkycoinAddress->addresses_count],
                     &size_address)) {
-                return ErrFailed;
+                err = ErrFailed;
+                break;
             }
             respSkycoinAddress->addresses_count++;
         }
     }
+    if (err == ErrOk && seckey != NULL) {
+        memcpy(seckey, secret, sizeof(secret));
+    }
+    memzero(seed, sizeof(seed));
+    memzero(nextSeed, sizeof(nextSeed));
+    memzero(secret, sizeof(secret));
+    if (err == ErrOk) {
+        PROFILE_END(derive, ProfilePhaseKeyDerivation, nbAddress + start_index);
+    }
+    return err;
+}
+
+ErrCode_t fsm_getAddressesFromCache(uint32_t nbAddress, ResponseSkycoinAddress* respSkycoinAddress, uint32_t start_index)
+{
+    const char* mnemo = storage_getFullSeed();
+    uint32_t count = 0;
+    if (mnemo == NULL) {
+        return ErrInvalidArg;
+    }
+    const uint8_t* hashes = storage_getAddressCache(mnemo, &count);
+    if (hashes == NULL || nbAddress + start_index > count) {
+        return ErrFailed;
+    }
+    size_t max_addresses =
+        sizeof(respSkycoinAddress->addresses) / sizeof(respSkycoinAddress->addresses[0]);
+    if (respSkycoinAddress->addresses_count + nbAddress > max_addresses) {
+        return ErrInvalidArg;
+    }
+    // Flash entries are not derivations of this session, they stay out of the address index
+    for (uint32_t i = start_index; i < nbAddress + start_index; ++i) {
+        size_t size_address = sizeof(respSkycoinAddress->addresses[0]);
+        if (!skycoin_address_from_address_hash(hashes + i * ADDRESS_CACHE_HASH_LEN,
+                respSkycoinAddress->addresses[respSkycoinAddress->addresses_count], &size_address)) {
+            return ErrFailed;
+        }
+        respSkycoinAddress->addresses_count++;
+    }
     return ErrOk;
 }
 
@@ -553,22 +654,28 @@ ErrCode_t msgWipeDeviceImpl(WipeDevice* msg)
 {
     (void)msg;
     storage_wipe();
+    TxSignCtx_DestroyAll();
     // the following does not work on Mac anyway :-/ Linux/Windows are fine, so it is not needed
     // usbReconnect(); // force re-enumeration because of the serial number change
     // fsm_sendSuccess(_("Device wiped"));
     return ErrOk;
 }
 
+ErrCode_t msgCancelImpl(Cancel* msg)
+{
+    (void)msg;
+    recovery_abort();
+    TxSignCtx_DestroyAll();
+    return ErrActionCancelled;
+}
+
 ErrCode_t msgSetMnemonicImpl(SetMnemonic* msg)
 {
     if (!mnemonic_check(msg->mnemonic)) {
         return ErrInvalidValue;
     }
     storage_setMnemonic(msg->mnemonic);
-    TxSignContext* ctx = TxSignCtx_Get();
-    if (ctx != NULL) {
-        ctx->mnemonic_change = true;
-    }
+    TxSignCtx_SetMnemonicChange();
     storage_setNeedsBackup(true);
     storage_update();
     //fsm_sendSuccess(_(msg->mnemonic));
@@ -678,13 +785,20 @@ ErrCode_t msgSignTxImpl(SignTx* msg, TxRequest* resp)
         _("Transaction signed nbIn"),
         msg->inputs_count, msg->outputs_count);
 #endif
-    TxSignContext* context = TxSignCtx_Get();
-    if (context->state != Destroyed) {
-        TxSignCtx_Destroy(context);
-        return ErrFailed;
-    }
-    // Init TxSignContext
-    context = TxSignCtx_Init();
+    // idle sessions expire in host time, also on a virtual clock
+    uint32_t now = timer_real_ms();
+    TxSignCtx_DestroyExpired(now, TX_SIGN_CTX_TIMEOUT_MS);
+    // A repeated SignTx restarts the session of that hash, e.g. when the host retries after a dropped link
+    TxSignContext* previous = TxSignCtx_Find(msg->tx_hash);
+    if (previous != NULL) {
+        TxSignCtx_Destroy(previous);
+    }
+#ifndef TxAck_tx_hash_tag
+    // TxAck can not name its session, a new SignTx replaces the one in progress
+    TxSignCtx_DestroyAll();
+#endif
+    // Init TxSignContext, other sessions in progress are kept unless the pool is full
+    TxSignContext* context = TxSignCtx_Init(msg->tx_hash, now);
     if (context->mnemonic_change) {
         TxSignCtx_Destroy(context);
         return ErrFailed;
@@ -697,7 +811,6 @@ ErrCode_t msgSignTxImpl(SignTx* msg, TxRequest* resp)
     context->nbIn = msg->inputs_count;
     context->nbOut = msg->outputs_count;
     sha256_Init(&context->sha256_ctx);
-    memcpy(context->tx_hash, msg->tx_hash, 65 * sizeof(char));
     context->version = msg->version;
     context->has_innerHash = false;
     context->requestIndex = 1;
@@ -737,7 +850,17 @@ ErrCode_t reqConfirmTransaction(uint64_t coins, uint64_t hours, char* address)
 
 ErrCode_t msgTxAckImpl(TxAck* msg, TxRequest* resp)
 {
+    uint32_t now = timer_real_ms();
+    TxSignCtx_DestroyExpired(now, TX_SIGN_CTX_TIMEOUT_MS);
+#ifdef TxAck_tx_hash_tag
+    TxSignContext* ctx = msg->has_tx_hash ? TxSignCtx_Find(msg->tx_hash) : NULL;
+    if (ctx == NULL) {
+        return ErrUnexpectedMessage;
+    }
+#else
+    // TxAck does not carry the transaction hash, msgSignTxImpl allows a single session
     TxSignContext* ctx = TxSignCtx_Get();
+#endif
     if (ctx->state != Start && ctx->state != InnerHashInputs && ctx->state != InnerHashOutputs &&
         ctx->state != Signature_) {
         TxSignCtx_Destroy(ctx);
@@ -777,6 +900,7 @@ ErrCode_t msgTxAckImpl(TxAck* msg, TxRequest* resp)
         TxSignCtx_Destroy(ctx);
         return ErrFailed;
     }
+    TxSignCtx_Touch(ctx, now);
     uint8_t inputs[7][32];
     for (uint8_t i = 0; i < msg->tx.inputs_count; ++i) {
         writebuf_fromhexstr(msg->tx.inputs[i].hashIn, inputs[i]);
@@ -807,8 +931,10 @@ ErrCode_t msgTxAckImpl(TxAck* msg, TxRequest* resp)
             if (!msg->tx.outputs[i].address_n_count) {
                 ErrCode_t err = reqConfirmTransaction(msg->tx.outputs[i].coins, msg->tx.outputs[i].hours,
                     msg->tx.outputs[i].address);
-                if (err != ErrOk)
+                if (err != ErrOk) {
+                    TxSignCtx_Destroy(ctx);
                     return err;
+                }
             }
 #endif
             outputs[i].coin = msg->tx.outputs[i].coins;
@@ -169,11 +169,31 @@ bool checkOutputs(TransactionSign* msg);
 
 bool checkMnemonicChecksum(SetMnemonic* msg);
 
+// Address derivations below this count do not show a progress bar
+#define FSM_PROGRESS_MIN_ADDRESSES 10
+
+/**
+ * @brief mnemonic_to_seed progress callback, shows progress and aborts on Cancel or Initialize
+ */
+bool fsm_seedProgress(uint32_t current, uint32_t total);
+
 ErrCode_t signTransactionMessageFromHDW(uint8_t* message_digest, Bip44AddrIndex bip44, char* signed_message);
 
+/**
+ * @brief Derive the deterministic key pairs up to start_index + nbAddress - 1
+ * @param pubkey Set to the public key of the last address
+ * @param seckey Set to the secret key of the last address, NULL when only the address is needed
+ * @param respSkycoinAddress Filled with the addresses from start_index on, may be NULL
+ */
 ErrCode_t
 fsm_getKeyPairAtIndex(uint32_t nbAddress, uint8_t* pubkey, uint8_t* seckey, ResponseSkycoinAddress* respSkycoinAddress, uint32_t start_index);
 
+/**
+ * @brief Fill respSkycoinAddress from the flash address cache
+ * @return ErrOk if all the requested addresses were cached, ErrFailed otherwise
+ */
+ErrCode_t fsm_getAddressesFromCache(uint32_t nbAddress, ResponseSkycoinAddress* respSkycoinAddress, uint32_t start_index);
+
 ErrCode_t addressFromHdw(SkycoinAddress* msg, ResponseSkycoinAddress* resp);
 
 ErrCode_t keyPairFromHdw(SkycoinSignMessage* msg, uint8_t* seckey, uint8_t* pubkey);
@@ -196,6 +216,11 @@ ErrCode_t msgChangePinImpl(ChangePin* msg, const char* (*)(PinMatrixRequestType,
 
 ErrCode_t msgWipeDeviceImpl(WipeDevice* msg);
 
+/**
+ * @brief Abort the recovery and the transaction signing sessions in progress
+ */
+ErrCode_t msgCancelImpl(Cancel* msg);
+
 ErrCode_t msgSetMnemonicImpl(SetMnemonic* msg);
 
 ErrCode_t msgGetEntropyImpl(GetRawEntropy* msg, Entropy* resp, void (*random_buffer_func)(uint8_t* buf, size_t len));
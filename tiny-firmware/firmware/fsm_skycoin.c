@@ -86,12 +86,14 @@ void fsm_msgSkycoinSignMessage(SkycoinSignMessage* msg)
 
     MessageType msgtype = MessageType_MessageType_SkycoinSignMessage;
     ResponseSkycoinAddress respAddr;
-    uint8_t seckey[32] = {0};
     uint8_t pubkey[33] = {0};
     if (msg->has_bip44_addr) {
-        const char* mnemo = storage_getFullSeed();
         uint8_t seed[512 / 8] = {0};
-        mnemonic_to_seed(mnemo, "", seed, NULL);
+        if (!session_getBip39Seed(seed, &fsm_seedProgress)) {
+            fsm_sendResponseFromErrCode(ErrActionCancelled, NULL, NULL, &msgtype);
+            layoutHome();
+            return;
+        }
         size_t addr_size = sizeof(respAddr.addresses[0]);
         int ret = hdnode_address_for_branch(
             seed, sizeof(seed), bip44_purpose, msg->bip44_addr.coin_type,
@@ -105,7 +107,7 @@ void fsm_msgSkycoinSignMessage(SkycoinSignMessage* msg)
             return;
         }
     } else {
-        ErrCode_t err = fsm_getKeyPairAtIndex(1, pubkey, seckey, &respAddr,
+        ErrCode_t err = fsm_getKeyPairAtIndex(1, pubkey, NULL, &respAddr,
             msg->address_n);
         if (err != ErrOk) {
             fsm_sendResponseFromErrCode(
@@ -194,3 +196,77 @@ void fsm_msgTransactionSign(TransactionSign* msg)
     }
     layoutHome();
 }
+
+#if defined(SkycoinAddressLookup_init_default)
+
+void fsm_msgSkycoinAddressLookup(SkycoinAddressLookup* msg)
+{
+    CHECK_PIN
+    CHECK_MNEMONIC
+
+    MessageType msgtype = MessageType_MessageType_SkycoinAddressLookup;
+    RESP_INIT(ResponseSkycoinAddressLookup);
+    bool found = false;
+    AddressPath path;
+    ErrCode_t err = msgSkycoinAddressLookupImpl(msg->address, &found, &path);
+    if (err != ErrOk) {
+        fsm_sendResponseFromErrCode(err, NULL, _("Invalid address"), &msgtype);
+        layoutHome();
+        return;
+    }
+    resp->has_found = true;
+    resp->found = found;
+    if (found) {
+        resp->has_bip44 = true;
+        resp->bip44 = path.bip44;
+        if (path.bip44) {
+            resp->has_coin_type = true;
+            resp->coin_type = path.coin_type;
+            resp->has_account = true;
+            resp->account = path.account;
+            resp->has_change = true;
+            resp->change = path.change;
+        }
+        resp->has_index = true;
+        resp->index = path.index;
+    }
+    msg_write(MessageType_MessageType_ResponseSkycoinAddressLookup, resp);
+    layoutHome();
+}
+
+#endif
+
+#if defined(TransactionSignBatch_init_default)
+
+static void writeResponseTransactionSign(ResponseTransactionSign* resp)
+{
+    msg_write(MessageType_MessageType_ResponseTransactionSign, resp);
+}
+
+void fsm_msgTransactionSignBatch(TransactionSignBatch* msg)
+{
+    CHECK_PIN
+    CHECK_MNEMONIC
+    for (uint32_t i = 0; i < msg->transactions_count; ++i) {
+        CHECK_INPUTS(&msg->transactions[i])
+        CHECK_OUTPUTS(&msg->transactions[i])
+    }
+
+    MessageType msgtype = MessageType_MessageType_TransactionSignBatch;
+    RESP_INIT(ResponseTransactionSign);
+    ErrCode_t err = msgTransactionSignBatchImpl(msg->transactions, msg->transactions_count, &requestConfirmBatchDestination, &writeResponseTransactionSign, resp);
+    char* failMsg = NULL;
+    switch (err) {
+    case ErrOk:
+        break;
+    case ErrAddressGeneration:
+        failMsg = _("Wrong return address");
+        // fall through
+    default:
+        fsm_sendResponseFromErrCode(err, NULL, failMsg, &msgtype);
+        break;
+    }
+    layoutHome();
+}
+
+#endif
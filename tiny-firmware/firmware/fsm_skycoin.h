@@ -27,5 +27,11 @@ void fsm_msgSkycoinCheckMessageSignature(SkycoinCheckMessageSignature* msg);
 void fsm_msgSkycoinSignMessage(SkycoinSignMessage* msg);
 void fsm_msgSkycoinAddress(SkycoinAddress* msg);
 void fsm_msgTransactionSign(TransactionSign* msg);
+#if defined(SkycoinAddressLookup_init_default)
+void fsm_msgSkycoinAddressLookup(SkycoinAddressLookup* msg);
+#endif
+#if defined(TransactionSignBatch_init_default)
+void fsm_msgTransactionSignBatch(TransactionSignBatch* msg);
+#endif
 
 #endif
@@ -33,6 +33,8 @@
 #include "skycoin-crypto/tools/bip32.h"
 #include "skycoin-crypto/tools/bip39.h"
 #include "skycoin-crypto/tools/bip44.h"
+#include "tiny-firmware/firmware/addrindex.h"
+#include "tiny-firmware/firmware/arena.h"
 #include "tiny-firmware/firmware/droplet.h"
 #include "tiny-firmware/firmware/entropy.h"
 #include "tiny-firmware/firmware/fsm.h"
@@ -40,6 +42,7 @@
 #include "tiny-firmware/firmware/gettext.h"
 #include "tiny-firmware/firmware/layout2.h"
 #include "tiny-firmware/firmware/messages.h"
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/firmware/protect.h"
 #include "tiny-firmware/firmware/recovery.h"
 #include "tiny-firmware/firmware/reset.h"
@@ -123,7 +126,9 @@ ErrCode_t msgSkycoinSignMessageImpl(SkycoinSignMessage* msg, ResponseSkycoinSign
     } else {
         sha256sum((const uint8_t*)msg->message, digest, strlen(msg->message));
     }
+    PROFILE_BEGIN(sign);
     int res = skycoin_ecdsa_sign_digest(seckey, digest, signature);
+    PROFILE_END(sign, ProfilePhaseSign, 0);
     if (res == -2) {
         // Fail due to empty digest
         return ErrInvalidArg;
@@ -151,7 +156,6 @@ static bool the_first_address_only(SkycoinAddress* msg)
 
 ErrCode_t msgSkycoinAddressImpl(SkycoinAddress* msg, ResponseSkycoinAddress* resp)
 {
-    uint8_t seckey[32] = {0};
     uint8_t pubkey[33] = {0};
     uint32_t start_index = !msg->has_start_index ? 0 : msg->start_index;
 
@@ -172,7 +176,15 @@ ErrCode_t msgSkycoinAddressImpl(SkycoinAddress* msg, ResponseSkycoinAddress* res
             return err;
         }
     } else {
-        if (fsm_getKeyPairAtIndex(msg->address_n, pubkey, seckey, resp, start_index) != ErrOk) {
+        // Addresses already listed once are read back from flash
+        ErrCode_t err = fsm_getAddressesFromCache(msg->address_n, resp, start_index);
+        if (err != ErrOk) {
+            err = fsm_getKeyPairAtIndex(msg->address_n, pubkey, NULL, resp, start_index);
+        }
+        if (err == ErrActionCancelled) {
+            return err;
+        }
+        if (err != ErrOk) {
             return ErrAddressGeneration;
         }
         if (msg->address_n == 1 && msg->has_confirm_address && msg->confirm_address) {
@@ -182,8 +194,90 @@ ErrCode_t msgSkycoinAddressImpl(SkycoinAddress* msg, ResponseSkycoinAddress* res
     return ErrOk;
 }
 
-ErrCode_t
-msgTransactionSignImpl(TransactionSign* msg, ErrCode_t (*funcConfirmTxn)(char*, char*, TransactionSign*, uint32_t), ResponseTransactionSign* resp)
+/**
+ * @brief Check that a change output pays to the address at its derivation path
+ * @param output Output with either bip44_addr or address_index set
+ */
+static ErrCode_t transactionSignVerifyChange(SkycoinTransactionOutput* output)
+{
+    AddressPath expected = {.bip44 = output->has_bip44_addr};
+    if (output->has_bip44_addr) {
+        expected.coin_type = output->bip44_addr.coin_type;
+        expected.account = output->bip44_addr.account;
+        expected.change = output->bip44_addr.change;
+        expected.index = output->bip44_addr.address_start_index;
+    } else {
+        expected.index = output->address_index;
+    }
+    // The index only holds addresses derived in this session, a hit at the
+    // expected path skips the derivation and anything else is derived again
+    AddressPath path;
+    if (addrindex_findAddress(output->address, &path) && addrindex_samePath(&path, &expected)) {
+        return ErrOk;
+    }
+    if (output->has_bip44_addr) {
+        char addr[100] = {0};
+        size_t addr_size = sizeof(addr);
+        ErrCode_t err = addressFromHdwWithTransactionOutput(*output, addr, &addr_size);
+        if (err != ErrOk) {
+            return err;
+        }
+        if (strcmp(output->address, addr) != 0) {
+            // fsm_sendFailure(FailureType_Failure_AddressGeneration, _("Wrong return address"));
+#if EMULATOR
+            printf("Internal address: %s, message address: %s\n", addr, output->address);
+            printf("Comparaison size %ld\n", addr_size);
+#endif
+            return ErrAddressGeneration;
+        }
+    } else {
+        uint8_t pubkey[33] = {0};
+        size_t size_address = 36;
+        char address[36] = {0};
+        ErrCode_t ret = fsm_getKeyPairAtIndex(1, pubkey, NULL, NULL, output->address_index);
+        if (ret != ErrOk) {
+            return ret;
+        }
+        if (!skycoin_address_from_pubkey(pubkey, address, &size_address)) {
+            return ErrAddressGeneration;
+        }
+        if (strcmp(output->address, address) != 0) {
+            // fsm_sendFailure(FailureType_Failure_AddressGeneration, _("Wrong return address"));
+#if EMULATOR
+            printf("Internal address: %s, message address: %s\n", address, output->address);
+            printf("Comparaison size %ld\n", size_address);
+#endif
+            return ErrAddressGeneration;
+        }
+    }
+    return ErrOk;
+}
+
+/**
+ * @brief Format amounts sent to an address for the confirmation dialog
+ */
+static void sprintTxnAmount(char* strCoin, char* strHour, uint64_t coins, uint64_t hours)
+{
+    char strValue[20];
+    char* coinString = coins == 1000000 ? _("coin") : _("coins");
+    char* hourString = (hours == 1 || hours == 0) ? _("hour") : _("hours");
+    char* strValueMsg = sprint_coins(coins, SKYPARAM_DROPLET_PRECISION_EXP, sizeof(strValue), strValue);
+    if (strValueMsg == NULL) {
+        // FIXME: For Skycoin coin supply and precision buffer size should be enough
+        strcpy(strCoin, "too many coins");
+    } else {
+        sprintf(strCoin, "%s %s %s", _("send"), strValueMsg, coinString);
+    }
+    sprintf(strHour, "%" PRIu64 " %s", hours, hourString);
+}
+
+/**
+ * @brief Check transaction bounds and verify that change addresses belong to the wallet
+ * @param msg Transaction to verify
+ * @param funcConfirmTxn Confirmation requested for every output sent outside the wallet,
+ *        NULL if the caller confirms them in some other way
+ */
+static ErrCode_t transactionSignVerify(TransactionSign* msg, ErrCode_t (*funcConfirmTxn)(char*, char*, TransactionSign*, uint32_t))
 {
     if (msg->nbIn > sizeof(msg->transactionIn) / sizeof(*msg->transactionIn)) {
         return ErrInvalidArg;
@@ -206,78 +300,58 @@ msgTransactionSignImpl(TransactionSign* msg, ErrCode_t (*funcConfirmTxn)(char*,
             msg->transactionOut[i].address, msg->transactionOut[i].address_index);
     }
 #endif
-    Transaction transaction;
-    transaction_initZeroTransaction(&transaction);
-    for (uint32_t i = 0; i < msg->nbIn; ++i) {
-        uint8_t hashIn[32];
-        writebuf_fromhexstr(msg->transactionIn[i].hashIn, hashIn);
-        transaction_addInput(&transaction, hashIn);
-    }
     for (uint32_t i = 0; i < msg->nbOut; ++i) {
-        char strHour[30];
-        char strCoin[30];
-        char strValue[20];
-        char* coinString = msg->transactionOut[i].coin == 1000000 ? _("coin") : _("coins");
-        char* hourString = (msg->transactionOut[i].hour == 1 || msg->transactionOut[i].hour == 0) ? _("hour") : _("hours");
-        char* strValueMsg = sprint_coins(msg->transactionOut[i].coin, SKYPARAM_DROPLET_PRECISION_EXP, sizeof(strValue),
-            strValue);
-        if (strValueMsg == NULL) {
-            // FIXME: For Skycoin coin supply and precision buffer size should be enough
-            strcpy(strCoin, "too many coins");
-        }
-        sprintf(strCoin, "%s %s %s", _("send"), strValueMsg, coinString);
-        sprintf(strHour, "%" PRIu64 " %s", msg->transactionOut[i].hour, hourString);
-
-        if (msg->transactionOut[i].has_bip44_addr) {
-            char addr[100] = {0};
-            size_t addr_size = sizeof(addr);
-            ErrCode_t err = addressFromHdwWithTransactionOutput(msg->transactionOut[i], addr, &addr_size);
+        if (msg->transactionOut[i].has_bip44_addr || msg->transactionOut[i].has_address_index) {
+            ErrCode_t err = transactionSignVerifyChange(&msg->transactionOut[i]);
             if (err != ErrOk) {
                 return err;
             }
-            if (strcmp(msg->transactionOut[i].address, addr) != 0) {
-                // fsm_sendFailure(FailureType_Failure_AddressGeneration, _("Wrong return address"));
-#if EMULATOR
-                printf("Internal address: %s, message address: %s\n", addr, msg->transactionOut[i].address);
-                printf("Comparaison size %ld\n", addr_size);
-#endif
-                return ErrAddressGeneration;
-            }
-        } else if (msg->transactionOut[i].has_address_index) {
-            uint8_t pubkey[33] = {0};
-            uint8_t seckey[32] = {0};
-            size_t size_address = 36;
-            char address[36] = {0};
-            ErrCode_t ret = fsm_getKeyPairAtIndex(1, pubkey, seckey, NULL, msg->transactionOut[i].address_index);
-            if (ret != ErrOk) {
-                return ret;
-            }
-            if (!skycoin_address_from_pubkey(pubkey, address, &size_address)) {
-                return ErrAddressGeneration;
-            }
-            if (strcmp(msg->transactionOut[i].address, address) != 0) {
-                // fsm_sendFailure(FailureType_Failure_AddressGeneration, _("Wrong return address"));
-#if EMULATOR
-                printf("Internal address: %s, message address: %s\n", address, msg->transactionOut[i].address);
-                printf("Comparaison size %ld\n", size_address);
-#endif
-                return ErrAddressGeneration;
-            }
-        } else {
+        } else if (funcConfirmTxn != NULL) {
+            char strHour[30];
+            char strCoin[30];
+            sprintTxnAmount(strCoin, strHour, msg->transactionOut[i].coin, msg->transactionOut[i].hour);
             // NOTICE: A single output per address is assumed
             ErrCode_t err = funcConfirmTxn(strCoin, strHour, msg, i);
             if (err != ErrOk)
                 return err;
         }
-        transaction_addOutput(&transaction, msg->transactionOut[i].coin, msg->transactionOut[i].hour,
-            msg->transactionOut[i].address);
     }
+    return ErrOk;
+}
 
-    CHECK_PIN_UNCACHED_RET_ERR_CODE
+/**
+ * @brief Hash inputs and outputs of a verified transaction
+ * @param msg Transaction to hash
+ * @param transaction Transaction with inputs and outputs added
+ */
+static void transactionSignBuild(TransactionSign* msg, Transaction* transaction)
+{
+    transaction_initZeroTransaction(transaction);
+    for (uint32_t i = 0; i < msg->nbIn; ++i) {
+        uint8_t hashIn[32];
+        writebuf_fromhexstr(msg->transactionIn[i].hashIn, hashIn);
+        transaction_addInput(transaction, hashIn);
+    }
+    for (uint32_t i = 0; i < msg->nbOut; ++i) {
+        transaction_addOutput(transaction, msg->transactionOut[i].coin, msg->transactionOut[i].hour,
+            msg->transactionOut[i].address);
+    }
+}
 
+/**
+ * @brief Sign every input of a prepared transaction owned by the device
+ * @param msg Transaction to sign
+ * @param transaction Transaction built by transactionSignBuild
+ * @param resp Response where signatures are appended
+ */
+static ErrCode_t transactionSignInputs(TransactionSign* msg, Transaction* transaction, ResponseTransactionSign* resp)
+{
     for (uint32_t i = 0; i < msg->nbIn; ++i) {
+        if (!protectProgress(_("Signing transaction"), i, msg->nbIn)) {
+            return ErrActionCancelled;
+        }
         uint8_t digest[32] = {0};
-        transaction_msgToSign(&transaction, i, digest);
+        transaction_msgToSign(transaction, i, digest);
         // Only sign inputs owned by Skywallet device
         if (msg->transactionIn[i].has_bip44_addr) {
             if (signTransactionMessageFromHDW(digest, msg->transactionIn[i].bip44_addr, resp->signatures[resp->signatures_count]) != ErrOk) {
@@ -313,11 +387,122 @@ msgTransactionSignImpl(TransactionSign* msg, ErrCode_t (*funcConfirmTxn)(char*,
     }
 #if EMULATOR
     char str[64];
-    tohex(str, transaction.innerHash, 32);
+    tohex(str, transaction->innerHash, 32);
     printf("InnerHash %s\n", str);
     printf("Signed message:  %s\n", resp->signatures[0]);
     printf("Nb signatures: %d\n", resp->signatures_count);
 #endif
+    return ErrOk;
+}
+
+ErrCode_t
+msgTransactionSignImpl(TransactionSign* msg, ErrCode_t (*funcConfirmTxn)(char*, char*, TransactionSign*, uint32_t), ResponseTransactionSign* resp)
+{
+    ErrCode_t err = transactionSignVerify(msg, funcConfirmTxn);
+    if (err != ErrOk) {
+        return err;
+    }
+
+    CHECK_PIN_UNCACHED_RET_ERR_CODE
+
+    // kept off the stack, wiped when released
+    size_t mark = arena_mark();
+    Transaction* transaction = arena_alloc(sizeof(Transaction));
+    if (transaction == NULL) {
+        return ErrFailed;
+    }
+    transactionSignBuild(msg, transaction);
     //layoutHome();
+    err = transactionSignInputs(msg, transaction, resp);
+    arena_release(mark);
+    return err;
+}
+
+ErrCode_t msgTransactionSignBatchImpl(TransactionSign* msgs, uint32_t count, ErrCode_t (*funcConfirmDestination)(char*, char*, char*), void (*funcWriteResp)(ResponseTransactionSign*), ResponseTransactionSign* resp)
+{
+    struct {
+        char address[sizeof(msgs->transactionOut[0].address)];
+        uint64_t coins;
+        uint64_t hours;
+    } totals[TX_BATCH_MAX_DESTINATIONS];
+    uint32_t nbDestinations = 0;
+    if (count == 0 || count > TX_BATCH_MAX_TRANSACTIONS) {
+        return ErrInvalidArg;
+    }
+    // Verify every transaction and add up what is sent to each external address
+    for (uint32_t t = 0; t < count; ++t) {
+        ErrCode_t err = transactionSignVerify(&msgs[t], NULL);
+        if (err != ErrOk) {
+            return err;
+        }
+        for (uint32_t i = 0; i < msgs[t].nbOut; ++i) {
+            SkycoinTransactionOutput* out = &msgs[t].transactionOut[i];
+            if (out->has_bip44_addr || out->has_address_index) {
+                continue;
+            }
+            uint32_t d = 0;
+            while (d < nbDestinations && strcmp(totals[d].address, out->address) != 0) {
+                ++d;
+            }
+            if (d == nbDestinations) {
+                if (nbDestinations == TX_BATCH_MAX_DESTINATIONS) {
+                    return ErrInvalidArg;
+                }
+                strncpy(totals[d].address, out->address, sizeof(totals[d].address));
+                totals[d].coins = 0;
+                totals[d].hours = 0;
+                nbDestinations++;
+            }
+            if (totals[d].coins + out->coin < totals[d].coins || totals[d].hours + out->hour < totals[d].hours) {
+                return ErrInvalidArg;
+            }
+            totals[d].coins += out->coin;
+            totals[d].hours += out->hour;
+        }
+    }
+    // A single confirmation covers the whole batch
+    for (uint32_t d = 0; d < nbDestinations; ++d) {
+        char strHour[30];
+        char strCoin[30];
+        sprintTxnAmount(strCoin, strHour, totals[d].coins, totals[d].hours);
+        ErrCode_t err = funcConfirmDestination(strCoin, strHour, totals[d].address);
+        if (err != ErrOk) {
+            return err;
+        }
+    }
+
+    CHECK_PIN_UNCACHED_RET_ERR_CODE
+
+    // Every transaction is signed before anything is written, so that a
+    // failure or a cancel in the middle of the batch leaks no signature
+    size_t mark = arena_mark();
+    Transaction* transaction = arena_alloc(sizeof(Transaction));
+    ResponseTransactionSign* signatures = arena_alloc(count * sizeof(ResponseTransactionSign));
+    if (transaction == NULL || signatures == NULL) {
+        arena_release(mark);
+        return ErrFailed;
+    }
+    ErrCode_t err = ErrOk;
+    for (uint32_t t = 0; t < count && err == ErrOk; ++t) {
+        transactionSignBuild(&msgs[t], transaction);
+        err = transactionSignInputs(&msgs[t], transaction, &signatures[t]);
+    }
+    // Signature sets are written back to back without waiting for the host
+    for (uint32_t t = 0; t < count && err == ErrOk; ++t) {
+        memcpy(resp, &signatures[t], sizeof(*resp));
+        funcWriteResp(resp);
+    }
+    arena_release(mark);
+    return err;
+}
+
+ErrCode_t msgSkycoinAddressLookupImpl(const char* address, bool* found, AddressPath* path)
+{
+    CHECK_MNEMONIC_RET_ERR_CODE
+    uint8_t hash[ADDRESS_CACHE_HASH_LEN];
+    if (!addrindex_addressHash(address, hash)) {
+        return ErrInvalidArg;
+    }
+    *found = addrindex_find(hash, path);
     return ErrOk;
 }
@@ -22,6 +22,7 @@
 #define __FSM_SKYCOIN_IMPL_H__
 
 #include "messages.pb.h"
+#include "tiny-firmware/firmware/addrindex.h"
 #include "tiny-firmware/firmware/error.h"
 
 ErrCode_t
@@ -33,4 +34,27 @@ ErrCode_t msgSkycoinAddressImpl(SkycoinAddress* msg, ResponseSkycoinAddress* res
 
 ErrCode_t msgTransactionSignImpl(TransactionSign* msg, ErrCode_t (*)(char*, char*, TransactionSign*, uint32_t), ResponseTransactionSign*);
 
+// Maximum number of transactions signed after a single confirmation
+#define TX_BATCH_MAX_TRANSACTIONS 8
+// Maximum number of distinct external addresses in a batch
+#define TX_BATCH_MAX_DESTINATIONS 16
+
+/**
+ * @brief Sign several transactions after confirming the totals sent to each destination once
+ * @param msgs Transactions to sign
+ * @param count Number of transactions in msgs
+ * @param funcConfirmDestination Confirmation of coins and hours sent to an address by the whole batch
+ * @param funcWriteResp Called with the signatures of each transaction, in order
+ * @param resp Buffer reused for the response of every transaction
+ */
+ErrCode_t msgTransactionSignBatchImpl(TransactionSign* msgs, uint32_t count, ErrCode_t (*funcConfirmDestination)(char*, char*, char*), void (*funcWriteResp)(ResponseTransactionSign*), ResponseTransactionSign* resp);
+
+/**
+ * @brief Tell whether an address belongs to this wallet without deriving keys
+ * @param address Base58 address to look up
+ * @param found Set to whether the address was derived in this session
+ * @param path Derivation path of the address when found
+ */
+ErrCode_t msgSkycoinAddressLookupImpl(const char* address, bool* found, AddressPath* path);
+
 #endif
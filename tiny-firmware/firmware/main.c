@@ -20,6 +20,7 @@
 #include "tiny-firmware/firmware/gettext.h"
 #include "tiny-firmware/firmware/layout2.h"
 #include "tiny-firmware/firmware/skywallet.h"
+#include "tiny-firmware/firmware/stackmon.h"
 #include "tiny-firmware/firmware/storage.h"
 #include "tiny-firmware/gen/bitmaps.h"
 #include "tiny-firmware/layout.h"
@@ -41,6 +42,9 @@ extern uint32_t storage_uuid[STM32_UUID_LEN / sizeof(uint32_t)];
 
 int main(void)
 {
+#if PROFILE
+    stackmon_init();
+#endif
 #if defined(EMULATOR) && EMULATOR == 1
     setup();
     __stack_chk_guard = random32(); // this supports compiler provided unpredictable stack protection checks
@@ -72,7 +76,7 @@ int main(void)
     // enable MPU (Memory Protection Unit)
     mpu_config();
 #else
-    random_buffer((uint8_t*)storage_uuid, sizeof(storage_uuid));
+    emulatorUuid((uint8_t*)storage_uuid, sizeof(storage_uuid));
 #endif // !defined(EMULATOR) || EMULATOR == 0
 
 #if DEBUG_LINK
@@ -91,6 +95,16 @@ int main(void)
         check_lock_screen();
         check_factory_test();
         check_entropy();
+        bool busy = check_bip39_seed();
+        busy |= check_address_prefetch();
+#if defined(EMULATOR) && EMULATOR == 1
+        // block on the sockets instead of spinning when there is nothing to do
+        if (!busy) {
+            emulatorWait(check_idle_timeout());
+        }
+#else
+        (void)busy;
+#endif // defined(EMULATOR) && EMULATOR == 1
     }
 
     return 0;
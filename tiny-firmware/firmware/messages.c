@@ -19,11 +19,15 @@
 
 #include <string.h>
 
+#include "skycoin-crypto/tools/memzero.h"
+#include "tiny-firmware/firmware/arena.h"
 #include "tiny-firmware/firmware/fsm.h"
 #include "tiny-firmware/firmware/fsm_skycoin.h"
 #include "tiny-firmware/firmware/gettext.h"
 #include "tiny-firmware/firmware/messages.h"
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/firmware/skywallet.h"
+#include "tiny-firmware/timer.h"
 #include "tiny-firmware/util.h"
 
 #include "messages.pb.h"
@@ -70,7 +74,9 @@ void MessageProcessFunc(char type, char dir, uint16_t msg_id, void* ptr)
 #else
         if (type == m->type && dir == m->dir && msg_id == m->msg_id) {
 #endif
+            PROFILE_BEGIN(handler);
             m->process_func(ptr);
+            PROFILE_END(handler, ProfilePhaseMessage, msg_id);
             return;
         }
         m++;
@@ -117,6 +123,49 @@ static bool pb_callback_out(pb_ostream_t* stream, const uint8_t* buf, size_t cou
     return true;
 }
 
+#if DEBUG_LINK
+
+static uint32_t msg_debug_out_start = 0;
+static uint32_t msg_debug_out_end = 0;
+static uint32_t msg_debug_out_cur = 0;
+static uint8_t msg_debug_out[MSG_DEBUG_OUT_SIZE];
+
+static inline void msg_debug_out_append(uint8_t c)
+{
+    if (msg_debug_out_cur == 0) {
+        msg_debug_out[msg_debug_out_end * 64] = '?';
+        msg_debug_out_cur = 1;
+    }
+    msg_debug_out[msg_debug_out_end * 64 + msg_debug_out_cur] = c;
+    msg_debug_out_cur++;
+    if (msg_debug_out_cur == 64) {
+        msg_debug_out_cur = 0;
+        msg_debug_out_end = (msg_debug_out_end + 1) % (MSG_DEBUG_OUT_SIZE / 64);
+    }
+}
+
+static inline void msg_debug_out_pad(void)
+{
+    if (msg_debug_out_cur == 0) return;
+    while (msg_debug_out_cur < 64) {
+        msg_debug_out[msg_debug_out_end * 64 + msg_debug_out_cur] = 0;
+        msg_debug_out_cur++;
+    }
+    msg_debug_out_cur = 0;
+    msg_debug_out_end = (msg_debug_out_end + 1) % (MSG_DEBUG_OUT_SIZE / 64);
+}
+
+static bool pb_debug_callback_out(pb_ostream_t* stream, const uint8_t* buf, size_t count)
+{
+    (void)stream;
+    for (size_t i = 0; i < count; i++) {
+        msg_debug_out_append(buf[i]);
+    }
+    return true;
+}
+
+#endif
+
 bool msg_write_common(char type, uint16_t msg_id, const void* msg_ptr)
 {
     const pb_field_t* fields = MessageFields(type, 'o', msg_id);
@@ -137,6 +186,11 @@ bool msg_write_common(char type, uint16_t msg_id, const void* msg_ptr)
     if (type == 'n') {
         append = msg_out_append;
         pb_callback = pb_callback_out;
+#if DEBUG_LINK
+    } else if (type == 'd') {
+        append = msg_debug_out_append;
+        pb_callback = pb_debug_callback_out;
+#endif
     } else {
         return false;
     }
@@ -155,6 +209,11 @@ bool msg_write_common(char type, uint16_t msg_id, const void* msg_ptr)
     if (type == 'n') {
         msg_out_pad();
     }
+#if DEBUG_LINK
+    else if (type == 'd') {
+        msg_debug_out_pad();
+    }
+#endif
     return status;
 }
 
@@ -163,29 +222,40 @@ enum {
     READSTATE_READING,
 };
 
+static char read_state = READSTATE_IDLE;
+// host time, the quiet period must pass on a virtual clock too
+static uint32_t read_last_ms = 0;
+
+bool msg_read_idle(uint32_t quiet_ms)
+{
+    return read_state == READSTATE_IDLE && (timer_real_ms() - read_last_ms) >= quiet_ms;
+}
+
 void msg_process(char type, uint16_t msg_id, const pb_field_t* fields, uint8_t* msg_raw, uint32_t msg_size)
 {
-    static CONFIDENTIAL uint8_t msg_data[MSG_IN_SIZE];
-    memset(msg_data, 0, sizeof(msg_data));
+    uint8_t* msg_data = arena_alloc(MSG_IN_SIZE);
     pb_istream_t stream = pb_istream_from_buffer(msg_raw, msg_size);
     bool status = pb_decode(&stream, fields, msg_data);
+    // the raw message is no longer needed, handlers get its room
+    arena_release_top();
     if (status) {
         MessageProcessFunc(type, 'i', msg_id, msg_data);
     } else {
         fsm_sendFailure(FailureType_Failure_DataError, stream.errmsg, 0);
     }
+    arena_reset();
 }
 
 void msg_read_common(char type, const uint8_t* buf, int len)
 {
-    static char read_state = READSTATE_IDLE;
-    static CONFIDENTIAL uint8_t msg_in[MSG_IN_SIZE];
+    static uint8_t* msg_in = NULL;
     static uint16_t msg_id = 0xFFFF;
     static uint32_t msg_size = 0;
     static uint32_t msg_pos = 0;
     static const pb_field_t* fields = 0;
 
     if (len != 64) return;
+    read_last_ms = timer_real_ms();
 
     if (read_state == READSTATE_IDLE) {
         if (buf[0] != '?' || buf[1] != '#' || buf[2] != '#') { // invalid start - discard
@@ -206,11 +276,16 @@ void msg_read_common(char type, const uint8_t* buf, int len)
 
         read_state = READSTATE_READING;
 
+        // drops what an interrupted message left
+        arena_reset();
+        // whole reports are copied, the last one may go past msg_size
+        msg_in = arena_alloc_top(msg_size + 63);
         memcpy(msg_in, buf + 9, len - 9);
         msg_pos = len - 9;
     } else if (read_state == READSTATE_READING) {
         if (buf[0] != '?') { // invalid contents
             read_state = READSTATE_IDLE;
+            arena_reset();
             return;
         }
         memcpy(msg_in + msg_pos, buf + 1, len - 1);
@@ -232,14 +307,57 @@ const uint8_t* msg_out_data(void)
     return data;
 }
 
+#if DEBUG_LINK
+
+const uint8_t* msg_debug_out_data(void)
+{
+    if (msg_debug_out_start == msg_debug_out_end) return 0;
+    uint8_t* data = msg_debug_out + (msg_debug_out_start * 64);
+    msg_debug_out_start = (msg_debug_out_start + 1) % (MSG_DEBUG_OUT_SIZE / 64);
+    return data;
+}
+
+#endif
+
 
 CONFIDENTIAL uint8_t msg_tiny[64];
 uint16_t msg_tiny_id = 0xFFFF;
 
+// First frame of a request received during a long operation, see msg_tiny_defer
+static CONFIDENTIAL uint8_t msg_deferred[64];
+static bool msg_deferred_pending = false;
+static bool msg_defer = false;
+
+void msg_tiny_defer(bool defer)
+{
+    msg_defer = defer;
+}
+
+bool msg_tiny_deferred(void)
+{
+    return msg_deferred_pending;
+}
+
+void msg_read_deferred(void)
+{
+    if (!msg_deferred_pending) {
+        return;
+    }
+    msg_deferred_pending = false;
+    msg_read(msg_deferred, sizeof(msg_deferred));
+    memzero(msg_deferred, sizeof(msg_deferred));
+}
+
 void msg_read_tiny(const uint8_t* buf, int len)
 {
     if (len != 64) return;
     if (buf[0] != '?' || buf[1] != '#' || buf[2] != '#') {
+        if (msg_deferred_pending && buf[0] == '?') {
+            // the rest of the deferred request is being lost to a dialog
+            msg_deferred_pending = false;
+            memzero(msg_deferred, sizeof(msg_deferred));
+            fsm_sendFailure(FailureType_Failure_UnexpectedMessage, _("Unknown message read_tiny"), 0);
+        }
         return;
     }
     uint16_t msg_id = (buf[3] << 8) + buf[4];
@@ -277,6 +395,10 @@ void msg_read_tiny(const uint8_t* buf, int len)
             fsm_sendFailure(FailureType_Failure_DataError, stream.errmsg, 0);
             msg_tiny_id = 0xFFFF;
         }
+    } else if (msg_defer && !msg_deferred_pending && MessageFields('n', 'i', msg_id)) {
+        // leave the request to the main loop, its other frames stay queued
+        memcpy(msg_deferred, buf, sizeof(msg_deferred));
+        msg_deferred_pending = true;
     } else {
         fsm_sendFailure(FailureType_Failure_UnexpectedMessage, _("Unknown message read_tiny"), 0);
         msg_tiny_id = 0xFFFF;
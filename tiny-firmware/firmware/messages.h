@@ -43,9 +43,25 @@ const uint8_t* msg_debug_out_data(void);
 #endif
 
 void msg_read_common(char type, const uint8_t* buf, int len);
+bool msg_read_idle(uint32_t quiet_ms);
 bool msg_write_common(char type, uint16_t msg_id, const void* msg_ptr);
 
 void msg_read_tiny(const uint8_t* buf, int len);
+/**
+ * @brief Keep the first frame of a non-tiny request read by msg_read_tiny
+ * instead of failing it, so that a long operation can poll for Cancel
+ * without dropping requests pipelined by the host
+ */
+void msg_tiny_defer(bool defer);
+/**
+ * @brief Whether a request is waiting for the main loop, reading must stop
+ * until it is replayed so that the rest of its frames stay queued
+ */
+bool msg_tiny_deferred(void);
+/**
+ * @brief Process the deferred frame, called by usbPoll outside of tiny mode
+ */
+void msg_read_deferred(void);
 void msg_debug_read_tiny(const uint8_t* buf, int len);
 extern uint8_t msg_tiny[64];
 extern uint16_t msg_tiny_id;
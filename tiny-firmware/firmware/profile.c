@@ -0,0 +1,64 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "tiny-firmware/firmware/profile.h"
+
+#if PROFILE
+
+#include <string.h>
+
+#include "tiny-firmware/timer.h"
+
+_Static_assert((PROFILE_RING_SIZE & (PROFILE_RING_SIZE - 1)) == 0, "profile ring size must be a power of two");
+
+/* Records live in [tail, head), the counters wrap around */
+static struct {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+    ProfileRecord records[PROFILE_RING_SIZE];
+} profileRing;
+
+void profile_record(ProfilePhase phase, uint16_t id, uint32_t start)
+{
+    uint32_t now = timer_cycles();
+    if (profileRing.head - profileRing.tail == PROFILE_RING_SIZE) {
+        profileRing.tail++;
+        profileRing.dropped++;
+    }
+    ProfileRecord* record = &profileRing.records[profileRing.head & (PROFILE_RING_SIZE - 1)];
+    record->phase = phase;
+    record->id = id;
+    record->start = start;
+    record->cycles = now - start;
+    profileRing.head++;
+}
+
+size_t profile_read(ProfileRecord* records, size_t max, uint32_t* dropped)
+{
+    size_t n = 0;
+    while (n < max && profileRing.tail != profileRing.head) {
+        records[n++] = profileRing.records[profileRing.tail & (PROFILE_RING_SIZE - 1)];
+        profileRing.tail++;
+    }
+    if (dropped != NULL) {
+        *dropped = profileRing.dropped;
+    }
+    profileRing.dropped = 0;
+    return n;
+}
+
+void profile_clear(void)
+{
+    memset(&profileRing, 0, sizeof(profileRing));
+}
+
+#endif // PROFILE
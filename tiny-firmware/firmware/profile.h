@@ -0,0 +1,79 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#ifndef __TINYFIRMWARE_FIRMWARE_PROFILE__
+#define __TINYFIRMWARE_FIRMWARE_PROFILE__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Set by the build, PROFILE=1 is the default of DEBUG_LINK builds
+#ifndef PROFILE
+#define PROFILE 0
+#endif
+
+// Records kept, older ones are overwritten, must be a power of two
+#define PROFILE_RING_SIZE 64
+
+/**
+ * @brief Code being timed, a message handler or one of its phases
+ */
+typedef enum {
+    ProfilePhaseMessage = 0,       /*!< Message handler, id is the message type */
+    ProfilePhaseKeyDerivation = 1, /*!< Key pair derivation */
+    ProfilePhaseSign = 2,          /*!< ECDSA signature */
+    ProfilePhaseFlashCommit = 3,   /*!< Storage written to flash */
+    ProfilePhaseOledRefresh = 4,   /*!< Display buffer sent to the OLED */
+} ProfilePhase;
+
+/**
+ * @brief Timing of a run of a profiled phase, in timer_cycles() units
+ */
+typedef struct {
+    uint16_t phase;
+    uint16_t id;
+    uint32_t start;
+    uint32_t cycles;
+} ProfileRecord;
+
+#if PROFILE
+
+#include "tiny-firmware/timer.h"
+
+/**
+ * @brief Record the end of a profiled phase
+ * @param start timer_cycles() when the phase began
+ */
+void profile_record(ProfilePhase phase, uint16_t id, uint32_t start);
+
+/**
+ * @brief Copy the recorded phases, oldest first, and empty the ring
+ * @param dropped records overwritten since the last read, may be NULL
+ * @return number of records copied, at most max
+ */
+size_t profile_read(ProfileRecord* records, size_t max, uint32_t* dropped);
+
+/**
+ * @brief Forget every record
+ */
+void profile_clear(void);
+
+#define PROFILE_BEGIN(name) uint32_t profile_##name = timer_cycles()
+#define PROFILE_END(name, phase, id) profile_record((phase), (id), profile_##name)
+
+#else
+
+#define PROFILE_BEGIN(name)
+#define PROFILE_END(name, phase, id)
+
+#endif // PROFILE
+
+#endif // __TINYFIRMWARE_FIRMWARE_PROFILE__
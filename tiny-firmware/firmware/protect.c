@@ -112,6 +112,37 @@ bool protectButton(ButtonRequestType type, bool confirm_only)
     return result;
 }
 
+/**
+ * @brief Let the host abort a long operation between two chunks of work
+ * @param desc Progress bar caption, NULL to leave the screen untouched
+ * @param current Amount of work already done
+ * @param total Total amount of work
+ * @return false if Cancel or Initialize was received, the operation must stop
+ */
+bool protectProgress(const char* desc, uint32_t current, uint32_t total)
+{
+    if (desc != NULL && total > 0) {
+        layoutProgress(desc, (int)((uint64_t)current * 1000 / total));
+    }
+    // A request pipelined by the host is handled once the operation is done,
+    // a Cancel sent after it can not overtake it
+    if (!msg_tiny_deferred()) {
+        char oldTiny = usbTiny(1);
+        msg_tiny_defer(true);
+        usbPoll();
+        msg_tiny_defer(false);
+        usbTiny(oldTiny);
+    }
+    if (msg_tiny_id == MessageType_MessageType_Cancel || msg_tiny_id == MessageType_MessageType_Initialize) {
+        if (msg_tiny_id == MessageType_MessageType_Initialize) {
+            protectAbortedByInitialize = true;
+        }
+        msg_tiny_id = 0xFFFF;
+        return false;
+    }
+    return true;
+}
+
 const char* requestPin(PinMatrixRequestType type, const char* text)
 {
     PinMatrixRequest resp;
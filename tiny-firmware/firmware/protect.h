@@ -23,11 +23,13 @@
 
 #include "types.pb.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 bool protectButton(ButtonRequestType type, bool confirm_only);
 bool protectPin(bool use_cached);
 bool protectChangePin(void);
 bool protectPassphrase(void);
+bool protectProgress(const char* desc, uint32_t current, uint32_t total);
 
 extern bool protectAbortedByInitialize;
 
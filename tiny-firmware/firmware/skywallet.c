@@ -24,7 +24,9 @@
 #include "tiny-firmware/firmware/fastflash.h"
 #include "tiny-firmware/firmware/gettext.h"
 #include "tiny-firmware/firmware/layout2.h"
+#include "tiny-firmware/firmware/messages.h"
 #include "tiny-firmware/firmware/storage.h"
+#include "tiny-firmware/firmware/swtimer.h"
 #include "tiny-firmware/gen/bitmaps.h"
 #include "tiny-firmware/layout.h"
 #include "tiny-firmware/oled.h"
@@ -37,6 +39,9 @@
 /* Screen timeout */
 uint32_t system_millis_lock_start;
 
+// Homescreen is locked after 10 minutes
+#define LOCK_SCREEN_TIMEOUT_MS 600000
+
 void check_lock_screen(void)
 {
     buttonUpdate();
@@ -83,13 +88,53 @@ void check_lock_screen(void)
 
     // if homescreen is shown for longer than 10 minutes, lock too
     if (layoutLast == layoutHome) {
-        if ((timer_ms() - system_millis_lock_start) >= 600000) {
+        if ((timer_ms() - system_millis_lock_start) >= LOCK_SCREEN_TIMEOUT_MS) {
             // lock the screen
             session_clear(true);
             layoutScreensaver();
         }
     }
 }
+
+bool check_bip39_seed(void)
+{
+    // Stretch the seed while idle so BIP44 requests do not pay for it
+    return session_stretchBip39Seed(BIP39_SEED_IDLE_ROUNDS);
+}
+
+bool check_address_prefetch(void)
+{
+    // One key pair per iteration, and only while the host is quiet
+    if (!msg_read_idle(ADDRESS_PREFETCH_QUIET_MS)) {
+        return false;
+    }
+    return session_prefetchKeyPair();
+}
+
+uint32_t check_idle_timeout(void)
+{
+    // Long presses are measured in main loop iterations
+    if (button.NoDown || button.YesDown) {
+        return 0;
+    }
+    // Prefetching resumes once the host has been quiet for a while
+    uint32_t timeout = ADDRESS_PREFETCH_QUIET_MS;
+    uint32_t deadline = stopwatch_next_deadline();
+    if (deadline < timeout) {
+        timeout = deadline;
+    }
+    if (layoutLast == layoutHome) {
+        uint32_t elapsed = timer_ms() - system_millis_lock_start;
+        if (elapsed >= LOCK_SCREEN_TIMEOUT_MS) {
+            return 0;
+        }
+        if (LOCK_SCREEN_TIMEOUT_MS - elapsed < timeout) {
+            timeout = LOCK_SCREEN_TIMEOUT_MS - elapsed;
+        }
+    }
+    return timeout;
+}
+
 void check_factory_test(void)
 {
     buttonUpdate();
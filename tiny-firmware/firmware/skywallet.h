@@ -20,6 +20,7 @@
 #ifndef __TREZOR_H__
 #define __TREZOR_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #define STR(X) #X
@@ -29,8 +30,22 @@
 #define DEBUG_LINK 0
 #endif
 
+// PBKDF2 rounds of BIP39 seed stretching run per main loop iteration
+#define BIP39_SEED_IDLE_ROUNDS 16
+
+// Deterministic key pairs derived ahead of time and kept for the session
+#ifndef ADDRESS_PREFETCH_COUNT
+#define ADDRESS_PREFETCH_COUNT 16
+#endif
+
+// Quiet time after the last USB frame before prefetching resumes
+#define ADDRESS_PREFETCH_QUIET_MS 200
+
 void check_lock_screen(void);
 void check_factory_test(void);
+bool check_bip39_seed(void);
+bool check_address_prefetch(void);
+uint32_t check_idle_timeout(void);
 
 /* Screen timeout */
 extern uint32_t system_millis_lock_start;
@@ -0,0 +1,122 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "tiny-firmware/firmware/stackmon.h"
+
+#if PROFILE
+
+#include <stdint.h>
+
+#if !EMULATOR
+// defined by the libopencm3 linker script, the stack grows down from _stack to end
+extern uint8_t end[];
+extern uint8_t _stack[];
+#endif
+
+/* Painted by stackmon_paint, the caller frame is above top */
+static volatile uint8_t* paintLow;
+static volatile uint8_t* paintTop;
+
+/* Free stack painted by stackmon_init up to high, use counts from the stack top */
+static volatile uint8_t* freeLow;
+static volatile uint8_t* freeHigh;
+static volatile uint8_t* freeTop;
+static size_t freePeak;
+
+/* A leaf, its frame fits in the STACKMON_SKIP bytes left by the caller */
+static __attribute__((noinline)) void stackmon_fill(volatile uint8_t* low, volatile uint8_t* high)
+{
+    while (high > low) {
+        *--high = STACKMON_PAINT;
+    }
+}
+
+/* Lowest byte of [low, high) not holding the paint, high when there is none */
+static volatile uint8_t* stackmon_deepest(volatile uint8_t* low, volatile uint8_t* high)
+{
+    while (low < high && *low == STACKMON_PAINT) {
+        low++;
+    }
+    return low;
+}
+
+__attribute__((noinline)) void stackmon_paint(size_t size)
+{
+    volatile uint8_t marker = 0;
+    volatile uint8_t* top = &marker;
+    // the area overlaps the free stack, keep the mark it holds
+    freePeak = stackmon_peak();
+    if (size <= STACKMON_SKIP) {
+        paintLow = paintTop = top;
+        return;
+    }
+    volatile uint8_t* low = top - size;
+#if !EMULATOR
+    if ((uintptr_t)low < (uintptr_t)end) {
+        low = end;
+    }
+#endif
+    stackmon_fill(low, top - STACKMON_SKIP);
+    paintLow = low;
+    paintTop = top;
+}
+
+size_t stackmon_used(void)
+{
+    volatile uint8_t* painted = paintTop - STACKMON_SKIP;
+    volatile uint8_t* p = stackmon_deepest(paintLow, painted);
+    if (p >= painted) {
+        return 0;
+    }
+    return paintTop - p;
+}
+
+__attribute__((noinline)) void stackmon_init(void)
+{
+    volatile uint8_t marker = 0;
+#if EMULATOR
+    freeTop = &marker;
+    freeLow = freeTop - STACKMON_EMULATOR_STACK;
+#else
+    freeTop = _stack;
+    freeLow = end;
+#endif
+    freeHigh = &marker - STACKMON_SKIP;
+    freePeak = 0;
+    stackmon_fill(freeLow, freeHigh);
+}
+
+__attribute__((noinline)) void stackmon_reset(void)
+{
+    volatile uint8_t marker = 0;
+    if (freeLow == NULL) {
+        return;
+    }
+    freeHigh = &marker - STACKMON_SKIP;
+    freePeak = 0;
+    stackmon_fill(freeLow, freeHigh);
+}
+
+size_t stackmon_peak(void)
+{
+    if (freeLow == NULL) {
+        return 0;
+    }
+    size_t used = freeTop - stackmon_deepest(freeLow, freeHigh);
+    return used > freePeak ? used : freePeak;
+}
+
+size_t stackmon_size(void)
+{
+    return freeTop - freeLow;
+}
+
+#endif // PROFILE
@@ -0,0 +1,63 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#ifndef __TINYFIRMWARE_FIRMWARE_STACKMON__
+#define __TINYFIRMWARE_FIRMWARE_STACKMON__
+
+#include <stddef.h>
+
+#include "tiny-firmware/firmware/profile.h"
+
+// Byte painted over the free stack
+#define STACKMON_PAINT 0xA5
+// Bytes right below the caller left unpainted, they hold the painter frame
+#define STACKMON_SKIP 256
+// Stack painted below main by stackmon_init in the emulator, which has no stack bounds
+#define STACKMON_EMULATOR_STACK (64 * 1024)
+
+#if PROFILE
+
+/**
+ * @brief Paint the free stack below the caller so that its use can be measured
+ * @param size bytes to paint, clamped to the free stack on the device
+ */
+void stackmon_paint(size_t size);
+
+/**
+ * @brief Deepest stack use below the stackmon_paint caller since it painted
+ * @return bytes used, STACKMON_SKIP or less is reported as 0
+ */
+size_t stackmon_used(void);
+
+/**
+ * @brief Paint the whole free stack, called once at boot
+ */
+void stackmon_init(void);
+
+/**
+ * @brief Repaint the free stack below the caller and forget the mark
+ */
+void stackmon_reset(void);
+
+/**
+ * @brief Deepest stack use, from the top of the stack, since stackmon_init or stackmon_reset
+ * @return bytes used, the whole stack above the painted area counts as used, 0 before stackmon_init
+ */
+size_t stackmon_peak(void);
+
+/**
+ * @brief Size of the stack watched by stackmon_peak
+ */
+size_t stackmon_size(void);
+
+#endif // PROFILE
+
+#endif // __TINYFIRMWARE_FIRMWARE_STACKMON__
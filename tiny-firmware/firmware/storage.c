@@ -26,14 +26,17 @@
 
 #include "messages.pb.h"
 
+#include "skycoin-crypto/skycoin_crypto.h"
 #include "skycoin-crypto/tools/bip32.h"
 #include "skycoin-crypto/tools/bip39.h"
 #include "skycoin-crypto/tools/hmac.h"
 #include "skycoin-crypto/tools/memzero.h"
 #include "skycoin-crypto/tools/sha2.h"
+#include "tiny-firmware/firmware/addrindex.h"
 #include "tiny-firmware/firmware/entropy.h"
 #include "tiny-firmware/firmware/gettext.h"
 #include "tiny-firmware/firmware/layout2.h"
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/firmware/protect.h"
 #include "tiny-firmware/firmware/skywallet.h"
 #include "tiny-firmware/firmware/storage.h"
@@ -53,7 +56,13 @@ Storage CONFIDENTIAL storageUpdate __attribute__((aligned(4)));
 _Static_assert((sizeof(storageUpdate) & 3) == 0, "storage unaligned");
 
 #define FLASH_STORAGE (FLASH_STORAGE_START + sizeof(storage_magic) + sizeof(storage_uuid))
-#define storageRom ((const Storage*)FLASH_PTR(FLASH_STORAGE))
+#define storageFlash ((const Storage*)FLASH_PTR(FLASH_STORAGE))
+
+/* Storage structure in flash with the settings journal replayed.  It only
+ * mirrors the flash, so it stays out of the tight confidential section.
+ */
+static Storage storageRam __attribute__((aligned(4)));
+#define storageRom ((const Storage*)&storageRam)
 
 // size *2 due to the hex formad and +1 because of the trailing NUL char
 char storage_uuid_str[SERIAL_NUMBER_SIZE * 2 + 1];
@@ -66,10 +75,23 @@ char storage_uuid_str[SERIAL_NUMBER_SIZE * 2 + 1];
  0x0000 |     4 bytes  |  magic = 'stor'
  0x0004 |    12 bytes  |  uuid
  0x0010 |     ? bytes  |  Storage structure
+      ? |     ? bytes  |  settings journal
 --------+--------------+-------------------------------
  0x4000 |     4 kbytes |  area for pin failures
  0x5000 |   256 bytes  |  area for u2f counter updates
- 0x5100 | 11.75 kbytes |  reserved
+ 0x5100 | 11.75 kbytes |  address cache
+
+The settings journal holds the updates of the Storage structure since
+the sector was last erased, so that changing a setting does not erase
+the sector.  Each record is a header word followed by the new content
+of a word aligned range of the structure.  The header is
+offset << 16 | words << 1 | pending.  All the records of an update are
+written with the pending bit set, then the bit of the last one is
+cleared, which commits the whole update at once.  Replaying stops at the
+first erased word.  When the journal is full, or its tail was not
+committed, the sector is compacted: it is erased and rewritten with the
+merged structure.  Updates of the pin, mnemonic or nodes always compact
+the sector, so that no old secret is left behind in the journal.
 
 The area for pin failures looks like this:
 0 ... 0 pinfail 0xffffffff .. 0xffffffff
@@ -83,12 +105,35 @@ followed by a sequence of one-bits.  The bits in a byte are numbered
 from LSB to MSB.  The number of zero bits is the offset that should
 be added to the storage u2f_counter to get the real counter value.
 
+The address cache only holds public data. It starts with a 32 byte tag,
+an HMAC-SHA256 keyed with the mnemonic over the device uuid, followed by
+the 20 byte address hashes of the deterministic chain from index 0 on.
+The key never leaves the storage sector, so the tag can not be used to
+test guesses of the seed.  Devices with passphrase protection do not
+cache addresses, so that hidden wallets leave no trace in flash.
+Entries are appended as they are derived and unwritten ones read as
+0xff.  A cleared tag invalidates the cache until the sector is erased
+again by a wipe or when the pin area is recycled.
+
  */
 
+#define FLASH_STORAGE_JOURNAL (FLASH_STORAGE + sizeof(Storage))
+#define FLASH_STORAGE_JOURNAL_END (FLASH_STORAGE_PINAREA)
+#define STORAGE_JOURNAL_PENDING 1
+#define STORAGE_JOURNAL_HEADER(offset, words) (((offset) << 16) | ((words) << 1) | STORAGE_JOURNAL_PENDING)
+#define STORAGE_JOURNAL_OFFSET(header) ((header) >> 16)
+#define STORAGE_JOURNAL_WORDS(header) (((header)&0xffff) >> 1)
+_Static_assert(sizeof(Storage) < 0x10000, "Storage struct is too large for the journal headers");
 #define FLASH_STORAGE_PINAREA (FLASH_META_START + 0x4000)
 #define FLASH_STORAGE_PINAREA_LEN (0x1000)
 #define FLASH_STORAGE_U2FAREA (FLASH_STORAGE_PINAREA + FLASH_STORAGE_PINAREA_LEN)
 #define FLASH_STORAGE_U2FAREA_LEN (0x100)
+#define FLASH_STORAGE_ADDRCACHE (FLASH_STORAGE_U2FAREA + FLASH_STORAGE_U2FAREA_LEN)
+#define FLASH_STORAGE_ADDRCACHE_LEN (0x2F00)
+#define FLASH_STORAGE_ADDRCACHE_TAG_LEN (SHA256_DIGEST_LENGTH)
+#define FLASH_STORAGE_ADDRCACHE_ENTRIES ((FLASH_STORAGE_ADDRCACHE_LEN - FLASH_STORAGE_ADDRCACHE_TAG_LEN) / ADDRESS_CACHE_HASH_LEN)
+_Static_assert(FLASH_STORAGE_ADDRCACHE + FLASH_STORAGE_ADDRCACHE_LEN == FLASH_META_START + FLASH_META_LEN, "address cache must end with the meta sectors");
+_Static_assert(ADDRESS_CACHE_HASH_LEN % sizeof(uint32_t) == 0, "address cache entries must be word aligned");
 #define FLASH_STORAGE_REALLEN (sizeof(storage_magic) + sizeof(storage_uuid) + sizeof(Storage))
 
 #if !EMULATOR
@@ -102,6 +147,12 @@ _Static_assert(FLASH_STORAGE_START + FLASH_STORAGE_REALLEN <= FLASH_STORAGE_PINA
  */
 static uint32_t storage_u2f_offset;
 
+/* Address of the next record of the settings journal */
+static uint32_t storage_journal_end;
+
+static void storage_journal_load(void);
+static void storage_invalidateAddressCache(void);
+
 static bool sessionSeedCached;
 
 static char CONFIDENTIAL sessionSeed[256];
@@ -111,7 +162,32 @@ static bool sessionPinCached;
 static bool sessionPassphraseCached;
 static char CONFIDENTIAL sessionPassphrase[51];
 
-#define STORAGE_VERSION 9
+/* BIP39 seed of the full seed (mnemonic and passphrase), stretched in the
+ * background once the session is unlocked. The fingerprint identifies the
+ * full seed it was derived from.
+ */
+static CONFIDENTIAL struct {
+    bool started;
+    bool done;
+    uint8_t fingerprint[SHA256_DIGEST_LENGTH];
+    BIP39_SEED_CTX ctx;
+    uint8_t seed[512 / 8];
+} sessionBip39Seed;
+
+/* Public keys of the first deterministic addresses of the full seed, filled
+ * while idle and by foreground derivations. chainSeed continues the chain
+ * right after the last cached entry. Secret keys are never cached, signing
+ * derives them again. The public keys stay out of the confidential section.
+ */
+static CONFIDENTIAL struct {
+    bool started;
+    uint8_t fingerprint[SHA256_DIGEST_LENGTH];
+    uint32_t count;
+    uint8_t chainSeed[SHA256_DIGEST_LENGTH];
+} sessionKeyPairs;
+static uint8_t sessionPubkeys[ADDRESS_PREFETCH_COUNT][33];
+
+#define STORAGE_VERSION 10
 
 void __attribute__((noreturn)) storage_show_error(void)
 {
@@ -147,6 +223,7 @@ bool storage_from_flash(void)
         return storage_from_flash();
     }
 
+    storage_journal_load();
     const uint32_t version = storageRom->version;
     // version 1: since 1.0.0
     // version 2: since 1.2.1
@@ -157,6 +234,7 @@ bool storage_from_flash(void)
     // version 7: since 1.5.1
     // version 8: since 1.5.2
     // version 9: since 1.6.1
+    // version 10: since 1.7.0
     if (version > STORAGE_VERSION) {
         // downgrade -> clear storage
         return false;
@@ -186,6 +264,9 @@ bool storage_from_flash(void)
     } else if (version <= 9) {
         // added u2froot, unfinished_backup and auto_lock_delay_ms
         old_storage_size = OLD_STORAGE_SIZE(auto_lock_delay_ms);
+    } else if (version <= 10) {
+        // added the settings journal after the structure
+        old_storage_size = OLD_STORAGE_SIZE(auto_lock_delay_ms);
     }
 
     // erase newly added fields
@@ -196,6 +277,7 @@ bool storage_from_flash(void)
             flash_write32(FLASH_STORAGE_START + sizeof(storage_magic) + sizeof(storage_uuid) + offset, 0);
         }
         storage_check_flash_errors(svc_flash_lock());
+        storage_journal_load();
     }
 
     if (version <= 5) {
@@ -255,6 +337,10 @@ void session_clear(bool clear_pin)
     memzero(&sessionSeed, sizeof(sessionSeed));
     sessionPassphraseCached = false;
     memzero(&sessionPassphrase, sizeof(sessionPassphrase));
+    memzero(&sessionBip39Seed, sizeof(sessionBip39Seed));
+    memzero(&sessionKeyPairs, sizeof(sessionKeyPairs));
+    memzero(sessionPubkeys, sizeof(sessionPubkeys));
+    addrindex_clear();
     if (clear_pin) {
         sessionPinCached = false;
     }
@@ -269,71 +355,197 @@ static uint32_t storage_flash_words(uint32_t addr, const uint32_t* src, int nwor
     return addr;
 }
 
-// if storage is filled in - update fields that has has_field set to true
-// if storage is NULL - do not backup original content - essentialy a wipe
-static void storage_commit_locked(bool update)
+static bool storage_isErased(uint32_t flash, uint32_t len)
 {
-    if (update) {
-        if (storageUpdate.has_passphrase_protection) {
-            sessionSeedCached = false;
-            sessionPassphraseCached = false;
-        }
-        if (storageUpdate.has_pin) {
-            sessionPinCached = false;
+    const uint32_t* ptr = (const uint32_t*)FLASH_PTR(flash);
+    for (uint32_t i = 0; i < len / sizeof(uint32_t); i++) {
+        if (ptr[i] != 0xffffffff) {
+            return false;
         }
+    }
+    return true;
+}
 
-        storageUpdate.version = STORAGE_VERSION;
-        if (!storageUpdate.has_node && !storageUpdate.has_mnemonic) {
-            storageUpdate.has_node = storageRom->has_node;
-            memcpy(&storageUpdate.node, &storageRom->node, sizeof(StorageHDNode));
-            storageUpdate.has_mnemonic = storageRom->has_mnemonic;
-            strlcpy(storageUpdate.mnemonic, storageRom->mnemonic, sizeof(storageUpdate.mnemonic));
-            storageUpdate.has_u2froot = storageRom->has_u2froot;
-            memcpy(&storageUpdate.u2froot, &storageRom->u2froot, sizeof(StorageHDNode));
-        }
-        if (!storageUpdate.has_passphrase_protection) {
-            storageUpdate.has_passphrase_protection = storageRom->has_passphrase_protection;
-            storageUpdate.passphrase_protection = storageRom->passphrase_protection;
-        }
-        if (!storageUpdate.has_pin) {
-            storageUpdate.has_pin = storageRom->has_pin;
-            strlcpy(storageUpdate.pin, storageRom->pin, sizeof(storageUpdate.pin));
-        } else if (!storageUpdate.pin[0]) {
-            storageUpdate.has_pin = false;
-        }
-        if (!storageUpdate.has_language) {
-            storageUpdate.has_language = storageRom->has_language;
-            strlcpy(storageUpdate.language, storageRom->language, sizeof(storageUpdate.language));
-        }
-        if (!storageUpdate.has_label) {
-            storageUpdate.has_label = storageRom->has_label;
-            strlcpy(storageUpdate.label, storageRom->label, sizeof(storageUpdate.label));
-        } else if (!storageUpdate.label[0]) {
-            storageUpdate.has_label = false;
+/* Load the Storage structure from flash and replay the committed updates of the journal */
+static void storage_journal_load(void)
+{
+    memcpy(&storageRam, storageFlash, sizeof(storageRam));
+    uint32_t flash = FLASH_STORAGE_JOURNAL;
+    uint32_t committed = flash;
+    while (flash + sizeof(uint32_t) <= FLASH_STORAGE_JOURNAL_END) {
+        const uint32_t header = *(const uint32_t*)FLASH_PTR(flash);
+        const uint32_t offset = STORAGE_JOURNAL_OFFSET(header);
+        const uint32_t words = STORAGE_JOURNAL_WORDS(header);
+        if (header == 0xffffffff || words == 0 || (offset & 3) != 0 ||
+            offset + words * sizeof(uint32_t) > sizeof(Storage) ||
+            flash + (1 + words) * sizeof(uint32_t) > FLASH_STORAGE_JOURNAL_END) {
+            break;
         }
-        if (!storageUpdate.has_imported) {
-            storageUpdate.has_imported = storageRom->has_imported;
-            storageUpdate.imported = storageRom->imported;
+        flash += (1 + words) * sizeof(uint32_t);
+        if ((header & STORAGE_JOURNAL_PENDING) == 0) {
+            // last record of an update, apply all of them
+            while (committed < flash) {
+                const uint32_t record = *(const uint32_t*)FLASH_PTR(committed);
+                memcpy((uint8_t*)&storageRam + STORAGE_JOURNAL_OFFSET(record),
+                    FLASH_PTR(committed + sizeof(uint32_t)),
+                    STORAGE_JOURNAL_WORDS(record) * sizeof(uint32_t));
+                committed += (1 + STORAGE_JOURNAL_WORDS(record)) * sizeof(uint32_t);
+            }
         }
-        if (!storageUpdate.has_homescreen) {
-            storageUpdate.has_homescreen = storageRom->has_homescreen;
-            memcpy(&storageUpdate.homescreen, &storageRom->homescreen, sizeof(storageUpdate.homescreen));
-        } else if (storageUpdate.homescreen.size == 0) {
-            storageUpdate.has_homescreen = false;
+    }
+    // an uncommitted or corrupted tail can not be appended to,
+    // leave the journal full so that the next update compacts the sector
+    if (committed == flash && storage_isErased(flash, sizeof(uint32_t))) {
+        storage_journal_end = flash;
+    } else {
+        storage_journal_end = FLASH_STORAGE_JOURNAL_END;
+    }
+}
+
+/* Append the words of newStorage that differ from the current settings to
+ * the journal.  Returns false if they do not fit and the sector has to be
+ * compacted.
+ */
+static bool storage_journal_append_locked(const Storage* newStorage)
+{
+    if (memcmp(FLASH_PTR(FLASH_STORAGE_START), &storage_magic, sizeof(storage_magic)) != 0) {
+        return false;
+    }
+    const uint32_t* current = (const uint32_t*)&storageRam;
+    const uint32_t* update = (const uint32_t*)newStorage;
+    const uint32_t nwords = sizeof(Storage) / sizeof(uint32_t);
+    uint32_t flash = storage_journal_end;
+    uint32_t last = 0;
+    // the first pass only measures the records, the second one writes them
+    for (int pass = 0; pass < 2; pass++) {
+        flash = storage_journal_end;
+        if (pass == 1) {
+            svc_flash_program(FLASH_CR_PROGRAM_X32);
         }
-        if (!storageUpdate.has_u2f_counter) {
-            storageUpdate.has_u2f_counter = storageRom->has_u2f_counter;
-            storageUpdate.u2f_counter = storageRom->u2f_counter;
+        for (uint32_t i = 0; i < nwords;) {
+            if (current[i] == update[i]) {
+                i++;
+                continue;
+            }
+            const uint32_t start = i;
+            // an unchanged word in between costs the same as a new header
+            while (i < nwords && (current[i] != update[i] || (i + 1 < nwords && current[i + 1] != update[i + 1]))) {
+                i++;
+            }
+            if (pass == 1) {
+                flash_write32(flash, STORAGE_JOURNAL_HEADER(start * sizeof(uint32_t), i - start));
+                storage_flash_words(flash + sizeof(uint32_t), update + start, i - start);
+            }
+            last = flash;
+            flash += (1 + i - start) * sizeof(uint32_t);
         }
-        if (!storageUpdate.has_needs_backup) {
-            storageUpdate.has_needs_backup = storageRom->has_needs_backup;
-            storageUpdate.needs_backup = storageRom->needs_backup;
+        if (last == 0) {
+            // nothing changed
+            return true;
         }
-        if (!storageUpdate.has_flags) {
-            storageUpdate.has_flags = storageRom->has_flags;
-            storageUpdate.flags = storageRom->flags;
+        if (pass == 0 && (flash > FLASH_STORAGE_JOURNAL_END || !storage_isErased(storage_journal_end, flash - storage_journal_end))) {
+            return false;
         }
     }
+    // commit the update
+    flash_write32(last, *(const uint32_t*)FLASH_PTR(last) & ~STORAGE_JOURNAL_PENDING);
+    memcpy(&storageRam, newStorage, sizeof(storageRam));
+    storage_journal_end = flash;
+    return true;
+}
+
+/* Whether newStorage changes a secret.  The journal keeps old values until
+ * the sector is erased, so these updates always compact it.
+ */
+static bool storage_changesSecret(const Storage* newStorage)
+{
+    return newStorage->has_pin != storageRam.has_pin ||
+           memcmp(newStorage->pin, storageRam.pin, sizeof(storageRam.pin)) != 0 ||
+           newStorage->has_mnemonic != storageRam.has_mnemonic ||
+           memcmp(newStorage->mnemonic, storageRam.mnemonic, sizeof(storageRam.mnemonic)) != 0 ||
+           newStorage->has_node != storageRam.has_node ||
+           memcmp(&newStorage->node, &storageRam.node, sizeof(storageRam.node)) != 0 ||
+           newStorage->has_u2froot != storageRam.has_u2froot ||
+           memcmp(&newStorage->u2froot, &storageRam.u2froot, sizeof(storageRam.u2froot)) != 0;
+}
+
+/* Complete storageUpdate with the fields that were not set since the last
+ * commit.  The has_field flags of storageUpdate are the dirty flags of
+ * the fields, this must be called only once per commit.
+ */
+static void storage_merge_update(void)
+{
+    if (storageUpdate.has_passphrase_protection) {
+        sessionSeedCached = false;
+        sessionPassphraseCached = false;
+    }
+    if (storageUpdate.has_pin) {
+        sessionPinCached = false;
+    }
+
+    storageUpdate.version = STORAGE_VERSION;
+    if (!storageUpdate.has_node && !storageUpdate.has_mnemonic) {
+        storageUpdate.has_node = storageRom->has_node;
+        memcpy(&storageUpdate.node, &storageRom->node, sizeof(StorageHDNode));
+        storageUpdate.has_mnemonic = storageRom->has_mnemonic;
+        strlcpy(storageUpdate.mnemonic, storageRom->mnemonic, sizeof(storageUpdate.mnemonic));
+        storageUpdate.has_u2froot = storageRom->has_u2froot;
+        memcpy(&storageUpdate.u2froot, &storageRom->u2froot, sizeof(StorageHDNode));
+    }
+    if (!storageUpdate.has_passphrase_protection) {
+        storageUpdate.has_passphrase_protection = storageRom->has_passphrase_protection;
+        storageUpdate.passphrase_protection = storageRom->passphrase_protection;
+    }
+    if (!storageUpdate.has_pin) {
+        storageUpdate.has_pin = storageRom->has_pin;
+        strlcpy(storageUpdate.pin, storageRom->pin, sizeof(storageUpdate.pin));
+    } else if (!storageUpdate.pin[0]) {
+        storageUpdate.has_pin = false;
+    }
+    if (!storageUpdate.has_language) {
+        storageUpdate.has_language = storageRom->has_language;
+        strlcpy(storageUpdate.language, storageRom->language, sizeof(storageUpdate.language));
+    }
+    if (!storageUpdate.has_label) {
+        storageUpdate.has_label = storageRom->has_label;
+        strlcpy(storageUpdate.label, storageRom->label, sizeof(storageUpdate.label));
+    } else if (!storageUpdate.label[0]) {
+        storageUpdate.has_label = false;
+    }
+    if (!storageUpdate.has_imported) {
+        storageUpdate.has_imported = storageRom->has_imported;
+        storageUpdate.imported = storageRom->imported;
+    }
+    if (!storageUpdate.has_homescreen) {
+        storageUpdate.has_homescreen = storageRom->has_homescreen;
+        memcpy(&storageUpdate.homescreen, &storageRom->homescreen, sizeof(storageUpdate.homescreen));
+    } else if (storageUpdate.homescreen.size == 0) {
+        storageUpdate.has_homescreen = false;
+    }
+    if (!storageUpdate.has_u2f_counter) {
+        storageUpdate.has_u2f_counter = storageRom->has_u2f_counter;
+        storageUpdate.u2f_counter = storageRom->u2f_counter;
+    }
+    if (!storageUpdate.has_needs_backup) {
+        storageUpdate.has_needs_backup = storageRom->has_needs_backup;
+        storageUpdate.needs_backup = storageRom->needs_backup;
+    }
+    if (!storageUpdate.has_flags) {
+        storageUpdate.has_flags = storageRom->has_flags;
+        storageUpdate.flags = storageRom->flags;
+    }
+}
+
+// if update is set - storageUpdate holds the merged storage to write
+// otherwise do not backup original content - essentialy a wipe
+static void storage_commit_locked(bool update)
+{
+    PROFILE_BEGIN(commit);
+    if (update && !storage_changesSecret(&storageUpdate) && storage_journal_append_locked(&storageUpdate)) {
+        storage_clear_update();
+        PROFILE_END(commit, ProfilePhaseFlashCommit, 0);
+        return;
+    }
 
     // backup meta
     uint32_t meta_backup[FLASH_META_DESC_LEN / sizeof(uint32_t)];
@@ -357,11 +569,13 @@ static void storage_commit_locked(bool update)
     }
     storage_clear_update();
 
-    // fill remainder with zero for future extensions
-    while (flash < FLASH_STORAGE_PINAREA) {
+    // fill remainder of the structure with zero, the journal stays erased
+    while (flash < FLASH_STORAGE_JOURNAL) {
         flash_write32(flash, 0);
         flash += sizeof(uint32_t);
     }
+    storage_journal_load();
+    PROFILE_END(commit, ProfilePhaseFlashCommit, 1);
 }
 
 void storage_clear_update(void)
@@ -371,6 +585,12 @@ void storage_clear_update(void)
 
 void storage_update(void)
 {
+    storage_merge_update();
+    if (memcmp(&storageUpdate, storageRom, sizeof(storageUpdate)) == 0) {
+        // nothing changed, leave the flash alone
+        storage_clear_update();
+        return;
+    }
     svc_flash_unlock();
     storage_commit_locked(true);
     storage_check_flash_errors(svc_flash_lock());
@@ -395,6 +615,7 @@ static void storage_setNode(const HDNodeType* node)
 void storage_loadDevice(LoadDevice* msg)
 {
     session_clear(true);
+    storage_invalidateAddressCache();
 
     storageUpdate.has_imported = true;
     storageUpdate.imported = true;
@@ -452,6 +673,10 @@ void storage_setPassphraseProtection(bool passphrase_protection)
 {
     sessionSeedCached = false;
     sessionPassphraseCached = false;
+    memzero(&sessionBip39Seed, sizeof(sessionBip39Seed));
+    memzero(&sessionKeyPairs, sizeof(sessionKeyPairs));
+    memzero(sessionPubkeys, sizeof(sessionPubkeys));
+    addrindex_clear();
 
     storageUpdate.has_passphrase_protection = true;
     storageUpdate.passphrase_protection = passphrase_protection;
@@ -499,8 +724,99 @@ const uint8_t* storage_getHomescreen(void)
     return (storageRom->has_homescreen && storageRom->homescreen.size == 1024) ? storageRom->homescreen.bytes : 0;
 }
 
+/* Tag of the address cache of fullSeed, keyed with the seed itself */
+static void storage_addressCacheTag(const char* fullSeed, uint32_t tag[FLASH_STORAGE_ADDRCACHE_TAG_LEN / sizeof(uint32_t)])
+{
+    static const char domain[] = "Skycoin address cache";
+    HMAC_SHA256_CTX ctx;
+    hmac_sha256_Init(&ctx, (const uint8_t*)fullSeed, strlen(fullSeed));
+    hmac_sha256_Update(&ctx, (const uint8_t*)domain, sizeof(domain) - 1);
+    hmac_sha256_Update(&ctx, (const uint8_t*)storage_uuid, sizeof(storage_uuid));
+    hmac_sha256_Final(&ctx, (uint8_t*)tag);
+    memzero(&ctx, sizeof(ctx));
+}
+
+/* Only the plain mnemonic is cached, never a passphrase wallet */
+static bool storage_addressCacheAllowed(const char* fullSeed)
+{
+    const char* mnemonic = storage_getMnemonic();
+    return !storage_hasPassphraseProtection() && mnemonic != NULL && strcmp(fullSeed, mnemonic) == 0;
+}
+
+static uint32_t storage_addressCacheCount(void)
+{
+    uint32_t count = 0;
+    while (count < FLASH_STORAGE_ADDRCACHE_ENTRIES &&
+           !storage_isErased(FLASH_STORAGE_ADDRCACHE + FLASH_STORAGE_ADDRCACHE_TAG_LEN + count * ADDRESS_CACHE_HASH_LEN, ADDRESS_CACHE_HASH_LEN)) {
+        count++;
+    }
+    return count;
+}
+
+const uint8_t* storage_getAddressCache(const char* fullSeed, uint32_t* count)
+{
+    uint32_t tag[FLASH_STORAGE_ADDRCACHE_TAG_LEN / sizeof(uint32_t)];
+    *count = 0;
+    if (!storage_addressCacheAllowed(fullSeed)) {
+        return NULL;
+    }
+    storage_addressCacheTag(fullSeed, tag);
+    if (memcmp(tag, FLASH_PTR(FLASH_STORAGE_ADDRCACHE), sizeof(tag)) != 0) {
+        return NULL;
+    }
+    *count = storage_addressCacheCount();
+    return FLASH_PTR(FLASH_STORAGE_ADDRCACHE + FLASH_STORAGE_ADDRCACHE_TAG_LEN);
+}
+
+void storage_appendAddressCache(const char* fullSeed, uint32_t index, const uint8_t* hash)
+{
+    uint32_t tag[FLASH_STORAGE_ADDRCACHE_TAG_LEN / sizeof(uint32_t)];
+    uint32_t entry[ADDRESS_CACHE_HASH_LEN / sizeof(uint32_t)];
+    if (index >= FLASH_STORAGE_ADDRCACHE_ENTRIES || !storage_addressCacheAllowed(fullSeed)) {
+        return;
+    }
+    storage_addressCacheTag(fullSeed, tag);
+    bool empty = storage_isErased(FLASH_STORAGE_ADDRCACHE, sizeof(tag));
+    // The cache belongs to another full seed or was invalidated
+    if (!empty && memcmp(tag, FLASH_PTR(FLASH_STORAGE_ADDRCACHE), sizeof(tag)) != 0) {
+        return;
+    }
+    // Append only, so that no entry is ever programmed twice
+    if (index != (empty ? 0 : storage_addressCacheCount())) {
+        return;
+    }
+    memcpy(entry, hash, sizeof(entry));
+    svc_flash_unlock();
+    svc_flash_program(FLASH_CR_PROGRAM_X32);
+    if (empty) {
+        storage_flash_words(FLASH_STORAGE_ADDRCACHE, tag, sizeof(tag) / sizeof(uint32_t));
+    }
+    storage_flash_words(FLASH_STORAGE_ADDRCACHE + FLASH_STORAGE_ADDRCACHE_TAG_LEN + index * ADDRESS_CACHE_HASH_LEN,
+        entry, sizeof(entry) / sizeof(uint32_t));
+    storage_check_flash_errors(svc_flash_lock());
+}
+
+/* Clear the tag, entries stay unusable until the sector is erased */
+static void storage_invalidateAddressCache(void)
+{
+    if (storage_isErased(FLASH_STORAGE_ADDRCACHE, FLASH_STORAGE_ADDRCACHE_TAG_LEN)) {
+        return;
+    }
+    svc_flash_unlock();
+    svc_flash_program(FLASH_CR_PROGRAM_X32);
+    for (uint32_t flash = FLASH_STORAGE_ADDRCACHE; flash < FLASH_STORAGE_ADDRCACHE + FLASH_STORAGE_ADDRCACHE_TAG_LEN; flash += sizeof(uint32_t)) {
+        flash_write32(flash, 0);
+    }
+    storage_check_flash_errors(svc_flash_lock());
+}
+
 void storage_setMnemonic(const char* mnemonic)
 {
+    memzero(&sessionBip39Seed, sizeof(sessionBip39Seed));
+    memzero(&sessionKeyPairs, sizeof(sessionKeyPairs));
+    memzero(sessionPubkeys, sizeof(sessionPubkeys));
+    addrindex_clear();
+    storage_invalidateAddressCache();
     storageUpdate.has_mnemonic = true;
     strlcpy(storageUpdate.mnemonic, mnemonic, sizeof(storageUpdate.mnemonic));
 }
@@ -527,6 +843,141 @@ const char* storage_getFullSeed(void)
     return storage_getMnemonic();
 }
 
+/* Restart the BIP39 seed stretching unless it already belongs to fullSeed */
+static void session_selectBip39Seed(const char* fullSeed)
+{
+    uint8_t fingerprint[SHA256_DIGEST_LENGTH];
+    sha256_Raw((const uint8_t*)fullSeed, strlen(fullSeed), fingerprint);
+    if (!sessionBip39Seed.started || memcmp(fingerprint, sessionBip39Seed.fingerprint, sizeof(fingerprint)) != 0) {
+        memzero(&sessionBip39Seed, sizeof(sessionBip39Seed));
+        mnemonic_to_seed_Init(&sessionBip39Seed.ctx, fullSeed, "");
+        memcpy(sessionBip39Seed.fingerprint, fingerprint, sizeof(fingerprint));
+        sessionBip39Seed.started = true;
+    }
+    memzero(fingerprint, sizeof(fingerprint));
+}
+
+/* Whether the full seed is available without asking for PIN or passphrase */
+static bool session_isUnlocked(void)
+{
+    if (!storage_hasMnemonic() || (storage_hasPin() && !sessionPinCached)) {
+        return false;
+    }
+    return !storage_hasPassphraseProtection() || sessionPassphraseCached;
+}
+
+bool session_stretchBip39Seed(uint32_t rounds)
+{
+    // Never ask for PIN or passphrase from the background
+    if (!session_isUnlocked()) {
+        return false;
+    }
+    if (sessionBip39Seed.done) {
+        return false;
+    }
+    // The fingerprint is taken only when stretching starts, changes of mnemonic
+    // or passphrase wipe the context, see session_getBip39Seed for the full check
+    if (!sessionBip39Seed.started) {
+        session_selectBip39Seed(storage_getFullSeed());
+    }
+    if (mnemonic_to_seed_Update(&sessionBip39Seed.ctx, rounds)) {
+        mnemonic_to_seed_Final(&sessionBip39Seed.ctx, sessionBip39Seed.seed);
+        sessionBip39Seed.done = true;
+    }
+    return true;
+}
+
+bool session_getBip39Seed(uint8_t seed[512 / 8], bool (*progress_callback)(uint32_t current, uint32_t total))
+{
+    session_selectBip39Seed(storage_getFullSeed());
+    while (!sessionBip39Seed.done) {
+        // On abort the rounds done so far are kept for the next attempt
+        if (progress_callback && !progress_callback(sessionBip39Seed.ctx.rounds, BIP39_PBKDF2_ROUNDS)) {
+            return false;
+        }
+        if (mnemonic_to_seed_Update(&sessionBip39Seed.ctx, BIP39_PBKDF2_ROUNDS / 16)) {
+            mnemonic_to_seed_Final(&sessionBip39Seed.ctx, sessionBip39Seed.seed);
+            sessionBip39Seed.done = true;
+        }
+    }
+    memcpy(seed, sessionBip39Seed.seed, sizeof(sessionBip39Seed.seed));
+    return true;
+}
+
+/* Drop the cached key pairs unless they belong to fullSeed */
+static void session_selectKeyPairs(const char* fullSeed)
+{
+    uint8_t fingerprint[SHA256_DIGEST_LENGTH];
+    sha256_Raw((const uint8_t*)fullSeed, strlen(fullSeed), fingerprint);
+    if (!sessionKeyPairs.started || memcmp(fingerprint, sessionKeyPairs.fingerprint, sizeof(fingerprint)) != 0) {
+        // The index may already hold BIP44 addresses of this same seed
+        if (sessionKeyPairs.started) {
+            addrindex_clear();
+        }
+        memzero(&sessionKeyPairs, sizeof(sessionKeyPairs));
+        memzero(sessionPubkeys, sizeof(sessionPubkeys));
+        memcpy(sessionKeyPairs.fingerprint, fingerprint, sizeof(fingerprint));
+        sessionKeyPairs.started = true;
+    }
+    memzero(fingerprint, sizeof(fingerprint));
+}
+
+uint32_t session_getCachedKeyPairs(const char* fullSeed, uint8_t chainSeed[32])
+{
+    session_selectKeyPairs(fullSeed);
+    memcpy(chainSeed, sessionKeyPairs.chainSeed, sizeof(sessionKeyPairs.chainSeed));
+    return sessionKeyPairs.count;
+}
+
+bool session_getCachedKeyPair(uint32_t index, uint8_t* pubkey)
+{
+    if (index >= sessionKeyPairs.count) {
+        return false;
+    }
+    memcpy(pubkey, sessionPubkeys[index], sizeof(sessionPubkeys[index]));
+    return true;
+}
+
+void session_cacheKeyPair(uint32_t index, const uint8_t* pubkey, const uint8_t nextSeed[32])
+{
+    // Only extend the chain, entries are never replaced
+    if (index != sessionKeyPairs.count || index >= ADDRESS_PREFETCH_COUNT) {
+        return;
+    }
+    memcpy(sessionPubkeys[index], pubkey, sizeof(sessionPubkeys[index]));
+    memcpy(sessionKeyPairs.chainSeed, nextSeed, sizeof(sessionKeyPairs.chainSeed));
+    sessionKeyPairs.count++;
+}
+
+bool session_prefetchKeyPair(void)
+{
+    // Never ask for PIN or passphrase from the background
+    if (!session_isUnlocked() || sessionKeyPairs.count >= ADDRESS_PREFETCH_COUNT) {
+        return false;
+    }
+    const char* fullSeed = storage_getFullSeed();
+    uint8_t chainSeed[SHA256_DIGEST_LENGTH];
+    uint8_t nextSeed[SHA256_DIGEST_LENGTH];
+    uint8_t pubkey[33];
+    uint8_t seckey[32];
+    uint32_t index = session_getCachedKeyPairs(fullSeed, chainSeed);
+    int ret = index == 0 ?
+                  deterministic_key_pair_iterator((const uint8_t*)fullSeed, strlen(fullSeed), nextSeed, seckey, pubkey) :
+                  deterministic_key_pair_iterator(chainSeed, sizeof(chainSeed), nextSeed, seckey, pubkey);
+    if (ret == 0) {
+        session_cacheKeyPair(index, pubkey, nextSeed);
+        uint8_t hash[ADDRESS_CACHE_HASH_LEN];
+        AddressPath path = {.bip44 = false, .index = index};
+        skycoin_address_hash_from_pubkey(pubkey, hash);
+        storage_appendAddressCache(fullSeed, index, hash);
+        addrindex_add(hash, &path);
+    }
+    memzero(chainSeed, sizeof(chainSeed));
+    memzero(nextSeed, sizeof(nextSeed));
+    memzero(seckey, sizeof(seckey));
+    return ret == 0;
+}
+
 const char* storage_getMnemonic(void)
 {
     return storageUpdate.has_mnemonic ? storageUpdate.mnemonic : storageRom->has_mnemonic ? storageRom->mnemonic : 0;
@@ -588,6 +1039,10 @@ void session_cachePassphrase(const char* passphrase)
 {
     strlcpy(sessionPassphrase, passphrase, sizeof(sessionPassphrase));
     sessionPassphraseCached = true;
+    memzero(&sessionBip39Seed, sizeof(sessionBip39Seed));
+    memzero(&sessionKeyPairs, sizeof(sessionKeyPairs));
+    memzero(sessionPubkeys, sizeof(sessionPubkeys));
+    addrindex_clear();
 }
 
 bool session_isPassphraseCached(void)
@@ -662,6 +1117,7 @@ static void storage_area_recycle(uint32_t new_pinfails)
     storageUpdate.has_u2f_counter = true;
     storageUpdate.u2f_counter += storage_u2f_offset;
     storage_u2f_offset = 0;
+    storage_merge_update();
     storage_commit_locked(true);
 }
 
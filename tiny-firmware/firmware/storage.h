@@ -47,6 +47,9 @@
 
 #define DEVICE_LABEL_SIZE 33
 
+// Address hashes kept in the flash address cache, ripemd160 digests
+#define ADDRESS_CACHE_HASH_LEN 20
+
 typedef struct {
     uint32_t depth;
     uint32_t fingerprint;
@@ -107,8 +110,17 @@ void storage_setHomescreen(const uint8_t* data, uint32_t size);
 
 void session_cachePassphrase(const char* passphrase);
 bool session_isPassphraseCached(void);
+bool session_stretchBip39Seed(uint32_t rounds);
+bool session_getBip39Seed(uint8_t seed[512 / 8], bool (*progress_callback)(uint32_t current, uint32_t total));
+uint32_t session_getCachedKeyPairs(const char* fullSeed, uint8_t chainSeed[32]);
+bool session_getCachedKeyPair(uint32_t index, uint8_t* pubkey);
+void session_cacheKeyPair(uint32_t index, const uint8_t* pubkey, const uint8_t nextSeed[32]);
+bool session_prefetchKeyPair(void);
 bool session_getState(const uint8_t* salt, uint8_t* state, const char* passphrase);
 
+const uint8_t* storage_getAddressCache(const char* fullSeed, uint32_t* count);
+void storage_appendAddressCache(const char* fullSeed, uint32_t index, const uint8_t* hash);
+
 void storage_setMnemonic(const char* mnemonic);
 bool storage_containsMnemonic(const char* mnemonic);
 bool storage_hasMnemonic(void);
@@ -31,8 +31,8 @@ uint32_t stopwatch_counter_impl(TIMER* t, uint32_t ticks)
     if (!t->active) {
         return INFINITE_TS;
     }
-    // FIXME: Conditional statement needed ?
-    uint32_t counter = (ticks > t->checkpoint) ? ticks - t->checkpoint : UINT32_MAX - ticks + t->checkpoint;
+    // Unsigned arithmetic handles the wrap around, and no tick elapsed is 0
+    uint32_t counter = ticks - t->checkpoint;
     if (!t->delay) {
         // Ascending counter
         return counter;
@@ -57,6 +57,22 @@ void stopwatch_close_impl(TIMER* t)
     t->delay = 0;
 }
 
+uint32_t stopwatch_next_deadline_impl(TIMER* timers, int count, uint32_t ticks)
+{
+    uint32_t next = INFINITE_TS;
+    for (int i = 0; i < count; ++i) {
+        // Ascending counters have no deadline
+        if (!timers[i].active || !timers[i].delay) {
+            continue;
+        }
+        uint32_t left = stopwatch_counter_impl(timers + i, ticks);
+        if (left < next) {
+            next = left;
+        }
+    }
+    return next;
+}
+
 /************************************
  * Public API functions
  ************************************/
@@ -106,3 +122,11 @@ void stopwatch_close(SWTIMER timer)
         stopwatch_close_impl(sw_timers + timer);
     }
 }
+
+/*
+ * Ticks left until the first countdown timer reaches zero
+ */
+uint32_t stopwatch_next_deadline(void)
+{
+    return stopwatch_next_deadline_impl(sw_timers, MAX_TIMERS, timer_ms());
+}
@@ -25,5 +25,6 @@ SWTIMER stopwatch_start(uint32_t timeout);
 uint32_t stopwatch_counter(SWTIMER);
 void stopwatch_reset(SWTIMER);
 void stopwatch_close(SWTIMER);
+uint32_t stopwatch_next_deadline(void);
 
 #endif
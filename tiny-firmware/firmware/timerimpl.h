@@ -30,5 +30,6 @@ void stopwatch_start_impl(TIMER* t, uint32_t timeout, uint32_t ticks);
 uint32_t stopwatch_counter_impl(TIMER*, uint32_t ticks);
 void stopwatch_reset_impl(TIMER*, uint32_t ticks);
 void stopwatch_close_impl(TIMER*);
+uint32_t stopwatch_next_deadline_impl(TIMER* timers, int count, uint32_t ticks);
 
 #endif
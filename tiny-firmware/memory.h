@@ -116,6 +116,11 @@ void memory_protect(void);
 void memory_write_unlock(void);
 int memory_bootloader_hash(uint8_t* hash);
 
+#if EMULATOR
+// programming can only clear bits, the emulator reports an error otherwise
+void flash_write32(uint32_t addr, uint32_t word);
+void flash_write8(uint32_t addr, uint8_t byte);
+#else
 static inline void flash_write32(uint32_t addr, uint32_t word)
 {
     *(volatile uint32_t*)FLASH_PTR(addr) = word;
@@ -125,6 +130,7 @@ static inline void flash_write8(uint32_t addr, uint8_t byte)
 {
     *(volatile uint8_t*)FLASH_PTR(addr) = byte;
 }
+#endif
 
 /**
  * @brief memory_rdp_level	Reference STM32F205 Flash programming manual
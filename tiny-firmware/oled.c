@@ -22,6 +22,7 @@
 
 #include <string.h>
 
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/oled.h"
 #include "tiny-firmware/util.h"
 
@@ -46,6 +47,8 @@
 #define OLED_COMSCANDEC 0xC8
 #define OLED_SEGREMAP 0xA0
 #define OLED_CHARGEPUMP 0x8D
+#define OLED_COLUMNADDR 0x21
+#define OLED_PAGEADDR 0x22
 
 #define SPI_BASE SPI1
 #define OLED_DC_PORT GPIOB
@@ -66,6 +69,21 @@
 static uint8_t _oledbuffer[OLED_BUFSIZE];
 static bool is_debug_link = 0;
 
+/* Every write to _oledbuffer sets the bit of its page, a group of
+ * OLED_WIDTH bytes, in _oleddirty. Refresh compares only the dirty pages
+ * with _oledshown, the contents of the display, and sends the pages that
+ * really changed. Screens are usually cleared and drawn again, so most dirty
+ * pages end up equal to what is shown.
+ */
+#define OLED_PAGES (OLED_HEIGHT / 8)
+#define OLED_DIRTY_ALL ((1 << OLED_PAGES) - 1)
+#define OLED_DIRTY(offset) (_oleddirty |= 1 << ((offset) / OLED_WIDTH))
+
+static uint8_t _oledshown[OLED_BUFSIZE];
+static uint8_t _oleddirty = OLED_DIRTY_ALL;
+// the display memory is unknown until the first refresh
+static bool _oledshown_valid = false;
+
 /*
  * macros to convert coordinate to bit position
  */
@@ -82,8 +100,10 @@ void oledDrawPixel(int x, int y)
     }
 #if REVERSE_SCREEN
     _oledbuffer[OLED_OFFSET(127 - x, 63 - y)] |= OLED_MASK(127 - x, 63 - y);
+    OLED_DIRTY(OLED_OFFSET(127 - x, 63 - y));
 #else
     _oledbuffer[OLED_OFFSET(x, y)] |= OLED_MASK(x, y);
+    OLED_DIRTY(OLED_OFFSET(x, y));
 #endif
 }
 
@@ -97,8 +117,10 @@ void oledClearPixel(int x, int y)
     }
 #if REVERSE_SCREEN
     _oledbuffer[OLED_OFFSET(127 - x, 63 - y)] &= ~OLED_MASK(127 - x, 63 - y);
+    OLED_DIRTY(OLED_OFFSET(127 - x, 63 - y));
 #else
     _oledbuffer[OLED_OFFSET(x, y)] &= ~OLED_MASK(x, y);
+    OLED_DIRTY(OLED_OFFSET(x, y));
 #endif
 }
 
@@ -112,8 +134,10 @@ void oledInvertPixel(int x, int y)
     }
 #if REVERSE_SCREEN
     _oledbuffer[OLED_OFFSET(127 - x, 63 - y)] ^= OLED_MASK(127 - x, 63 - y);
+    OLED_DIRTY(OLED_OFFSET(127 - x, 63 - y));
 #else
     _oledbuffer[OLED_OFFSET(x, y)] ^= OLED_MASK(x, y);
+    OLED_DIRTY(OLED_OFFSET(x, y));
 #endif
 }
 
@@ -191,6 +215,7 @@ void oledInit()
 void oledClear()
 {
     memset(_oledbuffer, 0, sizeof(_oledbuffer));
+    _oleddirty = OLED_DIRTY_ALL;
 }
 
 void oledInvertDebugLink()
@@ -214,6 +239,32 @@ void oledInvertDebugLink()
     }
 }
 
+/*
+ * Returns the mask of the pages that differ from the display, bit n for
+ * the n-th group of OLED_WIDTH bytes of the buffer, and records them as
+ * shown. Only the dirty pages are compared.
+ */
+uint8_t oledChangedPages(void)
+{
+    uint8_t changed = 0;
+    if (!_oledshown_valid) {
+        _oleddirty = OLED_DIRTY_ALL;
+    }
+    for (int page = 0; page < OLED_PAGES; page++) {
+        const uint8_t* data = _oledbuffer + page * OLED_WIDTH;
+        uint8_t* shown = _oledshown + page * OLED_WIDTH;
+        if (!(_oleddirty & (1 << page)) ||
+            (_oledshown_valid && memcmp(data, shown, OLED_WIDTH) == 0)) {
+            continue;
+        }
+        memcpy(shown, data, OLED_WIDTH);
+        changed |= 1 << page;
+    }
+    _oleddirty = 0;
+    _oledshown_valid = true;
+    return changed;
+}
+
 /*
  * Refresh the display. This copies the buffer to the display to show the
  * contents.  This must be called after every operation to the buffer to
@@ -223,23 +274,38 @@ void oledInvertDebugLink()
 #if !EMULATOR
 void oledRefresh()
 {
-    static const uint8_t s[3] = {OLED_SETLOWCOLUMN | 0x00, OLED_SETHIGHCOLUMN | 0x00, OLED_SETSTARTLINE | 0x00};
+    PROFILE_BEGIN(refresh);
 
     // draw triangle in upper right corner
     oledInvertDebugLink();
 
-    gpio_clear(OLED_CS_PORT, OLED_CS_PIN); // SPI select
-    SPISend(SPI_BASE, s, 3);
-    gpio_set(OLED_CS_PORT, OLED_CS_PIN); // SPI deselect
-
-    gpio_set(OLED_DC_PORT, OLED_DC_PIN);   // set to DATA
-    gpio_clear(OLED_CS_PORT, OLED_CS_PIN); // SPI select
-    SPISend(SPI_BASE, _oledbuffer, sizeof(_oledbuffer));
-    gpio_set(OLED_CS_PORT, OLED_CS_PIN);   // SPI deselect
-    gpio_clear(OLED_DC_PORT, OLED_DC_PIN); // set to CMD
+    // send every run of consecutive changed pages in one window
+    uint8_t pages = oledChangedPages();
+    for (int first = 0; first < OLED_PAGES; first++) {
+        if (!(pages & (1 << first))) {
+            continue;
+        }
+        int last = first;
+        while (last + 1 < OLED_PAGES && (pages & (1 << (last + 1)))) {
+            last++;
+        }
+        const uint8_t s[7] = {OLED_SETSTARTLINE | 0x00, OLED_COLUMNADDR, 0, OLED_WIDTH - 1, OLED_PAGEADDR, first, last};
+
+        gpio_clear(OLED_CS_PORT, OLED_CS_PIN); // SPI select
+        SPISend(SPI_BASE, s, sizeof(s));
+        gpio_set(OLED_CS_PORT, OLED_CS_PIN); // SPI deselect
+
+        gpio_set(OLED_DC_PORT, OLED_DC_PIN);   // set to DATA
+        gpio_clear(OLED_CS_PORT, OLED_CS_PIN); // SPI select
+        SPISend(SPI_BASE, _oledbuffer + first * OLED_WIDTH, (last - first + 1) * OLED_WIDTH);
+        gpio_set(OLED_CS_PORT, OLED_CS_PIN);   // SPI deselect
+        gpio_clear(OLED_DC_PORT, OLED_DC_PIN); // set to CMD
+        first = last;
+    }
 
     // return it back
     oledInvertDebugLink();
+    PROFILE_END(refresh, ProfilePhaseOledRefresh, 0);
 }
 #endif
 
@@ -251,12 +317,15 @@ const uint8_t* oledGetBuffer()
 void oledSetDebugLink(bool set)
 {
     is_debug_link = set;
+    // the triangle may have to be removed from a page that did not change
+    _oleddirty = OLED_DIRTY_ALL;
     oledRefresh();
 }
 
 void oledSetBuffer(uint8_t* buf)
 {
     memcpy(_oledbuffer, buf, sizeof(_oledbuffer));
+    _oleddirty = OLED_DIRTY_ALL;
 }
 
 void oledDrawChar(int x, int y, char c, int font)
@@ -420,6 +489,7 @@ void oledSwipeLeft(void)
             }
             _oledbuffer[j * OLED_WIDTH] = 0;
         }
+        _oleddirty = OLED_DIRTY_ALL;
         oledRefresh();
     }
 }
@@ -443,6 +513,7 @@ void oledSwipeRight(void)
             _oledbuffer[j * OLED_WIDTH + OLED_WIDTH - 3] = 0;
             _oledbuffer[j * OLED_WIDTH + OLED_WIDTH - 4] = 0;
         }
+        _oleddirty = OLED_DIRTY_ALL;
         oledRefresh();
     }
 }
@@ -33,6 +33,7 @@
 void oledInit(void);
 void oledClear(void);
 void oledRefresh(void);
+uint8_t oledChangedPages(void);
 
 void oledSetDebugLink(bool set);
 void oledInvertDebugLink(void);
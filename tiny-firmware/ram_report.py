@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# RAM used by the firmware, per output section, per object file and per
+# symbol, read from the map the linker writes with -Wl,-Map.
+
+from __future__ import print_function
+import argparse
+import json
+import os
+import re
+import sys
+
+REGION_RE = re.compile(r'^(\S+)\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)')
+OUTPUT_RE = re.compile(r'^(\.?[\w.]+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+))?\s*(?:load address.*)?$')
+INPUT_RE = re.compile(r'^ (\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s*(.*))?$')
+CONTINUED_RE = re.compile(r'^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s*(.*)$')
+SYMBOL_RE = re.compile(r'^\s+0x([0-9a-f]+)\s+([A-Za-z_]\w*)$')
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description='RAM used by the firmware, from the linker map.')
+    parser.add_argument('map', help="Map written by the linker with -Wl,-Map")
+    parser.add_argument('-m', '--memory', dest='memory', default='ram', help="Memory region of the RAM in the map")
+    parser.add_argument('-n', '--top', dest='top', type=int, default=20, help="Largest symbols listed")
+    parser.add_argument('-j', '--json', dest='json', action='store_true', help="Print JSON instead of tables")
+    return parser.parse_args()
+
+
+def read_map(path, memory):
+    """RAM region and the input sections placed in it"""
+    region = None
+    sections = []
+    output = None
+    pending = None
+    in_regions = in_layout = False
+    with open(path) as fp:
+        lines = fp.read().splitlines()
+    for line in lines:
+        if line.startswith('Memory Configuration'):
+            in_regions = True
+            continue
+        if line.startswith('Linker script and memory map'):
+            in_regions, in_layout = False, True
+            continue
+        if in_regions:
+            m = REGION_RE.match(line)
+            if m and m.group(1) == memory:
+                region = (int(m.group(2), 16), int(m.group(3), 16))
+            continue
+        if not in_layout or not line.strip():
+            continue
+        if not line.startswith(' '):
+            m = OUTPUT_RE.match(line)
+            output = m.group(1) if m else None
+            pending = None
+            continue
+        if output is None:
+            continue
+        # long input section names leave address, size and file to the next line
+        if pending is not None:
+            m = CONTINUED_RE.match(line)
+            if m:
+                sections.append(section(output, pending, m.group(1), m.group(2), m.group(3)))
+                pending = None
+                continue
+            pending = None
+        m = SYMBOL_RE.match(line)
+        if m:
+            # name the sections holding several variables after their first symbol
+            if sections and sections[-1]['symbol'] is None and sections[-1]['address'] == int(m.group(1), 16):
+                sections[-1]['symbol'] = m.group(2)
+            continue
+        m = INPUT_RE.match(line)
+        if not m or m.group(1).startswith('*(') or m.group(1).startswith('0x'):
+            continue
+        if m.group(2) is None:
+            pending = m.group(1)
+        else:
+            sections.append(section(output, m.group(1), m.group(2), m.group(3), m.group(4)))
+    if region is None:
+        raise Exception("no memory region %s in %s" % (memory, path))
+    start, length = region
+    return region, [s for s in sections if start <= s['address'] < start + length and s['size'] > 0]
+
+
+def section(output, name, address, size, origin):
+    symbol = None
+    for prefix in ('.bss.', '.data.', '.rodata.'):
+        if name.startswith(prefix):
+            symbol = name[len(prefix):]
+    if name == '*fill*':
+        symbol = origin = '(padding)'
+    return {'output': output, 'name': name, 'symbol': symbol, 'address': int(address, 16),
+            'size': int(size, 16), 'object': os.path.basename(origin.strip())}
+
+
+def totals(sections, key):
+    sums = {}
+    for s in sections:
+        sums[s[key]] = sums.get(s[key], 0) + s['size']
+    return sorted(sums.items(), key=lambda kv: -kv[1])
+
+
+def main(args):
+    (start, length), sections = read_map(args.map, args.memory)
+    used = max([s['address'] + s['size'] for s in sections] or [start]) - start
+    by_output = totals(sections, 'output')
+    by_object = totals(sections, 'object')
+    largest = sorted([s for s in sections if s['symbol'] != '(padding)'], key=lambda s: -s['size'])[:args.top]
+
+    if args.json:
+        print(json.dumps({'origin': start, 'length': length, 'used': used, 'stack': length - used,
+                          'sections': dict(by_output), 'objects': dict(by_object),
+                          'largest': [{'symbol': s['symbol'] or s['name'], 'size': s['size'], 'section': s['output'],
+                                       'object': s['object']} for s in largest]}, indent=2))
+        return 0
+
+    print("RAM at 0x%08x: %d bytes, %d used, %d left for the stack" % (start, length, used, length - used))
+    print("")
+    print("%-32s %8s" % ('section', 'bytes'))
+    for name, size in by_output:
+        print("%-32s %8d" % (name, size))
+    print("")
+    print("%-32s %8s" % ('object', 'bytes'))
+    for name, size in by_object:
+        print("%-32s %8d" % (name, size))
+    print("")
+    print("%-40s %8s  %-14s %s" % ('symbol', 'bytes', 'section', 'object'))
+    for s in largest:
+        print("%-40s %8d  %-14s %s" % (s['symbol'] or s['name'], s['size'], s['output'], s['object']))
+    return 0
+
+
+if __name__ == '__main__':
+    args = parse_args()
+    sys.exit(main(args))
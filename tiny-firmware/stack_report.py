@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Worst-case stack use of the FSM handlers, from the frame sizes gcc writes
+# with -fstack-usage (*.su) and the call graph disassembled from the firmware.
+
+from __future__ import print_function
+import argparse
+import json
+import re
+import subprocess
+import sys
+
+FUNC_RE = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+# direct calls and branches to the start of another function (tail calls)
+CALL_RE = re.compile(r'\t(bl|call|jmp|b(?:eq|ne|cs|hs|cc|lo|mi|pl|vs|vc|hi|ls|ge|lt|gt|le)?(?:\.[nw])?)\s+[0-9a-f]+ <([^>+]+)>')
+INDIRECT_RE = re.compile(r'\t(blx|bx|call|jmp)\s+(r\d+|ip|\*)')
+SYMBOL_RE = re.compile(r'^([0-9a-f]+)\s.*\s(\S+)$')
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description='Worst-case stack use of every FSM handler, dispatch from main included.')
+    parser.add_argument('-e', '--elf', dest='elf', help="Linked firmware", required=True)
+    parser.add_argument('-o', '--objdump', dest='objdump', default='arm-none-eabi-objdump', help="objdump of the toolchain")
+    parser.add_argument('-r', '--root', dest='root', default='^fsm_msg', help="Regular expression of the functions to report")
+    parser.add_argument('-d', '--dispatch', dest='dispatch', default='MessageProcessFunc', help="Function calling the reported ones through a pointer")
+    parser.add_argument('-l', '--limit', dest='limit', type=int, help="Fail when a reported function may use more bytes")
+    parser.add_argument('-j', '--json', dest='json', action='store_true', help="Print JSON instead of a table")
+    parser.add_argument('su', nargs='+', help="Stack usage files written by gcc -fstack-usage")
+    return parser.parse_args()
+
+
+def read_frames(paths):
+    # file.c:line:column:function<TAB>bytes<TAB>static|dynamic|dynamic,bounded
+    frames = {}
+    dynamic = set()
+    for path in paths:
+        try:
+            with open(path) as fp:
+                lines = fp.readlines()
+        except IOError:
+            # assembly sources have no stack usage file
+            continue
+        for line in lines:
+            fields = line.rstrip('\n').split('\t')
+            if len(fields) != 3:
+                continue
+            name = fields[0].split(':')[-1]
+            # static functions sharing a name are merged, keep the largest frame
+            frames[name] = max(frames.get(name, 0), int(fields[1]))
+            if fields[2] == 'dynamic':
+                dynamic.add(name)
+    return frames, dynamic
+
+
+def read_calls(objdump, elf):
+    out = subprocess.check_output([objdump, '-d', '--no-show-raw-insn', elf]).decode()
+    calls = {}
+    indirect = set()
+    current = None
+    for line in out.splitlines():
+        m = FUNC_RE.match(line)
+        if m:
+            current = m.group(2)
+            calls.setdefault(current, set())
+            continue
+        if current is None:
+            continue
+        m = CALL_RE.search(line)
+        if m:
+            # a branch back to its own start is a loop, a call is a recursion
+            if m.group(2) != current or m.group(1) in ('bl', 'call'):
+                calls[current].add(m.group(2))
+            continue
+        m = INDIRECT_RE.search(line)
+        if m and not line.rstrip().endswith('lr'):
+            indirect.add(current)
+    return calls, indirect
+
+
+def read_stack_size(objdump, elf):
+    out = subprocess.check_output([objdump, '-t', elf]).decode()
+    symbols = {}
+    for line in out.splitlines():
+        m = SYMBOL_RE.match(line)
+        if m:
+            symbols[m.group(2)] = int(m.group(1), 16)
+    if 'end' in symbols and '_stack' in symbols:
+        return symbols['_stack'] - symbols['end']
+    return None
+
+
+class Graph(object):
+    def __init__(self, frames, dynamic, calls, indirect):
+        self.frames = frames
+        self.dynamic = dynamic
+        self.calls = calls
+        self.indirect = indirect
+        self.worst = {}
+        self.reached = {}
+
+    def walk(self, name, stack=()):
+        """Worst-case bytes below the call of name, its deepest path and what makes it a guess"""
+        if name in self.worst:
+            return self.worst[name]
+        notes = set()
+        if name not in self.frames:
+            notes.add('unknown')
+        if name in self.dynamic:
+            notes.add('dynamic')
+        if name in self.indirect:
+            notes.add('indirect')
+        deepest, path = 0, []
+        for callee in sorted(self.calls.get(name, ())):
+            if callee in stack or callee == name:
+                notes.add('recursive')
+                continue
+            used, callee_path, callee_notes = self.walk(callee, stack + (name,))
+            notes |= callee_notes
+            if used > deepest:
+                deepest, path = used, callee_path
+        result = (self.frames.get(name, 0) + deepest, [name] + path, notes)
+        # results found inside a recursion depend on the path, do not keep them
+        if 'recursive' not in notes:
+            self.worst[name] = result
+        return result
+
+    def reach(self, name, target, stack=()):
+        """Deepest bytes from the call of name down to the frame of target included, None if unreachable"""
+        if name == target:
+            return self.frames.get(name, 0)
+        if name in self.reached:
+            return self.reached[name]
+        deepest = None
+        for callee in self.calls.get(name, ()):
+            if callee in stack or callee == name:
+                continue
+            used = self.reach(callee, target, stack + (name,))
+            if used is not None and (deepest is None or used > deepest):
+                deepest = used
+        result = None if deepest is None else self.frames.get(name, 0) + deepest
+        self.reached[name] = result
+        return result
+
+
+def main(args):
+    frames, dynamic = read_frames(args.su)
+    calls, indirect = read_calls(args.objdump, args.elf)
+    graph = Graph(frames, dynamic, calls, indirect)
+    root = re.compile(args.root)
+    dispatch = graph.reach('main', args.dispatch) or 0
+    report = []
+    for name in sorted(calls):
+        if not root.search(name) and name != 'main':
+            continue
+        used, path, notes = graph.walk(name)
+        # handlers run below main and the dispatcher, main itself starts the stack
+        total = used if name == 'main' else used + dispatch
+        report.append({'function': name, 'worst': used, 'total': total, 'self': frames.get(name, 0),
+                       'notes': sorted(notes), 'path': path})
+    report.sort(key=lambda r: -r['total'])
+    stack_size = read_stack_size(args.objdump, args.elf)
+
+    if args.json:
+        print(json.dumps({'stack_size': stack_size, 'dispatch': dispatch, 'functions': report}, indent=2))
+    else:
+        if stack_size is not None:
+            print("Free stack: %d bytes" % stack_size)
+        print("From main to %s: %d bytes" % (args.dispatch, dispatch))
+        print("%-40s %7s %7s %6s  %-26s %s" % ('function', 'total', 'worst', 'self', 'notes', 'deepest path'))
+        for r in report:
+            print("%-40s %7d %7d %6d  %-26s %s" % (r['function'], r['total'], r['worst'], r['self'],
+                                                   ','.join(r['notes']), ' > '.join(r['path'][1:])))
+        print("notes: unknown = no stack usage for a callee, dynamic = alloca or VLA,")
+        print("       indirect = calls through a pointer, recursive = a cycle was cut")
+
+    limit = args.limit if args.limit is not None else stack_size
+    if limit is not None:
+        over = [r['function'] for r in report if r['total'] > limit]
+        if over:
+            print("Over %d bytes: %s" % (limit, ', '.join(over)), file=sys.stderr)
+            return 1
+    return 0
+
+
+if __name__ == '__main__':
+    args = parse_args()
+    sys.exit(main(args))
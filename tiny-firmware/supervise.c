@@ -18,7 +18,9 @@
  */
 
 #include "tiny-firmware/supervise.h"
+#include "tiny-firmware/firmware/profile.h"
 #include "tiny-firmware/memory.h"
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/stm32/flash.h>
 #include <stdint.h>
 
@@ -84,6 +86,11 @@ void svc_handler_main(uint32_t* stack)
     case SVC_TIMER_MS:
         stack[0] = system_millis;
         break;
+#if PROFILE
+    case SVC_TIMER_CYCLES:
+        stack[0] = dwt_read_cycle_counter();
+        break;
+#endif
     default:
         stack[0] = 0xffffffff;
         break;
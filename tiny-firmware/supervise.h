@@ -29,6 +29,7 @@
 #define SVC_FLASH_PROGRAM 2
 #define SVC_FLASH_LOCK 3
 #define SVC_TIMER_MS 4
+#define SVC_TIMER_CYCLES 5
 
 /* Unlocks flash.  This function needs to be called before programming
  * or erasing. Multiple calls of flash_program and flash_erase can
@@ -85,6 +86,19 @@ static inline uint32_t svc_timer_ms(void)
     return r0;
 }
 
+/* DWT cycle counter, the Private Peripheral Bus is not accessible
+ * in unprivileged mode.
+ */
+static inline uint32_t svc_timer_cycles(void)
+{
+    register uint32_t r0 __asm__("r0");
+    __asm__ __volatile__("svc %1"
+                         : "=r"(r0)
+                         : "i"(SVC_TIMER_CYCLES)
+                         : "memory");
+    return r0;
+}
+
 #else
 
 extern void svc_flash_unlock(void);
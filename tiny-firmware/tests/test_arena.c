@@ -0,0 +1,93 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "tiny-firmware/tests/test_arena.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tiny-firmware/firmware/arena.h"
+
+static bool isZero(const uint8_t* p, size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        if (p[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+START_TEST(test_arenaAllocAligned)
+{
+    arena_reset();
+    uint8_t* a = arena_alloc(3);
+    uint8_t* b = arena_alloc(1);
+    ck_assert_ptr_nonnull(a);
+    ck_assert_ptr_nonnull(b);
+    ck_assert_uint_eq((uintptr_t)a % ARENA_ALIGN, 0);
+    ck_assert_uint_eq((uintptr_t)b % ARENA_ALIGN, 0);
+    ck_assert_uint_eq(b - a, ARENA_ALIGN);
+    ck_assert_uint_eq(arena_mark(), 2 * ARENA_ALIGN);
+    arena_reset();
+}
+END_TEST
+
+START_TEST(test_arenaReleaseWipes)
+{
+    arena_reset();
+    uint8_t* kept = arena_alloc(16);
+    memset(kept, 0xAB, 16);
+    size_t mark = arena_mark();
+    uint8_t* secret = arena_alloc(64);
+    ck_assert(isZero(secret, 64));
+    memset(secret, 0xCD, 64);
+    arena_release(mark);
+    ck_assert(isZero(secret, 64));
+    ck_assert_uint_eq(kept[15], 0xAB);
+    ck_assert_ptr_eq(arena_alloc(64), secret);
+
+    uint8_t* raw = arena_alloc_top(100);
+    memset(raw, 0xEF, 100);
+    arena_release_top();
+    ck_assert(isZero(raw, 100));
+
+    arena_reset();
+    ck_assert(isZero(kept, 16));
+    ck_assert_uint_eq(arena_mark(), 0);
+}
+END_TEST
+
+START_TEST(test_arenaExhausted)
+{
+    arena_reset();
+    // a message as large as allowed fits next to its decoded form
+    ck_assert_ptr_nonnull(arena_alloc_top(MSG_IN_SIZE + 63));
+    ck_assert_ptr_nonnull(arena_alloc(MSG_IN_SIZE));
+    ck_assert_ptr_null(arena_alloc(1));
+    ck_assert_ptr_null(arena_alloc_top(1));
+    ck_assert_uint_ge(arena_peak(), ARENA_SIZE);
+    // the room of the raw message goes to the handler once released
+    arena_release_top();
+    ck_assert_ptr_nonnull(arena_alloc(MSG_IN_SIZE));
+    ck_assert_ptr_null(arena_alloc(ARENA_SIZE - 2 * MSG_IN_SIZE + 1));
+    arena_reset();
+}
+END_TEST
+
+TCase* add_arena_tests(TCase* tc)
+{
+    tcase_add_test(tc, test_arenaAllocAligned);
+    tcase_add_test(tc, test_arenaReleaseWipes);
+    tcase_add_test(tc, test_arenaExhausted);
+    return tc;
+}
@@ -39,6 +39,7 @@
 #include "tiny-firmware/firmware/recovery.h"
 #include "tiny-firmware/firmware/reset.h"
 #include "tiny-firmware/firmware/skyparams.h"
+#include "tiny-firmware/firmware/skywallet.h"
 #include "tiny-firmware/firmware/storage.h"
 #include "tiny-firmware/memory.h"
 #include "tiny-firmware/oled.h"
@@ -512,6 +513,262 @@ START_TEST(test_generateAddressBip44)
 }
 END_TEST
 
+START_TEST(test_bip39SeedStretchedInBackground)
+{
+    char mnem_str[] = {"apple again now trial car member express concert antenna panda shuffle topple"};
+    SetMnemonic setMnem = SetMnemonic_init_zero;
+    memcpy(setMnem.mnemonic, mnem_str, sizeof(mnem_str));
+    ck_assert_int_eq(ErrOk, msgSetMnemonicImpl(&setMnem));
+    uint8_t expected[512 / 8] = {0};
+    ck_assert(mnemonic_to_seed(mnem_str, "", expected, NULL));
+
+    // a request arriving early only finishes the remaining rounds
+    ck_assert(session_stretchBip39Seed(BIP39_SEED_IDLE_ROUNDS));
+    uint8_t seed[512 / 8] = {0};
+    ck_assert(session_getBip39Seed(seed, NULL));
+    ck_assert_mem_eq(seed, expected, sizeof(seed));
+
+    // idle slices stop once the seed is ready and start over for a new mnemonic
+    ck_assert(!session_stretchBip39Seed(BIP39_SEED_IDLE_ROUNDS));
+    char mnem_str2[] = {"network hurdle trash obvious soccer sunset side merit horn author horn you"};
+    memcpy(setMnem.mnemonic, mnem_str2, sizeof(mnem_str2));
+    ck_assert_int_eq(ErrOk, msgSetMnemonicImpl(&setMnem));
+    ck_assert(mnemonic_to_seed(mnem_str2, "", expected, NULL));
+    uint32_t slices = 0;
+    while (session_stretchBip39Seed(BIP39_SEED_IDLE_ROUNDS)) {
+        ++slices;
+    }
+    ck_assert_uint_eq(slices, BIP39_PBKDF2_ROUNDS / BIP39_SEED_IDLE_ROUNDS);
+    ck_assert(session_getBip39Seed(seed, NULL));
+    ck_assert_mem_eq(seed, expected, sizeof(seed));
+}
+END_TEST
+
+START_TEST(test_addressPrefetchedInBackground)
+{
+    char mnem_str[] = {"apple again now trial car member express concert antenna panda shuffle topple"};
+    SetMnemonic setMnem = SetMnemonic_init_zero;
+    memcpy(setMnem.mnemonic, mnem_str, sizeof(mnem_str));
+    ck_assert_int_eq(ErrOk, msgSetMnemonicImpl(&setMnem));
+
+    // walk the chain up to the first index after the prefetched ones
+    uint8_t seed[32] = {0};
+    uint8_t nextSeed[32] = {0};
+    uint8_t pubkeys[ADDRESS_PREFETCH_COUNT + 1][33];
+    uint8_t seckeys[ADDRESS_PREFETCH_COUNT + 1][32];
+    ck_assert_int_eq(0, deterministic_key_pair_iterator((const uint8_t*)mnem_str, strlen(mnem_str), nextSeed, seckeys[0], pubkeys[0]));
+    for (uint32_t i = 1; i <= ADDRESS_PREFETCH_COUNT; ++i) {
+        memcpy(seed, nextSeed, sizeof(seed));
+        ck_assert_int_eq(0, deterministic_key_pair_iterator(seed, sizeof(seed), nextSeed, seckeys[i], pubkeys[i]));
+    }
+
+    uint32_t steps = 0;
+    while (session_prefetchKeyPair()) {
+        ++steps;
+    }
+    ck_assert_uint_eq(steps, ADDRESS_PREFETCH_COUNT);
+    uint8_t pubkey[33] = {0};
+    uint8_t seckey[32] = {0};
+    for (uint32_t i = 0; i < ADDRESS_PREFETCH_COUNT; ++i) {
+        ck_assert(session_getCachedKeyPair(i, pubkey));
+        ck_assert_mem_eq(pubkey, pubkeys[i], sizeof(pubkey));
+    }
+    ck_assert(!session_getCachedKeyPair(ADDRESS_PREFETCH_COUNT, pubkey));
+
+    // only public keys are cached, secret keys in the table are derived again
+    ck_assert_int_eq(ErrOk, fsm_getKeyPairAtIndex(1, pubkey, NULL, NULL, 3));
+    ck_assert_mem_eq(pubkey, pubkeys[3], sizeof(pubkey));
+    ck_assert_int_eq(ErrOk, fsm_getKeyPairAtIndex(1, pubkey, seckey, NULL, 3));
+    ck_assert_mem_eq(pubkey, pubkeys[3], sizeof(pubkey));
+    ck_assert_mem_eq(seckey, seckeys[3], sizeof(seckey));
+
+    // requests past the table continue from the cached chain
+    ck_assert_int_eq(ErrOk, fsm_getKeyPairAtIndex(1, pubkey, seckey, NULL, ADDRESS_PREFETCH_COUNT));
+    ck_assert_mem_eq(pubkey, pubkeys[ADDRESS_PREFETCH_COUNT], sizeof(pubkey));
+    ck_assert_mem_eq(seckey, seckeys[ADDRESS_PREFETCH_COUNT], sizeof(seckey));
+
+    // a new mnemonic drops the table
+    char mnem_str2[] = {"network hurdle trash obvious soccer sunset side merit horn author horn you"};
+    memcpy(setMnem.mnemonic, mnem_str2, sizeof(mnem_str2));
+    ck_assert_int_eq(ErrOk, msgSetMnemonicImpl(&setMnem));
+    ck_assert(!session_getCachedKeyPair(0, pubkey));
+    ck_assert(session_prefetchKeyPair());
+}
+END_TEST
+
+START_TEST(test_addressCacheInFlash)
+{
+    storage_wipe();
+    char mnem_str[] = {"apple again now trial car member express concert antenna panda shuffle topple"};
+    SetMnemonic setMnem = SetMnemonic_init_zero;
+    memcpy(setMnem.mnemonic, mnem_str, sizeof(mnem_str));
+    ck_assert_int_eq(ErrOk, msgSetMnemonicImpl(&setMnem));
+    uint32_t count = 0;
+    ck_assert_ptr_eq(storage_getAddressCache(mnem_str, &count), NULL);
+    ck_assert_uint_eq(count, 0);
+
+    // derived addresses are appended to flash
+    uint8_t pubkey[33] = {0};
+    ResponseSkycoinAddress derived = ResponseSkycoinAddress_init_zero;
+    ck_assert_int_eq(ErrOk, fsm_getKeyPairAtIndex(20, pubkey, NULL, &derived, 0));
+    ck_assert_ptr_ne(storage_getAddressCache(mnem_str, &count), NULL);
+    ck_assert_uint_eq(count, 20);
+
+    // and read back without deriving them, also after a reboot
+    session_clear(true);
+    ResponseSkycoinAddress cached = ResponseSkycoinAddress_init_zero;
+    ck_assert_int_eq(ErrOk, fsm_getAddressesFromCache(15, &cached, 5));
+    ck_assert_uint_eq(cached.addresses_count, 15);
+    for (uint32_t i = 0; i < cached.addresses_count; ++i) {
+        ck_assert_str_eq(cached.addresses[i], derived.addresses[i + 5]);
+    }
+    // flash is not trusted to vouch for change addresses
+    AddressPath path;
+    ck_assert(!addrindex_findAddress(cached.addresses[0], &path));
+    ck_assert_int_eq(ErrFailed, fsm_getAddressesFromCache(2, &cached, 19));
+
+    // entries are only appended in chain order
+    uint8_t hash[ADDRESS_CACHE_HASH_LEN] = {0};
+    storage_appendAddressCache(mnem_str, 25, hash);
+    storage_getAddressCache(mnem_str, &count);
+    ck_assert_uint_eq(count, 20);
+
+    // a new mnemonic invalidates the cache
+    char mnem_str2[] = {"network hurdle trash obvious soccer sunset side merit horn author horn you"};
+    memcpy(setMnem.mnemonic, mnem_str2, sizeof(mnem_str2));
+    ck_assert_int_eq(ErrOk, msgSetMnemonicImpl(&setMnem));
+    ck_assert_ptr_eq(storage_getAddressCache(mnem_str, &count), NULL);
+    ck_assert_ptr_eq(storage_getAddressCache(mnem_str2, &count), NULL);
+    ck_assert_uint_eq(count, 0);
+
+    // until a wipe erases it
+    storage_wipe();
+    memcpy(setMnem.mnemonic, mnem_str, sizeof(mnem_str));
+    ck_assert_int_eq(ErrOk, msgSetMnemonicImpl(&setMnem));
+    ck_assert_int_eq(ErrOk, fsm_getKeyPairAtIndex(1, pubkey, NULL, NULL, 0));
+    ck_assert_ptr_ne(storage_getAddressCache(mnem_str, &count), NULL);
+    ck_assert_uint_eq(count, 1);
+
+    // the tag can not be computed from the seed alone
+    uint8_t fingerprint[SHA256_DIGEST_LENGTH];
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    sha256_Raw((const uint8_t*)mnem_str, strlen(mnem_str), fingerprint);
+    sha256_Raw(fingerprint, sizeof(fingerprint), digest);
+    ck_assert_mem_ne(FLASH_PTR(FLASH_META_START + 0x5100), digest, sizeof(digest));
+
+    // passphrase wallets leave no trace in flash
+    storage_setPassphraseProtection(true);
+    storage_update();
+    session_cachePassphrase("hidden");
+    ck_assert_int_eq(ErrOk, fsm_getKeyPairAtIndex(3, pubkey, NULL, NULL, 0));
+    ck_assert_ptr_eq(storage_getAddressCache(storage_getFullSeed(), &count), NULL);
+    ck_assert_ptr_eq(storage_getAddressCache(mnem_str, &count), NULL);
+    storage_setPassphraseProtection(false);
+    storage_update();
+    ck_assert_ptr_ne(storage_getAddressCache(mnem_str, &count), NULL);
+    ck_assert_uint_eq(count, 1);
+
+    // loading a device drops the cache, even for the same mnemonic
+    LoadDevice load = LoadDevice_init_zero;
+    load.has_mnemonic = true;
+    strlcpy(load.mnemonic, mnem_str, sizeof(load.mnemonic));
+    storage_loadDevice(&load);
+    ck_assert_ptr_eq(storage_getAddressCache(mnem_str, &count), NULL);
+    ck_assert_uint_eq(count, 0);
+}
+END_TEST
+
+START_TEST(test_settingsJournal)
+{
+    storage_wipe();
+    // Storage structure right after the magic and the uuid
+    const Storage* flashed = (const Storage*)FLASH_PTR(FLASH_STORAGE_START + 4 + STM32_UUID_LEN);
+    char base[DEVICE_LABEL_SIZE];
+    strlcpy(base, flashed->label, sizeof(base));
+
+    // an update is appended without rewriting the structure
+    storage_setLabel("journaled label");
+    storage_update();
+    ck_assert_str_eq(storage_getLabel(), "journaled label");
+    ck_assert_str_eq(flashed->label, base);
+    ck_assert(storage_from_flash());
+    ck_assert_str_eq(storage_getLabel(), "journaled label");
+
+    // the sector is compacted once the journal is full
+    bool compacted = false;
+    char label[DEVICE_LABEL_SIZE];
+    for (int i = 0; i < 1000; ++i) {
+        memset(label, 'a' + i % 26, sizeof(label) - 1);
+        label[sizeof(label) - 1] = '\0';
+        storage_setLabel(label);
+        storage_update();
+        ck_assert_str_eq(storage_getLabel(), label);
+        compacted |= strcmp(flashed->label, label) == 0;
+    }
+    ck_assert(compacted);
+    ck_assert(storage_from_flash());
+    ck_assert_str_eq(storage_getLabel(), label);
+}
+END_TEST
+
+static bool flashContains(const char* data, size_t len)
+{
+    const uint8_t* meta = FLASH_PTR(FLASH_META_START);
+    for (size_t i = 0; i + len <= FLASH_META_LEN; i++) {
+        if (memcmp(meta + i, data, len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+START_TEST(test_settingsJournalForgetsSecrets)
+{
+    storage_wipe();
+    static const char old_pin[] = "918273";
+    storage_setPin(old_pin);
+    storage_update();
+    ck_assert(storage_containsPin(old_pin));
+    ck_assert(flashContains(old_pin, sizeof(old_pin)));
+
+    // a journal record would leave the old pin in flash until the next compaction
+    storage_setPin("5");
+    storage_update();
+    ck_assert(storage_containsPin("5"));
+    ck_assert(!flashContains(old_pin, sizeof(old_pin)));
+
+    static const char old_mnemonic[] = "apple again now trial car member express concert antenna panda shuffle topple";
+    storage_setMnemonic(old_mnemonic);
+    storage_update();
+    storage_setMnemonic("network hurdle trash obvious soccer sunset side merit horn author horn you");
+    storage_update();
+    ck_assert(!flashContains(old_mnemonic, sizeof(old_mnemonic)));
+}
+END_TEST
+
+START_TEST(test_storageUpdateUnchangedIsNoop)
+{
+    static uint8_t sector[0x4000];
+    storage_wipe();
+    ApplySettings msg = ApplySettings_init_zero;
+    msg.has_label = true;
+    strlcpy(msg.label, "unchanged", sizeof(msg.label));
+    ck_assert_int_eq(msgApplySettingsImpl(&msg), ErrOk);
+    memcpy(sector, FLASH_PTR(FLASH_META_START), sizeof(sector));
+
+    // applying the same settings again does not program the flash
+    ck_assert_int_eq(msgApplySettingsImpl(&msg), ErrOk);
+    storage_update();
+    ck_assert_mem_eq(sector, FLASH_PTR(FLASH_META_START), sizeof(sector));
+    ck_assert_str_eq(storage_getLabel(), "unchanged");
+
+    strlcpy(msg.label, "changed", sizeof(msg.label));
+    ck_assert_int_eq(msgApplySettingsImpl(&msg), ErrOk);
+    ck_assert(memcmp(sector, FLASH_PTR(FLASH_META_START), sizeof(sector)) != 0);
+    ck_assert_str_eq(storage_getLabel(), "changed");
+}
+END_TEST
+
 // define test cases
 TCase* add_fsm_tests(TCase* tc)
 {
@@ -536,5 +793,11 @@ TCase* add_fsm_tests(TCase* tc)
     tcase_add_test(tc, test_msgChangePinRemoveSuccess);
     tcase_add_test(tc, test_isSha256DigestHex);
     tcase_add_test(tc, test_generateAddressBip44);
+    tcase_add_test(tc, test_bip39SeedStretchedInBackground);
+    tcase_add_test(tc, test_addressPrefetchedInBackground);
+    tcase_add_test(tc, test_addressCacheInFlash);
+    tcase_add_test(tc, test_settingsJournal);
+    tcase_add_test(tc, test_settingsJournalForgetsSecrets);
+    tcase_add_test(tc, test_storageUpdateUnchangedIsNoop);
     return tc;
 }
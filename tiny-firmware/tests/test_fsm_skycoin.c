@@ -64,6 +64,7 @@ void setup_tc_fsm_skycoin(void)
 
 void teardown_tc_fsm_skycoin(void)
 {
+    TxSignCtx_DestroyAll();
 }
 
 /**
@@ -311,6 +312,83 @@ START_TEST(test_msgTransactionSign1)
 }
 END_TEST
 
+static uint32_t batchConfirmCount;
+static uint32_t batchRespCount;
+static ResponseTransactionSign batchResp[2];
+
+ErrCode_t funcConfirmBatchDestination(char* strCoin, char* strHour, char* address)
+{
+    (void)strHour;
+    ck_assert_str_eq(address, "K9TzLrgqz7uXn3QJHGxmzdRByAzH33J2ot");
+    ck_assert_str_eq(strCoin, "send 0.2 coins");
+    batchConfirmCount++;
+    return ErrOk;
+}
+
+void funcWriteBatchResp(ResponseTransactionSign* resp)
+{
+    ck_assert_uint_lt(batchRespCount, sizeof(batchResp) / sizeof(*batchResp));
+    batchResp[batchRespCount++] = *resp;
+}
+
+START_TEST(test_msgTransactionSignBatch)
+{
+    SkycoinTransactionInput transactionInputs[1] = {
+        {.hashIn = "181bd5656115172fe81451fae4fb56498a97744d89702e73da75ba91ed5200f9",
+            .has_index = true,
+            .index = 0}};
+    SkycoinTransactionOutput transactionOutputs[1] = {
+        {.address = "K9TzLrgqz7uXn3QJHGxmzdRByAzH33J2ot",
+            .coin = 100000,
+            .hour = 2}};
+    TransactionSign msgs[2] = {TransactionSign_init_zero, TransactionSign_init_zero};
+    for (size_t i = 0; i < 2; ++i) {
+        msgs[i].transactionIn[0] = transactionInputs[0];
+        msgs[i].transactionOut[0] = transactionOutputs[0];
+        msgs[i].nbIn = 1;
+        msgs[i].nbOut = 1;
+        msgs[i].transactionIn_count = 1;
+        msgs[i].transactionOut_count = 1;
+    }
+    SetMnemonic nemonic = SetMnemonic_init_zero;
+    char raw_mnemonic[] = {
+        "cloud flower upset remain green metal below cup stem infant art thank"};
+    memcpy(nemonic.mnemonic, raw_mnemonic, sizeof(raw_mnemonic));
+    ck_assert_int_eq(msgSetMnemonicImpl(&nemonic), ErrOk);
+
+    batchConfirmCount = 0;
+    batchRespCount = 0;
+    ResponseTransactionSign resp = ResponseTransactionSign_init_zero;
+    ck_assert_int_eq(msgTransactionSignBatchImpl(msgs, 2, funcConfirmBatchDestination, funcWriteBatchResp, &resp), ErrOk);
+    // both transactions send to the same address, confirmed once with the total
+    ck_assert_uint_eq(batchConfirmCount, 1);
+    ck_assert_uint_eq(batchRespCount, 2);
+
+    for (size_t i = 0; i < 2; ++i) {
+        ck_assert_int_eq(batchResp[i].signatures_count, 1);
+        SkycoinCheckMessageSignature msg_s = SkycoinCheckMessageSignature_init_zero;
+        char raw_addr[] = {"2EU3JbveHdkxW6z5tdhbbB2kRAWvXC2pLzw"};
+        memcpy(msg_s.address, raw_addr, sizeof(raw_addr));
+        char raw_msg[] = {
+            "d11c62b1e0e9abf629b1f5f4699cef9fbc504b45ceedf0047ead686979498218"};
+        memcpy(msg_s.message, raw_msg, sizeof(raw_msg));
+        memcpy(msg_s.signature, batchResp[i].signatures[0], sizeof(msg_s.signature));
+        Failure failure_resp = Failure_init_default;
+        Success success_resp = Success_init_default;
+        ck_assert_int_eq(msgSkycoinCheckMessageSignatureImpl(&msg_s, &success_resp, &failure_resp), ErrOk);
+    }
+
+    // the second transaction fails to sign, the signatures of the first one are not written
+    batchRespCount = 0;
+    msgs[1].transactionIn[0].index = 1000;
+    ck_assert_int_eq(msgTransactionSignBatchImpl(msgs, 2, funcConfirmBatchDestination, funcWriteBatchResp, &resp), ErrInvalidSignature);
+    ck_assert_uint_eq(batchRespCount, 0);
+
+    ck_assert_int_eq(msgTransactionSignBatchImpl(msgs, 0, funcConfirmBatchDestination, funcWriteBatchResp, &resp), ErrInvalidArg);
+    ck_assert_int_eq(msgTransactionSignBatchImpl(msgs, TX_BATCH_MAX_TRANSACTIONS + 1, funcConfirmBatchDestination, funcWriteBatchResp, &resp), ErrInvalidArg);
+}
+END_TEST
+
 START_TEST(test_msgTransactionSign2)
 {
     SkycoinTransactionInput transactionInputs[2] = {
@@ -1154,7 +1232,85 @@ START_TEST(test_msgTransactionSign13)
     sign_tx.lock_time = 3;
     sign_tx.has_tx_hash = true;
     strcpy(sign_tx.tx_hash, "8cbdfbc7aa9975904b805152a816a897d7f8b652806fd9ceec8822b096c6fc18");
-    ck_assert_int_eq(msgSignTxImpl(&sign_tx, &response), ErrFailed);
+    TxSignContext* ctx = TxSignCtx_Find(sign_tx.tx_hash);
+    ck_assert_ptr_nonnull(ctx);
+    ctx->requestIndex = 5;
+    // a repeated SignTx restarts the session of that hash
+    ck_assert_int_eq(msgSignTxImpl(&sign_tx, &response), ErrOk);
+    ck_assert_int_eq(response.details.request_index, 1);
+    ctx = TxSignCtx_Find(sign_tx.tx_hash);
+    ck_assert_ptr_nonnull(ctx);
+    ck_assert_int_eq(ctx->state, InnerHashInputs);
+    ck_assert_int_eq(ctx->requestIndex, 1);
+}
+END_TEST
+
+START_TEST(test_msgTransactionSignAfterCancel)
+{
+    SetMnemonic mnemonic = SetMnemonic_init_zero;
+    char mnemonic_str[] = {"network hurdle trash obvious soccer sunset side merit horn author horn you"};
+    memcpy(mnemonic.mnemonic, mnemonic_str, sizeof(mnemonic_str));
+    ck_assert_int_eq(msgSetMnemonicImpl(&mnemonic), ErrOk);
+
+    SignTx sign_tx = SignTx_init_default;
+    sign_tx.outputs_count = 1;
+    sign_tx.inputs_count = 1;
+    sign_tx.has_coin_name = true;
+    strcpy(sign_tx.coin_name, "Skycoin");
+    sign_tx.has_version = true;
+    sign_tx.version = 1;
+    sign_tx.has_lock_time = true;
+    sign_tx.lock_time = 3;
+    sign_tx.has_tx_hash = true;
+    strcpy(sign_tx.tx_hash, "8cbdfbc7aa9975904b805152a816a897d7f8b652806fd9ceec8822b096c6fc18");
+    TxRequest response = TxRequest_init_default;
+
+    TxAck tx_ack = TxAck_init_default;
+    tx_ack.has_tx = true;
+    tx_ack.tx.has_version = true;
+    tx_ack.tx.version = 1;
+    tx_ack.tx.has_lock_time = true;
+    tx_ack.tx.lock_time = 3;
+#ifdef TxAck_tx_hash_tag
+    tx_ack.has_tx_hash = true;
+    strcpy(tx_ack.tx_hash, sign_tx.tx_hash);
+#endif
+    TxAck_TransactionType_TxInputType input = {
+        .hashIn = "941a422ed8b17ae9dcbf942ace143f77c26a9c02d2e6395b46d50d1079ba4b00",
+        .address_n_count = 1,
+        .address_n = {0}};
+    TxAck_TransactionType_TxOutputType output = {
+        .address = "2EU3JbveHdkxW6z5tdhbbB2kRAWvXC2pLzw",
+        .address_n_count = 0,
+        .coins = 2,
+        .hours = 255};
+
+    // the user cancels while the output is being confirmed
+    ck_assert_int_eq(msgSignTxImpl(&sign_tx, &response), ErrOk);
+    tx_ack.tx.inputs_count = 1;
+    tx_ack.tx.outputs_count = 0;
+    tx_ack.tx.inputs[0] = input;
+    ck_assert_int_eq(msgTxAckImpl(&tx_ack, &response), ErrOk);
+    ck_assert_int_eq(response.request_type, TxRequest_RequestType_TXOUTPUT);
+    Cancel cancel = Cancel_init_default;
+    ck_assert_int_eq(msgCancelImpl(&cancel), ErrActionCancelled);
+    ck_assert_ptr_null(TxSignCtx_Find(sign_tx.tx_hash));
+
+    // signing the same transaction again runs to the end
+    ck_assert_int_eq(msgSignTxImpl(&sign_tx, &response), ErrOk);
+    ck_assert_int_eq(msgTxAckImpl(&tx_ack, &response), ErrOk);
+    ck_assert_int_eq(response.request_type, TxRequest_RequestType_TXOUTPUT);
+    tx_ack.tx.inputs_count = 0;
+    tx_ack.tx.outputs_count = 1;
+    tx_ack.tx.outputs[0] = output;
+    ck_assert_int_eq(msgTxAckImpl(&tx_ack, &response), ErrOk);
+    ck_assert_int_eq(response.request_type, TxRequest_RequestType_TXINPUT);
+    tx_ack.tx.inputs_count = 1;
+    tx_ack.tx.outputs_count = 0;
+    ck_assert_int_eq(msgTxAckImpl(&tx_ack, &response), ErrOk);
+    ck_assert_int_eq(response.request_type, TxRequest_RequestType_TXFINISHED);
+    ck_assert_int_eq(response.sign_result_count, 1);
+    ck_assert_ptr_null(TxSignCtx_Find(sign_tx.tx_hash));
 }
 END_TEST
 
@@ -1301,6 +1457,118 @@ START_TEST(test_msgTransactionSign14)
 }
 END_TEST
 
+START_TEST(test_msgTransactionSignChangeFromAddressIndex)
+{
+    SetMnemonic nemonic = SetMnemonic_init_zero;
+    char raw_mnemonic[] = {
+        "cloud flower upset remain green metal below cup stem infant art thank"};
+    memcpy(nemonic.mnemonic, raw_mnemonic, sizeof(raw_mnemonic));
+    ck_assert_int_eq(msgSetMnemonicImpl(&nemonic), ErrOk);
+    bool found = true;
+    AddressPath path = {0};
+    ck_assert_int_eq(msgSkycoinAddressLookupImpl("2EU3JbveHdkxW6z5tdhbbB2kRAWvXC2pLzw", &found, &path), ErrOk);
+    ck_assert(!found);
+    ck_assert_int_eq(msgSkycoinAddressLookupImpl("2EU3JbveHdkxW6z5tdhbbB2kRAWvXC2pLzx", &found, &path), ErrInvalidArg);
+
+    SkycoinTransactionInput transactionInputs[1] = {
+        {.hashIn = "181bd5656115172fe81451fae4fb56498a97744d89702e73da75ba91ed5200f9",
+            .has_index = true,
+            .index = 0}};
+    SkycoinTransactionOutput transactionOutputs[2] = {
+        {.address = "K9TzLrgqz7uXn3QJHGxmzdRByAzH33J2ot",
+            .coin = 100000,
+            .hour = 2},
+        {.address = "2EU3JbveHdkxW6z5tdhbbB2kRAWvXC2pLzw",
+            .coin = 200000,
+            .hour = 1,
+            .has_address_index = true,
+            .address_index = 0}};
+    TransactionSign msg = TransactionSign_init_zero;
+    msg.transactionIn[0] = transactionInputs[0];
+    msg.transactionOut[0] = transactionOutputs[0];
+    msg.transactionOut[1] = transactionOutputs[1];
+    msg.nbIn = 1;
+    msg.nbOut = 2;
+    msg.transactionIn_count = 1;
+    msg.transactionOut_count = 2;
+    ResponseTransactionSign resp = ResponseTransactionSign_init_zero;
+    ck_assert_int_eq(msgTransactionSignImpl(&msg, funcConfirmTxn, &resp), ErrOk);
+
+    // derived addresses are known from now on
+    ck_assert_int_eq(msgSkycoinAddressLookupImpl("2EU3JbveHdkxW6z5tdhbbB2kRAWvXC2pLzw", &found, &path), ErrOk);
+    ck_assert(found);
+    ck_assert(!path.bip44);
+    ck_assert_uint_eq(path.index, 0);
+    ck_assert_int_eq(msgSkycoinAddressLookupImpl("K9TzLrgqz7uXn3QJHGxmzdRByAzH33J2ot", &found, &path), ErrOk);
+    ck_assert(!found);
+
+    // a change output claiming another index is derived again and rejected
+    msg.transactionOut[1].address_index = 1;
+    memset(&resp, 0, sizeof(resp));
+    ck_assert_int_eq(msgTransactionSignImpl(&msg, funcConfirmTxn, &resp), ErrAddressGeneration);
+
+    // and the index is dropped with the mnemonic
+    ck_assert_int_eq(msgSetMnemonicImpl(&nemonic), ErrOk);
+    ck_assert_int_eq(msgSkycoinAddressLookupImpl("2EU3JbveHdkxW6z5tdhbbB2kRAWvXC2pLzw", &found, &path), ErrOk);
+    ck_assert(!found);
+}
+END_TEST
+
+START_TEST(test_msgTransactionSignConcurrentSessions)
+{
+    SetMnemonic mnemonic = SetMnemonic_init_zero;
+    char mnemonic_str[] = {"network hurdle trash obvious soccer sunset side merit horn author horn you"};
+    memcpy(mnemonic.mnemonic, mnemonic_str, sizeof(mnemonic_str));
+    ck_assert_int_eq(msgSetMnemonicImpl(&mnemonic), ErrOk);
+
+    SignTx sign_tx = SignTx_init_default;
+    sign_tx.outputs_count = 1;
+    sign_tx.inputs_count = 1;
+    sign_tx.has_coin_name = true;
+    strcpy(sign_tx.coin_name, "Skycoin");
+    sign_tx.has_version = true;
+    sign_tx.version = 1;
+    sign_tx.has_lock_time = true;
+    sign_tx.lock_time = 3;
+    sign_tx.has_tx_hash = true;
+    TxRequest response = TxRequest_init_default;
+#ifdef TxAck_tx_hash_tag
+    for (uint32_t i = 0; i < TX_SIGN_CTX_POOL_SIZE + 1; ++i) {
+        sprintf(sign_tx.tx_hash, "%064u", i);
+        ck_assert_int_eq(msgSignTxImpl(&sign_tx, &response), ErrOk);
+        ck_assert_int_eq(response.request_type, TxRequest_RequestType_TXINPUT);
+        ck_assert_str_eq(response.details.tx_hash, sign_tx.tx_hash);
+    }
+    // the least recently used session was evicted to make room for the last one
+    ck_assert_ptr_null(TxSignCtx_Find("0000000000000000000000000000000000000000000000000000000000000000"));
+    for (uint32_t i = 1; i < TX_SIGN_CTX_POOL_SIZE + 1; ++i) {
+        sprintf(sign_tx.tx_hash, "%064u", i);
+        ck_assert_ptr_nonnull(TxSignCtx_Find(sign_tx.tx_hash));
+    }
+#else
+    // without a hash in TxAck a second session replaces the first one
+    sprintf(sign_tx.tx_hash, "%064u", 0);
+    ck_assert_int_eq(msgSignTxImpl(&sign_tx, &response), ErrOk);
+    sprintf(sign_tx.tx_hash, "%064u", 1);
+    ck_assert_int_eq(msgSignTxImpl(&sign_tx, &response), ErrOk);
+    ck_assert_ptr_nonnull(TxSignCtx_Find(sign_tx.tx_hash));
+    ck_assert_ptr_null(TxSignCtx_Find("0000000000000000000000000000000000000000000000000000000000000000"));
+#endif
+
+    // a new mnemonic invalidates every session in progress
+    ck_assert_int_eq(msgSetMnemonicImpl(&mnemonic), ErrOk);
+    TxAck tx_ack = TxAck_init_default;
+    tx_ack.has_tx = true;
+    tx_ack.tx.inputs_count = 1;
+    strcpy(tx_ack.tx.inputs[0].hashIn, "941a422ed8b17ae9dcbf942ace143f77c26a9c02d2e6395b46d50d1079ba4b00");
+#ifdef TxAck_tx_hash_tag
+    tx_ack.has_tx_hash = true;
+    strcpy(tx_ack.tx_hash, sign_tx.tx_hash);
+#endif
+    ck_assert_int_eq(msgTxAckImpl(&tx_ack, &response), ErrFailed);
+}
+END_TEST
+
 START_TEST(test_transactionSignCheckEdges)
 {
     SkycoinTransactionInput transactionInputs[1] = {
@@ -1470,6 +1738,55 @@ START_TEST(test_msgSkycoinAddressesTooMany)
 }
 END_TEST
 
+START_TEST(test_msgSkycoinAddressesCancelled)
+{
+    SetMnemonic msgSeed = SetMnemonic_init_zero;
+    SkycoinAddress msgAddr = SkycoinAddress_init_zero;
+    RESP_INIT(ResponseSkycoinAddress);
+
+    strncpy(msgSeed.mnemonic, TEST_MANY_ADDRESS_SEED, sizeof(msgSeed.mnemonic));
+    ck_assert_int_eq(msgSetMnemonicImpl(&msgSeed), ErrOk);
+
+    msgAddr.has_start_index = false;
+    msgAddr.address_n = 99;
+    msgAddr.has_confirm_address = false;
+
+    // Cancel received while addresses are being generated
+    uint8_t cancel[64] = {'?', '#', '#', (MessageType_MessageType_Cancel >> 8) & 0xFF,
+        MessageType_MessageType_Cancel & 0xFF, 0, 0, 0, 0};
+    msg_read_tiny(cancel, sizeof(cancel));
+    ck_assert_int_eq(msg_tiny_id, MessageType_MessageType_Cancel);
+    ck_assert_int_eq(msgSkycoinAddressImpl(&msgAddr, resp), ErrActionCancelled);
+    ck_assert_int_eq(msg_tiny_id, 0xFFFF);
+    ck_assert(!protectAbortedByInitialize);
+
+    // nothing pending, the same request completes
+    memset(resp, 0, sizeof(*resp));
+    ck_assert_int_eq(msgSkycoinAddressImpl(&msgAddr, resp), ErrOk);
+    ck_assert_int_eq(resp->addresses_count, 99);
+}
+END_TEST
+
+START_TEST(test_msgReadTinyDefersPipelinedRequest)
+{
+    uint8_t request[64] = {'?', '#', '#', (MessageType_MessageType_GetFeatures >> 8) & 0xFF,
+        MessageType_MessageType_GetFeatures & 0xFF, 0, 0, 0, 0};
+    // a request sent while a long operation polls for Cancel is kept for the main loop
+    msg_tiny_defer(true);
+    msg_read_tiny(request, sizeof(request));
+    msg_tiny_defer(false);
+    ck_assert(msg_tiny_deferred());
+    ck_assert_int_eq(msg_tiny_id, 0xFFFF);
+
+    msg_read_deferred();
+    ck_assert(!msg_tiny_deferred());
+
+    // out of a long operation the request is still refused
+    msg_read_tiny(request, sizeof(request));
+    ck_assert(!msg_tiny_deferred());
+}
+END_TEST
+
 START_TEST(test_msgSkycoinAddressesFailWithoutMnemonic)
 {
     SkycoinAddress msgAddr = SkycoinAddress_init_zero;
@@ -1539,6 +1856,7 @@ TCase* add_fsm_skycoin_tests(TCase* tc)
     tcase_add_test(tc, test_msgSkycoinCheckMessageSignatureFailedAsExpectedForInvalidSignedMessage);
     tcase_add_test(tc, test_msgSkycoinCheckMessageSignatureFailedAsExpectedForInvalidMessage);
     tcase_add_test(tc, test_msgTransactionSign1);
+    tcase_add_test(tc, test_msgTransactionSignBatch);
     tcase_add_test(tc, test_msgTransactionSign2);
     tcase_add_test(tc, test_msgTransactionSign3);
     tcase_add_test(tc, test_msgTransactionSign4);
@@ -1551,13 +1869,18 @@ TCase* add_fsm_skycoin_tests(TCase* tc)
     tcase_add_test(tc, test_msgTransactionSign11);
     tcase_add_test(tc, test_msgTransactionSign12);
     tcase_add_test(tc, test_msgTransactionSign13);
+    tcase_add_test(tc, test_msgTransactionSignAfterCancel);
     tcase_add_test(tc, test_msgTransactionSign14);
+    tcase_add_test(tc, test_msgTransactionSignConcurrentSessions);
+    tcase_add_test(tc, test_msgTransactionSignChangeFromAddressIndex);
     tcase_add_test(tc, test_transactionSignCheckEdges);
     tcase_add_test(tc, test_msgSkycoinAddressesAll);
     tcase_add_test(tc, test_msgSkycoinAddressesStartIndex);
     tcase_add_test(tc, test_msgSkycoinAddressesAllEmptyPassphrase);
     tcase_add_test(tc, test_msgSkycoinAddressesStartIndexEmptyPassphrase);
     tcase_add_test(tc, test_msgSkycoinAddressesTooMany);
+    tcase_add_test(tc, test_msgSkycoinAddressesCancelled);
+    tcase_add_test(tc, test_msgReadTinyDefersPipelinedRequest);
     tcase_add_test(tc, test_msgSkycoinAddressesFailWithoutMnemonic);
     tcase_add_test(tc, test_msgSkycoinSignMessageCheckMaxAddresses);
     return tc;
@@ -12,41 +12,46 @@
 #include <check.h>
 
 #include "test_bip32.h"
+#include "tiny-firmware/tests/test_arena.h"
 #include "tiny-firmware/tests/test_droplet.h"
 #include "tiny-firmware/tests/test_fsm.h"
 #include "tiny-firmware/tests/test_fsm_skycoin.h"
+#include "tiny-firmware/tests/test_oled.h"
+#include "tiny-firmware/tests/test_profile.h"
 #include "tiny-firmware/tests/test_protect.h"
 #include "tiny-firmware/tests/test_reset.h"
+#include "tiny-firmware/tests/test_runner.h"
 #include "tiny-firmware/tests/test_serialno.h"
 #include "tiny-firmware/tests/test_timer.h"
 
+// test cases of the suite, the runner shards on them
+static const TestCaseEntry test_cases[] = {
+    {"fsm", add_fsm_tests},
+    {"fsm_skycoin", add_fsm_skycoin_tests},
+    {"droplet", add_droplet_tests},
+    {"timer", add_timer_tests},
+    {"profile", add_profile_tests},
+    {"arena", add_arena_tests},
+    {"oled", add_oled_tests},
+    {"protect", add_protect_tests},
+    {"serialno", add_serialno_tests},
+    {"reset", add_reset_tests},
+    {"bip32", add_bip32_tests},
+};
+
 // define test suite and cases
 Suite* test_suite(void)
 {
     Suite* s = suite_create("firmware");
 
-    suite_add_tcase(s, add_fsm_tests(tcase_create("fsm")));
-    suite_add_tcase(s, add_fsm_skycoin_tests(tcase_create("fsm_skycoin")));
-    suite_add_tcase(s, add_droplet_tests(tcase_create("droplet")));
-    suite_add_tcase(s, add_timer_tests(tcase_create("timer")));
-    suite_add_tcase(s, add_protect_tests(tcase_create("protect")));
-    suite_add_tcase(s, add_serialno_tests(tcase_create("serialno")));
-    suite_add_tcase(s, add_reset_tests(tcase_create("reset")));
-    suite_add_tcase(s, add_bip32_tests(tcase_create("bip32")));
+    for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); ++i) {
+        suite_add_tcase(s, test_cases[i].add_tests(tcase_create(test_cases[i].name)));
+    }
     return s;
 }
 
 // run suite
-int main(void)
+int main(int argc, char** argv)
 {
-    int number_failed;
-    Suite* s = test_suite();
-    SRunner* sr = srunner_create(s);
-    srunner_run_all(sr, CK_VERBOSE);
-    number_failed = srunner_ntests_failed(sr);
-    srunner_free(sr);
-    if (number_failed == 0) {
-        printf("PASSED ALL TESTS\n");
-    }
-    return number_failed;
+    return test_runner_main(argc, argv, "firmware", test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
 }
@@ -0,0 +1,95 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "tiny-firmware/tests/test_oled.h"
+
+#include <string.h>
+
+#include "tiny-firmware/oled.h"
+
+// Page of the buffer holding row y, rows are stored bottom up
+#define PAGE_BIT(y) (1 << (OLED_HEIGHT / 8 - 1 - (y) / 8))
+
+static void oled_shown_blank(void)
+{
+    oledClear();
+    oledChangedPages();
+}
+
+START_TEST(test_oledChangedPagesPixel)
+{
+    oled_shown_blank();
+    ck_assert_uint_eq(oledChangedPages(), 0);
+    oledDrawPixel(10, 0);
+    oledDrawPixel(20, 60);
+    ck_assert_uint_eq(oledChangedPages(), PAGE_BIT(0) | PAGE_BIT(60));
+    ck_assert_uint_eq(oledChangedPages(), 0);
+    oledClearPixel(20, 60);
+    ck_assert_uint_eq(oledChangedPages(), PAGE_BIT(60));
+}
+END_TEST
+
+START_TEST(test_oledChangedPagesRedraw)
+{
+    oled_shown_blank();
+    oledDrawStringCenter(20, "Progress", FONT_STANDARD);
+    oledBox(0, 40, 63, 44, true);
+    uint8_t first = oledChangedPages();
+    ck_assert_uint_ne(first, 0);
+
+    // clearing and drawing the same screen again does not change the display
+    oledClear();
+    oledDrawStringCenter(20, "Progress", FONT_STANDARD);
+    oledBox(0, 40, 63, 44, true);
+    ck_assert_uint_eq(oledChangedPages(), 0);
+
+    // only the page of the longer bar changes
+    oledClear();
+    oledDrawStringCenter(20, "Progress", FONT_STANDARD);
+    oledBox(0, 40, 95, 44, true);
+    ck_assert_uint_eq(oledChangedPages(), PAGE_BIT(40));
+}
+END_TEST
+
+START_TEST(test_oledChangedPagesInvert)
+{
+    oled_shown_blank();
+    oledInvert(0, 0, OLED_WIDTH - 1, 7);
+    ck_assert_uint_eq(oledChangedPages(), PAGE_BIT(0));
+    oledInvert(0, 0, OLED_WIDTH - 1, 7);
+    oledInvert(0, 0, OLED_WIDTH - 1, 7);
+    ck_assert_uint_eq(oledChangedPages(), 0);
+}
+END_TEST
+
+START_TEST(test_oledChangedPagesSetBuffer)
+{
+    uint8_t buffer[OLED_BUFSIZE];
+    oled_shown_blank();
+    oledDrawPixel(0, 30);
+    oledChangedPages();
+    memcpy(buffer, oledGetBuffer(), sizeof(buffer));
+    oledSetBuffer(buffer);
+    ck_assert_uint_eq(oledChangedPages(), 0);
+    buffer[0] ^= 1;
+    oledSetBuffer(buffer);
+    ck_assert_uint_eq(oledChangedPages(), 1);
+}
+END_TEST
+
+TCase* add_oled_tests(TCase* tc)
+{
+    tcase_add_test(tc, test_oledChangedPagesPixel);
+    tcase_add_test(tc, test_oledChangedPagesRedraw);
+    tcase_add_test(tc, test_oledChangedPagesInvert);
+    tcase_add_test(tc, test_oledChangedPagesSetBuffer);
+    return tc;
+}
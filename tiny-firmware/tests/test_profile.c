@@ -0,0 +1,288 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "tiny-firmware/tests/test_profile.h"
+#include "tiny-firmware/firmware/benchmark.h"
+#include "tiny-firmware/firmware/profile.h"
+#include "tiny-firmware/firmware/stackmon.h"
+
+#if PROFILE
+
+#include <string.h>
+
+#if DEBUG_LINK
+#include <pb_decode.h>
+
+#include "messages.pb.h"
+#include "tiny-firmware/firmware/fsm.h"
+#include "tiny-firmware/firmware/messages.h"
+
+/* Reassemble the next reply queued for the debug link */
+static size_t debugReply(uint16_t* msg_id, uint8_t* payload, size_t size)
+{
+    const uint8_t* frame = msg_debug_out_data();
+    ck_assert_ptr_nonnull(frame);
+    ck_assert(frame[0] == '?' && frame[1] == '#' && frame[2] == '#');
+    *msg_id = (frame[3] << 8) + frame[4];
+    size_t len = (frame[5] << 24) + (frame[6] << 16) + (frame[7] << 8) + frame[8];
+    ck_assert_uint_le(len, size);
+    size_t pos = len < 64 - 9 ? len : 64 - 9;
+    memcpy(payload, frame + 9, pos);
+    while (pos < len) {
+        frame = msg_debug_out_data();
+        ck_assert_ptr_nonnull(frame);
+        size_t n = len - pos < 64 - 1 ? len - pos : 64 - 1;
+        memcpy(payload + pos, frame + 1, n);
+        pos += n;
+    }
+    ck_assert_ptr_null(msg_debug_out_data());
+    return len;
+}
+#endif // DEBUG_LINK
+
+START_TEST(test_profileRecordsInOrder)
+{
+    ProfileRecord records[PROFILE_RING_SIZE];
+    profile_clear();
+    PROFILE_BEGIN(first);
+    PROFILE_END(first, ProfilePhaseSign, 7);
+    PROFILE_BEGIN(second);
+    PROFILE_END(second, ProfilePhaseMessage, 42);
+
+    uint32_t dropped = 1;
+    ck_assert_uint_eq(profile_read(records, PROFILE_RING_SIZE, &dropped), 2);
+    ck_assert_uint_eq(dropped, 0);
+    ck_assert_uint_eq(records[0].phase, ProfilePhaseSign);
+    ck_assert_uint_eq(records[0].id, 7);
+    ck_assert_uint_eq(records[1].phase, ProfilePhaseMessage);
+    ck_assert_uint_eq(records[1].id, 42);
+    // Read records are gone
+    ck_assert_uint_eq(profile_read(records, PROFILE_RING_SIZE, NULL), 0);
+}
+END_TEST
+
+START_TEST(test_profileOverwritesOldest)
+{
+    ProfileRecord records[PROFILE_RING_SIZE];
+    profile_clear();
+    for (uint16_t i = 0; i < PROFILE_RING_SIZE + 5; i++) {
+        profile_record(ProfilePhaseFlashCommit, i, timer_cycles());
+    }
+
+    uint32_t dropped = 0;
+    ck_assert_uint_eq(profile_read(records, 2, &dropped), 2);
+    ck_assert_uint_eq(dropped, 5);
+    ck_assert_uint_eq(records[0].id, 5);
+    ck_assert_uint_eq(records[1].id, 6);
+    // The drop count is reported once
+    ck_assert_uint_eq(profile_read(records, PROFILE_RING_SIZE, &dropped), PROFILE_RING_SIZE - 2);
+    ck_assert_uint_eq(dropped, 0);
+    ck_assert_uint_eq(records[PROFILE_RING_SIZE - 3].id, PROFILE_RING_SIZE + 4);
+}
+END_TEST
+
+START_TEST(test_profileCyclesElapsed)
+{
+    ProfileRecord record;
+    profile_clear();
+    uint32_t start = timer_cycles() - 1000 * TIMER_CYCLES_PER_US;
+    profile_record(ProfilePhaseKeyDerivation, 0, start);
+    ck_assert_uint_eq(profile_read(&record, 1, NULL), 1);
+    ck_assert_uint_eq(record.start, start);
+    ck_assert_uint_ge(record.cycles, 1000 * TIMER_CYCLES_PER_US);
+}
+END_TEST
+
+static __attribute__((noinline)) uint8_t stackUser(size_t size)
+{
+    volatile uint8_t buffer[size];
+    memset((uint8_t*)buffer, 0, size);
+    return buffer[size / 2];
+}
+
+START_TEST(test_stackmonMeasuresDeepestUse)
+{
+    stackmon_paint(8192);
+    ck_assert_uint_eq(stackmon_used(), 0);
+    stackUser(2048);
+    size_t used = stackmon_used();
+    ck_assert_uint_ge(used, 2048);
+    ck_assert_uint_le(used, 8192);
+    // The mark stays after the stack is released
+    stackUser(1024);
+    ck_assert_uint_eq(stackmon_used(), used);
+}
+END_TEST
+
+START_TEST(test_stackmonPeakSinceReset)
+{
+    stackmon_init();
+    ck_assert_uint_eq(stackmon_size(), STACKMON_EMULATOR_STACK);
+    stackUser(4096);
+    size_t peak = stackmon_peak();
+    ck_assert_uint_ge(peak, 4096);
+    // a painting below the caller keeps the mark
+    stackmon_paint(1024);
+    ck_assert_uint_eq(stackmon_peak(), peak);
+    stackmon_reset();
+    ck_assert_uint_lt(stackmon_peak(), 4096);
+    stackUser(2048);
+    ck_assert_uint_ge(stackmon_peak(), 2048);
+}
+END_TEST
+
+START_TEST(test_benchmarkRunsEveryPrimitive)
+{
+    for (BenchmarkPrimitive primitive = BenchmarkChainStep; primitive <= BenchmarkFlashProgramWord; primitive++) {
+        BenchmarkResult result;
+        ck_assert_int_eq(benchmark_run(primitive, 3, &result), ErrOk);
+        ck_assert_uint_eq(result.iterations, 3);
+        ck_assert_uint_le(result.min_cycles, result.max_cycles);
+        ck_assert_uint_ge(result.total_cycles, (uint64_t)result.min_cycles * 3);
+        ck_assert_uint_le(result.total_cycles, (uint64_t)result.max_cycles * 3);
+    }
+
+    // A signature goes far deeper than the unpainted top of the probe
+    BenchmarkResult result;
+    ck_assert_int_eq(benchmark_run(BenchmarkSign, 1, &result), ErrOk);
+    ck_assert_uint_gt(result.stack_used, 1024);
+}
+END_TEST
+
+START_TEST(test_benchmarkRejectsInvalidArgs)
+{
+    BenchmarkResult result;
+    ck_assert_int_eq(benchmark_run(BenchmarkSign, 0, &result), ErrInvalidArg);
+    ck_assert_int_eq(benchmark_run(BenchmarkSign, BENCHMARK_MAX_ITERATIONS + 1, &result), ErrInvalidArg);
+    ck_assert_int_eq(benchmark_run(BenchmarkFlashProgramWord + 1, 1, &result), ErrInvalidArg);
+}
+END_TEST
+
+#if DEBUG_LINK && defined(DebugLinkProfile_init_default)
+
+START_TEST(test_debugLinkProfileReply)
+{
+    while (msg_debug_out_data() != NULL) {
+    }
+    profile_clear();
+    PROFILE_BEGIN(sign);
+    PROFILE_END(sign, ProfilePhaseSign, 7);
+    DebugLinkGetProfile msg = DebugLinkGetProfile_init_default;
+    fsm_msgDebugLinkGetProfile(&msg);
+
+    static uint8_t payload[MSG_DEBUG_OUT_SIZE];
+    uint16_t msg_id;
+    size_t len = debugReply(&msg_id, payload, sizeof(payload));
+    ck_assert_uint_eq(msg_id, MessageType_MessageType_DebugLinkProfile);
+    DebugLinkProfile reply = DebugLinkProfile_init_default;
+    pb_istream_t stream = pb_istream_from_buffer(payload, len);
+    ck_assert(pb_decode(&stream, DebugLinkProfile_fields, &reply));
+    ck_assert_uint_eq(reply.records_count, 1);
+    ck_assert_uint_eq(reply.records[0].phase, ProfilePhaseSign);
+    ck_assert_uint_eq(reply.records[0].id, 7);
+    ck_assert_uint_eq(reply.cycles_per_us, TIMER_CYCLES_PER_US);
+    ck_assert_uint_eq(reply.dropped, 0);
+}
+END_TEST
+
+#endif
+
+#if DEBUG_LINK && defined(DebugLinkBenchmark_init_default)
+
+START_TEST(test_debugLinkBenchmarkReply)
+{
+    while (msg_debug_out_data() != NULL) {
+    }
+    while (msg_out_data() != NULL) {
+    }
+    static uint8_t payload[MSG_DEBUG_OUT_SIZE];
+    uint16_t msg_id;
+    DebugLinkBenchmark msg = DebugLinkBenchmark_init_default;
+    msg.primitive = BenchmarkChainStep;
+    msg.has_iterations = true;
+    msg.iterations = 2;
+    fsm_msgDebugLinkBenchmark(&msg);
+    size_t len = debugReply(&msg_id, payload, sizeof(payload));
+    ck_assert_uint_eq(msg_id, MessageType_MessageType_DebugLinkBenchmarkResult);
+    DebugLinkBenchmarkResult result = DebugLinkBenchmarkResult_init_default;
+    pb_istream_t stream = pb_istream_from_buffer(payload, len);
+    ck_assert(pb_decode(&stream, DebugLinkBenchmarkResult_fields, &result));
+    ck_assert_uint_eq(result.iterations, 2);
+    ck_assert_uint_le(result.min_cycles, result.max_cycles);
+
+    // errors are answered on the debug link too
+    msg.iterations = 0;
+    fsm_msgDebugLinkBenchmark(&msg);
+    len = debugReply(&msg_id, payload, sizeof(payload));
+    ck_assert_uint_eq(msg_id, MessageType_MessageType_Failure);
+    Failure failure = Failure_init_default;
+    stream = pb_istream_from_buffer(payload, len);
+    ck_assert(pb_decode(&stream, Failure_fields, &failure));
+    ck_assert_int_eq(failure.code, FailureType_Failure_DataError);
+    ck_assert_ptr_null(msg_out_data());
+}
+END_TEST
+
+#endif
+
+#if DEBUG_LINK && defined(DebugLinkStackUsage_init_default)
+
+START_TEST(test_debugLinkStackUsageReply)
+{
+    while (msg_debug_out_data() != NULL) {
+    }
+    static uint8_t payload[MSG_DEBUG_OUT_SIZE];
+    uint16_t msg_id;
+    stackmon_init();
+    stackUser(4096);
+    DebugLinkGetStackUsage msg = DebugLinkGetStackUsage_init_default;
+    msg.has_reset = true;
+    msg.reset = true;
+    fsm_msgDebugLinkGetStackUsage(&msg);
+    size_t len = debugReply(&msg_id, payload, sizeof(payload));
+    ck_assert_uint_eq(msg_id, MessageType_MessageType_DebugLinkStackUsage);
+    DebugLinkStackUsage usage = DebugLinkStackUsage_init_default;
+    pb_istream_t stream = pb_istream_from_buffer(payload, len);
+    ck_assert(pb_decode(&stream, DebugLinkStackUsage_fields, &usage));
+    ck_assert_uint_ge(usage.peak, 4096);
+    ck_assert_uint_eq(usage.size, STACKMON_EMULATOR_STACK);
+    // the mark was reset once reported
+    ck_assert_uint_lt(stackmon_peak(), 4096);
+}
+END_TEST
+
+#endif
+
+#endif // PROFILE
+
+// define test cases, profiling is only built with PROFILE=1
+TCase* add_profile_tests(TCase* tc)
+{
+#if PROFILE
+    tcase_add_test(tc, test_profileRecordsInOrder);
+    tcase_add_test(tc, test_profileOverwritesOldest);
+    tcase_add_test(tc, test_profileCyclesElapsed);
+    tcase_add_test(tc, test_stackmonMeasuresDeepestUse);
+    tcase_add_test(tc, test_stackmonPeakSinceReset);
+    tcase_add_test(tc, test_benchmarkRunsEveryPrimitive);
+    tcase_add_test(tc, test_benchmarkRejectsInvalidArgs);
+#if DEBUG_LINK && defined(DebugLinkProfile_init_default)
+    tcase_add_test(tc, test_debugLinkProfileReply);
+#endif
+#if DEBUG_LINK && defined(DebugLinkBenchmark_init_default)
+    tcase_add_test(tc, test_debugLinkBenchmarkReply);
+#endif
+#if DEBUG_LINK && defined(DebugLinkStackUsage_init_default)
+    tcase_add_test(tc, test_debugLinkStackUsageReply);
+#endif
+#endif
+    return tc;
+}
@@ -0,0 +1,373 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include "test_runner.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ENV_FLASH_MODE "SKYWALLET_FLASH_MODE"
+#define ENV_RNG_SEED "SKYWALLET_RNG_SEED"
+
+#define RUNNER_SLOWEST_DEFAULT 10
+
+typedef struct {
+    const TestCaseEntry* entry;
+    unsigned long long seed;
+    pid_t pid;
+    struct timespec start;
+    double seconds;
+    bool crashed;
+    int tests;
+    int failed;
+    char log[256];
+    char xml[256];
+} RunnerShard;
+
+typedef struct {
+    const char* tcase;
+    char id[128];
+    double duration;
+    bool passed;
+} RunnerTest;
+
+static RunnerTest* runner_tests;
+static size_t runner_tests_count;
+static size_t runner_tests_size;
+
+static void usage(const char* prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-j jobs] [-s seed] [-S index/count] [-x file] [-n slowest] [-l] [tcase ...]\n"
+        "  -j jobs         test cases run at once, default 1\n"
+        "  -s seed         base of the " ENV_RNG_SEED " of every test case,\n"
+        "                  default " ENV_RNG_SEED " or the current time\n"
+        "  -S index/count  only run the test cases whose position modulo count is index\n"
+        "  -x file         write the merged check XML report to file\n"
+        "  -n slowest      number of slowest tests reported, default %d\n"
+        "  -l              list the test cases and exit\n",
+        prog, RUNNER_SLOWEST_DEFAULT);
+}
+
+static double elapsed(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Child process: run one test case with its own flash and seed, report in shard->xml
+static void run_shard(const char* suite_name, const RunnerShard* shard)
+{
+    char seed[32];
+    snprintf(seed, sizeof(seed), "%llu", shard->seed);
+    setenv(ENV_FLASH_MODE, "memory", 1);
+    setenv(ENV_RNG_SEED, seed, 1);
+
+    int fd = open(shard->log, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+
+    Suite* s = suite_create(suite_name);
+    suite_add_tcase(s, shard->entry->add_tests(tcase_create(shard->entry->name)));
+    SRunner* sr = srunner_create(s);
+    srunner_set_xml(sr, shard->xml);
+    srunner_run_all(sr, CK_VERBOSE);
+    int number_failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+    // exit rather than _exit, coverage data is written by the child
+    exit(number_failed != 0);
+}
+
+static void add_test(const RunnerShard* shard, const RunnerTest* test)
+{
+    if (runner_tests_count == runner_tests_size) {
+        runner_tests_size = runner_tests_size ? 2 * runner_tests_size : 64;
+        runner_tests = realloc(runner_tests, runner_tests_size * sizeof(RunnerTest));
+        if (runner_tests == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    runner_tests[runner_tests_count] = *test;
+    runner_tests[runner_tests_count].tcase = shard->entry->name;
+    runner_tests_count++;
+}
+
+static bool xml_value(const char* line, const char* tag, char* value, size_t size)
+{
+    char open_tag[32];
+    snprintf(open_tag, sizeof(open_tag), "<%s>", tag);
+    const char* begin = strstr(line, open_tag);
+    if (begin == NULL) {
+        return false;
+    }
+    begin += strlen(open_tag);
+    const char* end = strchr(begin, '<');
+    size_t len = end ? (size_t)(end - begin) : strlen(begin);
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(value, begin, len);
+    value[len] = '\0';
+    return true;
+}
+
+// Collect the tests of a shard report and copy its suite element to merged
+static void read_shard_xml(RunnerShard* shard, FILE* merged)
+{
+    FILE* fp = fopen(shard->xml, "r");
+    if (fp == NULL) {
+        return;
+    }
+    char line[1024];
+    char value[128];
+    bool in_suite = false;
+    RunnerTest test;
+    memset(&test, 0, sizeof(test));
+    while (fgets(line, sizeof(line), fp)) {
+        if (strstr(line, "<suite>")) {
+            in_suite = true;
+        }
+        if (in_suite && merged) {
+            fputs(line, merged);
+        }
+        if (strstr(line, "</suite>")) {
+            in_suite = false;
+        } else if (strstr(line, "<test result=")) {
+            memset(&test, 0, sizeof(test));
+            test.passed = strstr(line, "result=\"success\"") != NULL;
+        } else if (xml_value(line, "id", value, sizeof(value))) {
+            snprintf(test.id, sizeof(test.id), "%s", value);
+        } else if (xml_value(line, "duration", value, sizeof(value))) {
+            test.duration = strtod(value, NULL);
+        } else if (strstr(line, "</test>")) {
+            shard->tests++;
+            shard->failed += !test.passed;
+            add_test(shard, &test);
+        }
+    }
+    fclose(fp);
+}
+
+static void print_log(const RunnerShard* shard)
+{
+    FILE* fp = fopen(shard->log, "r");
+    if (fp == NULL) {
+        return;
+    }
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        fwrite(buf, 1, n, stdout);
+    }
+    fclose(fp);
+}
+
+static int compare_duration(const void* a, const void* b)
+{
+    double da = ((const RunnerTest*)a)->duration;
+    double db = ((const RunnerTest*)b)->duration;
+    return (da < db) - (da > db);
+}
+
+static bool selected(const char* name, int argc, char** argv)
+{
+    if (optind == argc) {
+        return true;
+    }
+    for (int i = optind; i < argc; ++i) {
+        if (strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int test_runner_main(int argc, char** argv, const char* suite_name, const TestCaseEntry* cases, size_t count)
+{
+    int jobs = 1;
+    int slowest = RUNNER_SLOWEST_DEFAULT;
+    unsigned shard_index = 0, shard_count = 1;
+    const char* xml_path = NULL;
+    const char* env_seed = getenv(ENV_RNG_SEED);
+    unsigned long long seed = env_seed ? strtoull(env_seed, NULL, 0) : (unsigned long long)time(NULL);
+    int opt;
+    while ((opt = getopt(argc, argv, "j:s:S:x:n:lh")) != -1) {
+        switch (opt) {
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'S':
+            if (sscanf(optarg, "%u/%u", &shard_index, &shard_count) != 2 || shard_index >= shard_count) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'x':
+            xml_path = optarg;
+            break;
+        case 'n':
+            slowest = atoi(optarg);
+            break;
+        case 'l':
+            for (size_t i = 0; i < count; ++i) {
+                printf("%s\n", cases[i].name);
+            }
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    for (int i = optind; i < argc; ++i) {
+        size_t j = 0;
+        while (j < count && strcmp(argv[i], cases[j].name) != 0) {
+            ++j;
+        }
+        if (j == count) {
+            fprintf(stderr, "Unknown test case %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    char dir[] = "/tmp/skywallet-tests-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    RunnerShard* shards = calloc(count, sizeof(RunnerShard));
+    if (shards == NULL) {
+        perror("calloc");
+        return 1;
+    }
+    size_t nshards = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (i % shard_count != shard_index || !selected(cases[i].name, argc, argv)) {
+            continue;
+        }
+        RunnerShard* shard = &shards[nshards++];
+        shard->entry = &cases[i];
+        shard->seed = seed + i;
+        snprintf(shard->log, sizeof(shard->log), "%s/%s.log", dir, cases[i].name);
+        snprintf(shard->xml, sizeof(shard->xml), "%s/%s.xml", dir, cases[i].name);
+    }
+    printf("Running %zu test cases, %d at once, " ENV_RNG_SEED "=%llu\n", nshards, jobs, seed);
+    fflush(stdout);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t next = 0, running = 0, done = 0;
+    while (done < nshards) {
+        while (next < nshards && running < (size_t)jobs) {
+            RunnerShard* shard = &shards[next++];
+            clock_gettime(CLOCK_MONOTONIC, &shard->start);
+            shard->pid = fork();
+            if (shard->pid < 0) {
+                perror("fork");
+                exit(1);
+            }
+            if (shard->pid == 0) {
+                run_shard(suite_name, shard);
+            }
+            running++;
+        }
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("waitpid");
+            exit(1);
+        }
+        for (size_t i = 0; i < nshards; ++i) {
+            RunnerShard* shard = &shards[i];
+            if (shard->pid != pid) {
+                continue;
+            }
+            shard->seconds = elapsed(&shard->start);
+            shard->crashed = !WIFEXITED(status) || WEXITSTATUS(status) > 1;
+            print_log(shard);
+            fflush(stdout);
+            running--;
+            done++;
+        }
+    }
+    double seconds = elapsed(&start);
+
+    FILE* merged = NULL;
+    if (xml_path) {
+        merged = fopen(xml_path, "w");
+        if (merged == NULL) {
+            perror(xml_path);
+        } else {
+            fprintf(merged,
+                "<?xml version=\"1.0\"?>\n"
+                "<?xml-stylesheet type=\"text/xsl\" href=\"http://check.sourceforge.net/xml/check_unittest.xslt\"?>\n"
+                "<testsuites xmlns=\"http://check.sourceforge.net/ns\">\n");
+        }
+    }
+    int number_failed = 0;
+    printf("\n%-16s %6s %6s %9s  %s\n", "tcase", "tests", "failed", "seconds", ENV_RNG_SEED);
+    for (size_t i = 0; i < nshards; ++i) {
+        RunnerShard* shard = &shards[i];
+        read_shard_xml(shard, merged);
+        if (shard->crashed || (shard->tests == 0 && shard->failed == 0)) {
+            // A crashed runner leaves no usable report, count the whole case as one failure
+            shard->failed++;
+        }
+        number_failed += shard->failed;
+        printf("%-16s %6d %6d %9.3f  %llu%s\n", shard->entry->name, shard->tests, shard->failed,
+            shard->seconds, shard->seed, shard->crashed ? "  crashed" : "");
+        unlink(shard->log);
+        unlink(shard->xml);
+    }
+    rmdir(dir);
+    if (merged) {
+        fprintf(merged, "  <duration>%f</duration>\n</testsuites>\n", seconds);
+        fclose(merged);
+    }
+
+    if (slowest > 0 && runner_tests_count > 0) {
+        qsort(runner_tests, runner_tests_count, sizeof(RunnerTest), compare_duration);
+        printf("\nSlowest tests:\n");
+        for (size_t i = 0; i < runner_tests_count && i < (size_t)slowest; ++i) {
+            printf("%9.3f  %s:%s%s\n", runner_tests[i].duration, runner_tests[i].tcase,
+                runner_tests[i].id, runner_tests[i].passed ? "" : "  FAILED");
+        }
+    }
+    printf("\n%zu test cases in %.3f s\n", nshards, seconds);
+    free(runner_tests);
+    free(shards);
+
+    if (number_failed == 0) {
+        printf("PASSED ALL TESTS\n");
+    }
+    return number_failed != 0;
+}
@@ -0,0 +1,28 @@
+/*
+ * This file is part of the Skycoin project, https://skycoin.net/
+ *
+ * Copyright (C) 2018-2019 Skycoin Project
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ */
+
+#include <check.h>
+#include <stddef.h>
+
+/**
+ * @brief Test case of the suite, the unit the runner shards on
+ */
+typedef struct {
+    const char* name;
+    TCase* (*add_tests)(TCase* tc);
+} TestCaseEntry;
+
+/**
+ * @brief Run test cases in child processes, several at once, then report their timings
+ * @param cases every test case of the suite, the seed of each one follows its position
+ * @return exit status of the test binary, non zero when a test failed
+ */
+int test_runner_main(int argc, char** argv, const char* suite_name, const TestCaseEntry* cases, size_t count);
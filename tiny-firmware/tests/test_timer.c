@@ -10,8 +10,17 @@
  */
 
 #include "tiny-firmware/tests/test_timer.h"
+#include "tiny-firmware/firmware/messages.h"
 #include "tiny-firmware/firmware/swtimer.h"
 #include "tiny-firmware/firmware/timerimpl.h"
+#include "tiny-firmware/timer.h"
+
+#if DEBUG_LINK
+#include <pb_decode.h>
+
+#include "messages.pb.h"
+#include "tiny-firmware/firmware/fsm.h"
+#endif
 
 // Defined in swtimer.c
 extern TIMER sw_timers[MAX_TIMERS];
@@ -102,6 +111,94 @@ START_TEST(test_swtimer_counter_desc)
 }
 END_TEST
 
+START_TEST(test_swtimer_next_deadline)
+{
+    TIMER timers[3];
+    for (int i = 0; i < 3; ++i) {
+        stopwatch_close_impl(timers + i);
+    }
+    // No countdown running
+    ck_assert_uint_eq(stopwatch_next_deadline_impl(timers, 3, 12345000), INFINITE_TS);
+    // Ascending counters never expire
+    stopwatch_start_impl(timers, 0, 12345000);
+    ck_assert_uint_eq(stopwatch_next_deadline_impl(timers, 3, 12345678), INFINITE_TS);
+    // The closest countdown wins
+    stopwatch_start_impl(timers + 1, 1000, 12345000);
+    stopwatch_start_impl(timers + 2, 500, 12345000);
+    ck_assert_uint_eq(stopwatch_next_deadline_impl(timers, 3, 12345100), 400);
+    ck_assert_uint_eq(stopwatch_next_deadline_impl(timers, 3, 12345600), 0);
+    stopwatch_close_impl(timers + 2);
+    ck_assert_uint_eq(stopwatch_next_deadline_impl(timers, 3, 12345600), 400);
+}
+END_TEST
+
+START_TEST(test_virtualClock)
+{
+    bool wasVirtual = emulatorVirtualTime();
+    emulatorSetVirtualTime(true);
+    uint32_t start = timer_ms();
+    SWTIMER timer = stopwatch_start(60000);
+    // the clock only moves when told to
+    ck_assert_uint_eq(timer_ms(), start);
+    ck_assert_uint_eq(stopwatch_counter(timer), 60000);
+    emulatorAdvanceTime(59999);
+    ck_assert_uint_eq(timer_ms(), start + 59999);
+    ck_assert_uint_eq(stopwatch_counter(timer), 1);
+    ck_assert_uint_eq(stopwatch_next_deadline(), 1);
+    emulatorAdvanceTime(1);
+    ck_assert_uint_eq(stopwatch_counter(timer), 0);
+    stopwatch_close(timer);
+    emulatorSetVirtualTime(wasVirtual);
+}
+END_TEST
+
+START_TEST(test_virtualClockKeepsHostQuietPeriod)
+{
+    bool wasVirtual = emulatorVirtualTime();
+    emulatorSetVirtualTime(true);
+    uint32_t start = timer_ms();
+    // idle detection runs on host time, the frozen clock does not stop it
+    uint32_t real_start = timer_real_ms();
+    while (timer_real_ms() - real_start < 20) {
+    }
+    ck_assert_uint_eq(timer_ms(), start);
+    ck_assert(msg_read_idle(10));
+    emulatorSetVirtualTime(wasVirtual);
+}
+END_TEST
+
+#if DEBUG_LINK && defined(DebugLinkAdvanceTime_init_default)
+
+START_TEST(test_debugLinkAdvanceTimeReply)
+{
+    while (msg_debug_out_data() != NULL) {
+    }
+    bool wasVirtual = emulatorVirtualTime();
+    emulatorSetVirtualTime(true);
+    uint32_t start = timer_ms();
+    DebugLinkAdvanceTime msg = DebugLinkAdvanceTime_init_default;
+    msg.ms = 1500;
+    fsm_msgDebugLinkAdvanceTime(&msg);
+    ck_assert_uint_eq(timer_ms(), start + 1500);
+
+    // the answer fits in a single report
+    const uint8_t* frame = msg_debug_out_data();
+    ck_assert_ptr_nonnull(frame);
+    ck_assert_ptr_null(msg_debug_out_data());
+    ck_assert_uint_eq((frame[3] << 8) + frame[4], MessageType_MessageType_DebugLinkTime);
+    uint32_t len = (frame[5] << 24) + (frame[6] << 16) + (frame[7] << 8) + frame[8];
+    ck_assert_uint_le(len, 64 - 9);
+    DebugLinkTime reply = DebugLinkTime_init_default;
+    pb_istream_t stream = pb_istream_from_buffer(frame + 9, len);
+    ck_assert(pb_decode(&stream, DebugLinkTime_fields, &reply));
+    ck_assert_uint_eq(reply.now_ms, start + 1500);
+    ck_assert(reply.virtual_time);
+    emulatorSetVirtualTime(wasVirtual);
+}
+END_TEST
+
+#endif
+
 /*
 START_TEST(test_swtimer_asc_overflow)
 {
@@ -127,6 +224,12 @@ TCase* add_timer_tests(TCase* tc)
     tcase_add_test(tc, test_swtimer_inactive);
     tcase_add_test(tc, test_swtimer_counter_asc);
     tcase_add_test(tc, test_swtimer_counter_desc);
+    tcase_add_test(tc, test_swtimer_next_deadline);
+    tcase_add_test(tc, test_virtualClock);
+    tcase_add_test(tc, test_virtualClockKeepsHostQuietPeriod);
+#if DEBUG_LINK && defined(DebugLinkAdvanceTime_init_default)
+    tcase_add_test(tc, test_debugLinkAdvanceTimeReply);
+#endif
     /* tcase_add_test(tc, test_swtimer_asc_overflow);
   tcase_add_test(tc, test_swtimer_counter_overflow);
   tcase_add_test(tc, test_swtimer_full); */
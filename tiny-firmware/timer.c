@@ -20,10 +20,12 @@
 
 #include "tiny-firmware/timer.h"
 
+#include <libopencm3/cm3/dwt.h>
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/cm3/vector.h>
 #include <libopencm3/stm32/rcc.h>
 
+#include <tiny-firmware/firmware/profile.h>
 #include <tiny-firmware/firmware/swtimer.h>
 #include <tiny-firmware/rng.h>
 
@@ -59,6 +61,11 @@ void timer_init(void)
     systick_interrupt_enable();
     systick_counter_enable();
 
+#if PROFILE
+    /* DWT must be set up before switching to unprivileged mode */
+    dwt_enable_cycle_counter();
+#endif
+
     timer_init_sw();
 }
 
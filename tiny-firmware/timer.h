@@ -27,8 +27,16 @@ void timer_init(void);
 
 #if EMULATOR
 uint32_t timer_ms(void);
+// Host time, it keeps moving when the emulator runs on a virtual clock
+uint32_t timer_real_ms(void);
+uint32_t timer_cycles(void);
 #else
 #define timer_ms svc_timer_ms
+#define timer_real_ms svc_timer_ms
+#define timer_cycles svc_timer_cycles
 #endif
 
+// Core clock, timer_cycles() ticks per microsecond
+#define TIMER_CYCLES_PER_US 120
+
 #endif
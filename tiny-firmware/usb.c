@@ -213,6 +213,9 @@ void usbInit(void)
 void usbPoll(void)
 {
     static const uint8_t* data;
+    if (!tiny) {
+        msg_read_deferred();
+    }
     // poll read buffer
     usbd_poll(usbd_dev);
     // write pending data